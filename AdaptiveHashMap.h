@@ -0,0 +1,267 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+
+template <typename Key, typename T>
+struct adaptive_hash_value
+{
+  using type = std::pair<const Key, T>;
+};
+
+template <typename Key>
+struct adaptive_hash_value<Key, void>
+{
+  using type = Key;
+};
+
+// Hash map (or set, with T = void) keeping its elements in one array, in
+// two forms: up to SmallSize elements the array is scanned linearly, and
+// past that the map promotes itself to an indexed form, adding a
+// std::pmr::unordered_map from keys to their position in the array. Most
+// maps of the cache (the orders of a security, their matches) hold a
+// handful of elements, for which the array alone saves the nodes and
+// bucket array of a hash table and looks keys up in a cache line or two,
+// while deep books keep constant time lookups. Either way iterating is a
+// walk over the array.
+//
+// The small form isn't stored inline: like the index, the array is
+// allocated from the memory resource given at construction (the cache's
+// pool), as inline room for SmallSize orders would make every security
+// several KiB larger, whether it has orders or not. An empty map holds no
+// storage at all; the array grows by doubling.
+//
+// A map is only demoted (drops its index once it holds SmallSize / 2
+// elements or less, gives back most of the array once it is mostly empty,
+// and all of its storage once it is empty) by compact() and by
+// erase(key), so that loops erasing elements through iterators aren't
+// invalidated: erase(iterator) moves the last element into the erased
+// slot and returns an iterator to it.
+//
+// Iteration order is insertion order, perturbed by erasures. Pointers to
+// elements are only stable while nothing is inserted (which may grow the
+// array) or erased.
+template <typename Key, typename T, typename Hash = std::hash<Key>, uint32_t SmallSize = 8>
+class AdaptiveHashMap
+{
+  static constexpr bool is_set = std::is_void_v<T>;
+  using index_type = std::pmr::unordered_map<Key, uint32_t, Hash>;
+
+public:
+  using key_type = Key;
+  using value_type = typename adaptive_hash_value<Key, T>::type;
+  using size_type = size_t;
+  // keys can't be changed through iterators
+  using iterator = std::conditional_t<is_set, const value_type *, value_type *>;
+  using const_iterator = const value_type *;
+
+  explicit AdaptiveHashMap(std::pmr::memory_resource *resource = std::pmr::get_default_resource()) : _resource(resource) {}
+
+  AdaptiveHashMap(AdaptiveHashMap &&other) noexcept
+      : _resource(other._resource), _slots(std::exchange(other._slots, nullptr)), _size(std::exchange(other._size, 0)),
+        _capacity(std::exchange(other._capacity, 0)), _index(std::exchange(other._index, nullptr)) {}
+  AdaptiveHashMap(const AdaptiveHashMap &) = delete;
+  AdaptiveHashMap &operator=(const AdaptiveHashMap &) = delete;
+
+  ~AdaptiveHashMap()
+  {
+    clear();
+    release_slots();
+    release_index();
+  }
+
+  // whether the map is in its indexed form
+  bool indexed() const { return _index != nullptr; }
+
+  size_t size() const { return _size; }
+  bool empty() const { return _size == 0; }
+  size_t capacity() const { return _capacity; }
+
+  iterator begin() { return _slots; }
+  iterator end() { return _slots + _size; }
+  const_iterator begin() const { return _slots; }
+  const_iterator end() const { return _slots + _size; }
+
+  iterator find(const Key &key) { return _slots + position(key); }
+  const_iterator find(const Key &key) const { return _slots + position(key); }
+  size_t count(const Key &key) const { return position(key) != _size ? 1 : 0; }
+
+  template <typename... Args>
+  std::pair<iterator, bool> try_emplace(const Key &key, Args &&...args)
+  {
+    const auto pos = position(key);
+    if (pos != _size)
+      return {_slots + pos, false};
+
+    if (_size == _capacity)
+      resize_slots(std::max(_capacity * 2, 1u));
+    if constexpr (is_set)
+      new (_slots + _size) value_type(key);
+    else
+      new (_slots + _size) value_type(std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple(std::forward<Args>(args)...));
+    ++_size;
+
+    if (_index != nullptr)
+      _index->emplace(key, pos);
+    else if (_size > SmallSize)
+      build_index(_size);
+    return {_slots + pos, true};
+  }
+
+  std::pair<iterator, bool> insert(const value_type &value)
+  {
+    if constexpr (is_set)
+      return try_emplace(value);
+    else
+      return try_emplace(value.first, value.second);
+  }
+
+  // never demotes the map, see above
+  iterator erase(const_iterator pos)
+  {
+    auto *slot = const_cast<value_type *>(pos);
+    auto *last = _slots + _size - 1;
+    if (_index != nullptr)
+      _index->erase(key_of(*slot));
+    if (slot != last)
+    {
+      slot->~value_type();
+      new (slot) value_type(std::move(*last));
+      if (_index != nullptr)
+        _index->find(key_of(*slot))->second = static_cast<uint32_t>(slot - _slots);
+    }
+    last->~value_type();
+    --_size;
+    return slot;
+  }
+
+  // may demote the map (invalidating iterators)
+  size_t erase(const Key &key)
+  {
+    const auto pos = position(key);
+    if (pos == _size)
+      return 0;
+    erase(_slots + pos);
+    compact();
+    return 1;
+  }
+
+  // keeps the form (and capacity)
+  void clear()
+  {
+    for (uint32_t i = 0; i != _size; ++i)
+      _slots[i].~value_type();
+    _size = 0;
+    if (_index != nullptr)
+      _index->clear();
+  }
+
+  void reserve(size_t count)
+  {
+    if (count > _capacity)
+      resize_slots(static_cast<uint32_t>(count));
+    if (count > SmallSize)
+    {
+      if (_index == nullptr)
+        build_index(count);
+      else
+        _index->reserve(count);
+    }
+  }
+
+  // drop the index once the map holds SmallSize / 2 elements or less,
+  // halve the array while it is less than a quarter full, and free both
+  // once the map is empty (invalidating iterators)
+  void compact()
+  {
+    if (_index != nullptr && _size <= SmallSize / 2)
+      release_index();
+    if (_size == 0)
+    {
+      release_slots();
+      return;
+    }
+
+    auto capacity = _capacity;
+    while (capacity > SmallSize && _size < capacity / 4)
+      capacity /= 2;
+    if (capacity != _capacity)
+      resize_slots(std::max(capacity, SmallSize));
+  }
+
+private:
+  static const Key &key_of(const value_type &value)
+  {
+    if constexpr (is_set)
+      return value;
+    else
+      return value.first;
+  }
+
+  // of the key in the array, or the size of the map
+  uint32_t position(const Key &key) const
+  {
+    if (_index != nullptr)
+    {
+      const auto it = _index->find(key);
+      return it != _index->end() ? it->second : _size;
+    }
+
+    uint32_t pos = 0;
+    while (pos != _size && !(key_of(_slots[pos]) == key))
+      ++pos;
+    return pos;
+  }
+
+  void resize_slots(uint32_t capacity)
+  {
+    auto *slots = static_cast<value_type *>(_resource->allocate(capacity * sizeof(value_type), alignof(value_type)));
+    for (uint32_t i = 0; i != _size; ++i)
+    {
+      new (slots + i) value_type(std::move(_slots[i]));
+      _slots[i].~value_type();
+    }
+    release_slots();
+    _slots = slots;
+    _capacity = capacity;
+  }
+
+  void release_slots()
+  {
+    if (_slots != nullptr)
+      _resource->deallocate(_slots, _capacity * sizeof(value_type), alignof(value_type));
+    _slots = nullptr;
+    _capacity = 0;
+  }
+
+  void build_index(size_t count)
+  {
+    _index = new (_resource->allocate(sizeof(index_type), alignof(index_type))) index_type(_resource);
+    _index->reserve(count);
+    for (uint32_t i = 0; i != _size; ++i)
+      _index->emplace(key_of(_slots[i]), i);
+  }
+
+  void release_index()
+  {
+    if (_index != nullptr)
+    {
+      _index->~index_type();
+      _resource->deallocate(_index, sizeof(index_type), alignof(index_type));
+    }
+    _index = nullptr;
+  }
+
+  std::pmr::memory_resource *_resource;
+  value_type *_slots = nullptr;
+  uint32_t _size = 0;
+  uint32_t _capacity = 0;
+  index_type *_index = nullptr; // key -> position, once promoted
+};
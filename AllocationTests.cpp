@@ -0,0 +1,117 @@
+#include "OrderCacheImpl.h"
+#include "gtest/gtest.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// Tests counting the heap allocations of the whole program, with a
+// replacement of every form of the global operator new and delete: built
+// into their own executable, so that the other tests keep the default
+// allocator.
+
+static std::atomic<size_t> heap_allocations{0};
+
+namespace
+{
+    // not inlined into callers, so that the compiler doesn't see memory from
+    // operator new reaching std::free (-Wmismatched-new-delete)
+    [[gnu::noinline]] void *allocate(std::size_t size, std::size_t alignment)
+    {
+        heap_allocations.fetch_add(1, std::memory_order_relaxed);
+        size = size != 0 ? size : 1;
+        if (alignment > alignof(std::max_align_t))
+            return std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+        return std::malloc(size);
+    }
+
+    [[gnu::noinline]] void deallocate(void *p) noexcept { std::free(p); }
+}
+
+void *operator new(std::size_t size)
+{
+    if (auto *p = allocate(size, alignof(std::max_align_t)))
+        return p;
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size)
+{
+    if (auto *p = allocate(size, alignof(std::max_align_t)))
+        return p;
+    throw std::bad_alloc();
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment)
+{
+    if (auto *p = allocate(size, static_cast<std::size_t>(alignment)))
+        return p;
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment)
+{
+    if (auto *p = allocate(size, static_cast<std::size_t>(alignment)))
+        return p;
+    throw std::bad_alloc();
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept { return allocate(size, alignof(std::max_align_t)); }
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept { return allocate(size, alignof(std::max_align_t)); }
+void *operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept { return allocate(size, static_cast<std::size_t>(alignment)); }
+void *operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept { return allocate(size, static_cast<std::size_t>(alignment)); }
+
+void operator delete(void *p) noexcept { deallocate(p); }
+void operator delete[](void *p) noexcept { deallocate(p); }
+void operator delete(void *p, std::size_t) noexcept { deallocate(p); }
+void operator delete[](void *p, std::size_t) noexcept { deallocate(p); }
+void operator delete(void *p, std::align_val_t) noexcept { deallocate(p); }
+void operator delete[](void *p, std::align_val_t) noexcept { deallocate(p); }
+void operator delete(void *p, std::size_t, std::align_val_t) noexcept { deallocate(p); }
+void operator delete[](void *p, std::size_t, std::align_val_t) noexcept { deallocate(p); }
+void operator delete(void *p, const std::nothrow_t &) noexcept { deallocate(p); }
+void operator delete[](void *p, const std::nothrow_t &) noexcept { deallocate(p); }
+void operator delete(void *p, std::align_val_t, const std::nothrow_t &) noexcept { deallocate(p); }
+void operator delete[](void *p, std::align_val_t, const std::nothrow_t &) noexcept { deallocate(p); }
+
+// heap allocations of a round of adds, matching size reads and cancels of
+// orders with short (SSO) ids, after `warmup` identical rounds
+template <typename Cache>
+size_t steady_state_allocations(const int warmup)
+{
+    Cache cache;
+    std::vector<std::string> order_ids, security_ids;
+    for (auto i = 0; i != 200; ++i)
+        order_ids.push_back("OrdId" + std::to_string(i));
+    for (auto i = 0; i != 4; ++i)
+        security_ids.push_back("SecId" + std::to_string(i));
+
+    size_t allocations = 0;
+    for (auto round = 0; round <= warmup; ++round)
+    {
+        std::vector<Order> orders;
+        for (auto i = 0; i != 200; ++i)
+            orders.push_back(Order{order_ids[i], security_ids[i % 4], i % 3 == 0 ? "Sell" : "Buy", 100u * (1 + i % 7),
+                                   "User" + std::to_string(i % 8), "Company" + std::to_string(i % 5)});
+
+        const auto before = heap_allocations.load();
+        for (auto &order : orders)
+            cache.addOrder(std::move(order));
+        for (const auto &security_id : security_ids)
+            cache.getMatchingSizeForSecurity(std::string_view(security_id));
+        for (const auto &order_id : order_ids)
+            cache.cancelOrder(std::string_view(order_id));
+        allocations = heap_allocations.load() - before;
+    }
+    return allocations;
+}
+
+// Test Z1: Once the pools are warm, adding and cancelling orders doesn't allocate
+TEST(AllocationTest, Z1_AllocationTest_SteadyStateHotPath)
+{
+    // the first round allocates the pools' blocks and the containers' buckets
+    ASSERT_GT(steady_state_allocations<BasicOrderCache<NullLockPolicy>>(0), 0);
+
+    ASSERT_EQ(steady_state_allocations<BasicOrderCache<NullLockPolicy>>(2), 0);
+    ASSERT_EQ(steady_state_allocations<BasicOrderCache<SharedMutexLockPolicy>>(2), 0);
+    ASSERT_EQ(steady_state_allocations<BasicOrderCache<ShardedLockPolicy<4>>>(2), 0);
+}
@@ -0,0 +1,266 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <variant>
+
+#include "MpscRing.h"
+#include "OrderCache.h"
+
+// Single-writer front end for an order cache: producers push add/cancel
+// commands into a lock-free MPSC ring (MpscRing.h) and one writer thread
+// drains it in batches, applies them to the cache and completes their
+// futures/callbacks. Producers never wait for the cache locks, and runs of
+// consecutive adds in a batch go through one addOrders call (one lock and,
+// with a journal, one journal commit for all of them).
+//
+// Commands from one producer are applied in the order they were pushed.
+// When the ring is full producers wait for the writer to make room.
+//
+// Reads go directly to the cache (cache()), so Cache needs a thread safe
+// lock policy if they may run while the writer does; flush() gives
+// read-your-writes.
+template <typename Cache = OrderCache>
+class AsyncOrderCache
+{
+public:
+  // completion callback, run on the writer thread: error is null on
+  // success (must not throw)
+  using Callback = std::function<void(std::exception_ptr error)>;
+
+  // capacity: commands the ring holds; max_batch: most commands applied
+  // per batch
+  explicit AsyncOrderCache(size_t capacity = 1 << 16, size_t max_batch = 1024)
+      : _ring(capacity), _max_batch(max_batch)
+  {
+    _writer = std::thread([this]()
+                          { writer_loop(); });
+  }
+
+  // applies the pending commands before returning
+  ~AsyncOrderCache()
+  {
+    _stop.store(true);
+    wake_writer();
+    _writer.join();
+  }
+
+  AsyncOrderCache(const AsyncOrderCache &) = delete;
+  AsyncOrderCache &operator=(const AsyncOrderCache &) = delete;
+
+  std::future<void> addOrder(Order order) { return submit(Command{CommandType::AddOrder, std::move(order)}); }
+  void addOrder(Order order, Callback callback) { submit(Command{CommandType::AddOrder, std::move(order)}, std::move(callback)); }
+
+  std::future<void> cancelOrder(std::string orderId) { return submit(Command{CommandType::CancelOrder, std::nullopt, std::move(orderId)}); }
+  void cancelOrder(std::string orderId, Callback callback) { submit(Command{CommandType::CancelOrder, std::nullopt, std::move(orderId)}, std::move(callback)); }
+
+  std::future<void> cancelOrdersForUser(std::string user) { return submit(Command{CommandType::CancelOrdersForUser, std::nullopt, std::move(user)}); }
+  void cancelOrdersForUser(std::string user, Callback callback) { submit(Command{CommandType::CancelOrdersForUser, std::nullopt, std::move(user)}, std::move(callback)); }
+
+  std::future<void> cancelOrdersForSecIdWithMinimumQty(std::string securityId, unsigned int minQty)
+  {
+    return submit(Command{CommandType::CancelOrdersForSecIdWithMinimumQty, std::nullopt, std::move(securityId), minQty});
+  }
+  void cancelOrdersForSecIdWithMinimumQty(std::string securityId, unsigned int minQty, Callback callback)
+  {
+    submit(Command{CommandType::CancelOrdersForSecIdWithMinimumQty, std::nullopt, std::move(securityId), minQty}, std::move(callback));
+  }
+
+  // completes once every command pushed before it has been applied
+  std::future<void> flush() { return submit(Command{CommandType::Flush}); }
+
+  Cache &cache() { return _cache; }
+  const Cache &cache() const { return _cache; }
+
+  // commands taken by the writer, and batches they were applied in
+  uint64_t commandCount() const { return _commands.load(std::memory_order_relaxed); }
+  uint64_t batchCount() const { return _batches.load(std::memory_order_relaxed); }
+
+private:
+  enum class CommandType : uint8_t
+  {
+    AddOrder,
+    CancelOrder,
+    CancelOrdersForUser,
+    CancelOrdersForSecIdWithMinimumQty,
+    Flush,
+  };
+
+  struct Command
+  {
+    CommandType type = CommandType::Flush;
+    std::optional<Order> order{}; // AddOrder
+    std::string id{};             // order id, user or security id
+    unsigned int min_qty = 0;
+    std::variant<std::monostate, std::promise<void>, Callback> completion{};
+  };
+
+  std::future<void> submit(Command &&command)
+  {
+    auto future = command.completion.template emplace<std::promise<void>>().get_future();
+    push(command);
+    return future;
+  }
+
+  void submit(Command &&command, Callback callback)
+  {
+    if (callback)
+      command.completion = std::move(callback);
+    push(command);
+  }
+
+  void push(Command &command)
+  {
+    while (_ring.try_push(command) == false)
+      std::this_thread::yield();
+
+    // pairs with the fence in writer_loop: either the writer sees the
+    // command before sleeping, or this sees it sleeping and wakes it
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (_sleeping.load(std::memory_order_relaxed) == true)
+      wake_writer();
+  }
+
+  void wake_writer()
+  {
+    std::lock_guard lock(_wake_mutex);
+    _wake_cv.notify_one();
+  }
+
+  void writer_loop()
+  {
+    std::vector<Command> batch;
+    batch.reserve(_max_batch);
+    std::vector<Order> orders;
+    unsigned int idle = 0;
+
+    while (true)
+    {
+      while (batch.size() < _max_batch)
+      {
+        auto command = _ring.try_pop();
+        if (command.has_value() == false)
+          break;
+        batch.push_back(std::move(*command));
+      }
+
+      if (batch.empty() == false)
+      {
+        // counted first, so that they include commands already completed
+        _commands.fetch_add(batch.size(), std::memory_order_relaxed);
+        _batches.fetch_add(1, std::memory_order_relaxed);
+        apply(batch, orders);
+        batch.clear();
+        idle = 0;
+        continue;
+      }
+
+      if (_stop.load() == true)
+        break;
+
+      // spin for a while before sleeping, as commands tend to come in bursts
+      if (++idle < 64)
+      {
+        std::this_thread::yield();
+        continue;
+      }
+
+      std::unique_lock lock(_wake_mutex);
+      _sleeping.store(true, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (_ring.empty() == true && _stop.load() == false)
+        _wake_cv.wait_for(lock, std::chrono::milliseconds(10));
+      _sleeping.store(false, std::memory_order_relaxed);
+    }
+  }
+
+  void apply(std::vector<Command> &batch, std::vector<Order> &orders)
+  {
+    for (size_t i = 0; i != batch.size();)
+    {
+      std::exception_ptr error;
+
+      if (batch[i].type == CommandType::AddOrder)
+      {
+        // a run of adds goes through the bulk path
+        auto end = i;
+        orders.clear();
+        for (; end != batch.size() && batch[end].type == CommandType::AddOrder; ++end)
+          orders.push_back(std::move(*batch[end].order));
+
+        try
+        {
+          _cache.addOrders(std::move(orders));
+        }
+        catch (...)
+        {
+          error = std::current_exception();
+        }
+
+        for (; i != end; ++i)
+          complete(batch[i], error);
+        continue;
+      }
+
+      try
+      {
+        auto &command = batch[i];
+        switch (command.type)
+        {
+        case CommandType::CancelOrder:
+          _cache.cancelOrder(command.id);
+          break;
+        case CommandType::CancelOrdersForUser:
+          _cache.cancelOrdersForUser(command.id);
+          break;
+        case CommandType::CancelOrdersForSecIdWithMinimumQty:
+          _cache.cancelOrdersForSecIdWithMinimumQty(command.id, command.min_qty);
+          break;
+        default:
+          break;
+        }
+      }
+      catch (...)
+      {
+        error = std::current_exception();
+      }
+
+      complete(batch[i], error);
+      ++i;
+    }
+  }
+
+  static void complete(Command &command, const std::exception_ptr &error)
+  {
+    if (auto promise = std::get_if<std::promise<void>>(&command.completion))
+    {
+      if (error)
+        promise->set_exception(error);
+      else
+        promise->set_value();
+    }
+    else if (auto callback = std::get_if<Callback>(&command.completion))
+      (*callback)(error);
+  }
+
+  Cache _cache;
+  MpscRing<Command> _ring;
+  const size_t _max_batch;
+
+  std::atomic<bool> _stop{false};
+  std::atomic<bool> _sleeping{false};
+  std::mutex _wake_mutex;
+  std::condition_variable _wake_cv;
+
+  std::atomic<uint64_t> _commands{0};
+  std::atomic<uint64_t> _batches{0};
+
+  std::thread _writer;
+};
@@ -0,0 +1,65 @@
+#include "ChangeFeed.h"
+#include <algorithm>
+#include <stdexcept>
+
+ChangeFeed::ChangeFeed(size_t capacity)
+{
+  if (capacity == 0)
+    throw std::invalid_argument("change feed capacity must not be zero");
+
+  // the slots keep their strings, so that changes of orders with ids of
+  // similar sizes are copied without allocating
+  _ring.resize(capacity);
+}
+
+uint64_t ChangeFeed::version() const
+{
+  std::lock_guard lock(_mutex);
+  return _next_version - 1;
+}
+
+OrderChanges ChangeFeed::getChangesSince(uint64_t version, size_t max_changes) const
+{
+  std::lock_guard lock(_mutex);
+
+  OrderChanges changes;
+  const auto latest = _next_version - 1;
+  const auto oldest = _next_version - _size; // first version in the ring
+  if (version < _reset_version || version + 1 < oldest || version > latest)
+  {
+    changes.resync = true;
+    changes.version = latest;
+    return changes;
+  }
+
+  const auto count = static_cast<size_t>(std::min<uint64_t>(latest - version, max_changes));
+  changes.changes.reserve(count);
+  for (auto v = version + 1; v != version + 1 + count; ++v)
+    changes.changes.push_back(_ring[v % _ring.size()]);
+  changes.version = version + count;
+  return changes;
+}
+
+void ChangeFeed::append(OrderChangeType type, const Order &order, unsigned int unmatched)
+{
+  std::lock_guard lock(_mutex);
+  const auto version = _next_version++;
+  auto &change = _ring[version % _ring.size()];
+  change.version = version;
+  change.type = type;
+  change.order_id = order.orderIdView();
+  change.security_id = order.securityIdView();
+  change.side = order.sideView();
+  change.qty = order.qty();
+  change.user = order.userView();
+  change.company = order.companyView();
+  change.unmatched = unmatched;
+  _size = std::min(_size + 1, _ring.size());
+}
+
+void ChangeFeed::reset()
+{
+  std::lock_guard lock(_mutex);
+  _reset_version = _next_version++;
+  _size = 0;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "OrderCache.h"
+
+// a change of an order, with its state after the change
+struct OrderChange
+{
+  uint64_t version = 0;
+  OrderChangeType type = OrderChangeType::Added;
+  std::string order_id;
+  std::string security_id;
+  std::string side;
+  unsigned int qty = 0;
+  std::string user;
+  std::string company;
+  unsigned int unmatched = 0; // qty of the order not matched
+
+  Order order() const { return Order{order_id, security_id, side, qty, user, company}; }
+};
+
+struct OrderChanges
+{
+  // the changes after the requested version aren't all available anymore
+  // (or are from before a reset): the consumer must reload the orders with
+  // getAllOrders, then ask for the changes after `version`
+  bool resync = false;
+  uint64_t version = 0; // of the last change returned (or the latest one, to resync)
+  std::vector<OrderChange> changes;
+};
+
+// Feed of the order-level changes of a cache, fed by
+// BasicOrderCache::setChangeFeed, so that downstream copies of the orders
+// can follow the cache with the changes since the version they have
+// instead of diffing getAllOrders.
+//
+// Every change gets the next version and goes into a ring of the latest
+// `capacity` changes; a consumer that has fallen further behind is told
+// to resync. Changes carry the whole state of their order, so applying
+// them in order is idempotent: a consumer can take version(), then
+// getAllOrders(), then apply the changes since that version, some of which
+// may already be in the orders it got.
+class ChangeFeed
+{
+public:
+  explicit ChangeFeed(size_t capacity = 1 << 16);
+
+  ChangeFeed(const ChangeFeed &) = delete;
+  ChangeFeed &operator=(const ChangeFeed &) = delete;
+
+  size_t capacity() const { return _ring.size(); }
+
+  // version of the latest change (or reset)
+  uint64_t version() const;
+
+  // the (at most max_changes first) changes after `version`, oldest first
+  OrderChanges getChangesSince(uint64_t version, size_t max_changes = std::numeric_limits<size_t>::max()) const;
+
+  // called by the cache, with the order's security locked
+  void append(OrderChangeType type, const Order &order, unsigned int unmatched);
+
+  // forget the changes, so that every consumer resyncs (called by the cache
+  // when attached and when it loads a snapshot)
+  void reset();
+
+private:
+  mutable std::mutex _mutex;
+  std::vector<OrderChange> _ring; // change of version v at v % capacity
+  uint64_t _next_version = 1;
+  uint64_t _reset_version = 0; // consumers before it must resync
+  size_t _size = 0;            // changes in the ring
+};
@@ -0,0 +1,726 @@
+#include "Gateway.h"
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#define ORDERCACHE_HAVE_UNIX_SOCKETS 1
+#endif
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#define ORDERCACHE_HAVE_EPOLL 1
+#endif
+
+namespace
+{
+  [[noreturn]] void fail(const std::string &path, const std::string &what)
+  {
+    throw std::runtime_error("gateway " + path + ": " + what + (errno != 0 ? std::string(" (") + std::strerror(errno) + ")" : ""));
+  }
+
+  void put_u8(std::string &out, uint8_t value) { out.push_back(static_cast<char>(value)); }
+
+  void put_u32(std::string &out, uint32_t value)
+  {
+    char bytes[sizeof(value)];
+    std::memcpy(bytes, &value, sizeof(value));
+    out.append(bytes, sizeof(bytes));
+  }
+
+  void put_string(std::string &out, std::string_view str)
+  {
+    if (str.size() > UINT16_MAX)
+      throw std::runtime_error("gateway: string too long");
+    const auto size = static_cast<uint16_t>(str.size());
+    char bytes[sizeof(size)];
+    std::memcpy(bytes, &size, sizeof(size));
+    out.append(bytes, sizeof(bytes));
+    out.append(str);
+  }
+
+  // frame with its size patched in later
+  size_t begin_frame(std::string &out, uint32_t tag, uint8_t code)
+  {
+    const auto begin = out.size();
+    put_u32(out, 0);
+    put_u32(out, tag);
+    put_u8(out, code);
+    return begin;
+  }
+
+  void end_frame(std::string &out, size_t begin)
+  {
+    const auto size = static_cast<uint32_t>(out.size() - begin - sizeof(uint32_t));
+    std::memcpy(&out[begin], &size, sizeof(size));
+  }
+
+  // size of the complete frame at the start of `data`, or 0
+  size_t frame_size(std::string_view data)
+  {
+    if (data.size() < gateway_frame_header_size)
+      return 0;
+    uint32_t size;
+    std::memcpy(&size, data.data(), sizeof(size));
+    return data.size() - sizeof(size) >= size ? sizeof(size) + size : 0;
+  }
+
+  // whether the frame at the start of `data` declares a size too small for
+  // its tag and code (its payload would start in the next frame)
+  bool frame_too_short(std::string_view data)
+  {
+    uint32_t size;
+    if (data.size() < sizeof(size))
+      return false;
+    std::memcpy(&size, data.data(), sizeof(size));
+    return size < gateway_frame_header_size - sizeof(size);
+  }
+
+  // bounds-checked decoding of a payload (false if malformed)
+  struct PayloadParser
+  {
+    std::string_view data;
+
+    bool u8(uint8_t &value)
+    {
+      if (data.empty() == true)
+        return false;
+      value = static_cast<uint8_t>(data[0]);
+      data.remove_prefix(1);
+      return true;
+    }
+
+    bool u32(uint32_t &value)
+    {
+      if (data.size() < sizeof(value))
+        return false;
+      std::memcpy(&value, data.data(), sizeof(value));
+      data.remove_prefix(sizeof(value));
+      return true;
+    }
+
+    bool string(std::string_view &value)
+    {
+      uint16_t size;
+      if (data.size() < sizeof(size))
+        return false;
+      std::memcpy(&size, data.data(), sizeof(size));
+      if (data.size() - sizeof(size) < size)
+        return false;
+      value = data.substr(sizeof(size), size);
+      data.remove_prefix(sizeof(size) + size);
+      return true;
+    }
+
+    bool order(std::string_view (&fields)[4], uint8_t &side, uint32_t &qty)
+    {
+      return string(fields[0]) && string(fields[1]) && u8(side) && side <= 1 && u32(qty) && string(fields[2]) && string(fields[3]);
+    }
+  };
+
+  void put_order(std::string &out, std::string_view order_id, std::string_view security_id, bool buy, uint32_t qty,
+                 std::string_view user, std::string_view company)
+  {
+    put_string(out, order_id);
+    put_string(out, security_id);
+    put_u8(out, buy ? 0 : 1);
+    put_u32(out, qty);
+    put_string(out, user);
+    put_string(out, company);
+  }
+
+  const std::string_view sides[2] = {"Buy", "Sell"};
+}
+
+OrderGateway::OrderGateway(OrderCacheInterface &cache, const std::string &path) : _cache(cache), _path(path)
+{
+#if defined(ORDERCACHE_HAVE_EPOLL)
+  sockaddr_un address{};
+  if (path.empty() == true || path.size() >= sizeof(address.sun_path))
+    fail(path, "invalid socket path");
+  address.sun_family = AF_UNIX;
+  std::memcpy(address.sun_path, path.c_str(), path.size());
+
+  errno = 0;
+  _listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  _epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  _stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (_listen_fd == -1 || _epoll_fd == -1 || _stop_fd == -1)
+  {
+    close_fds();
+    fail(path, "cannot create socket");
+  }
+
+  unlink(path.c_str()); // a socket left behind by a previous server
+  if (bind(_listen_fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0 || listen(_listen_fd, SOMAXCONN) != 0)
+  {
+    close_fds();
+    fail(path, "cannot listen");
+  }
+
+  epoll_event event{};
+  event.events = EPOLLIN;
+  event.data.fd = _listen_fd;
+  epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, _listen_fd, &event);
+  event.data.fd = _stop_fd;
+  epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, _stop_fd, &event);
+#else
+  fail(path, "the gateway isn't supported on this platform");
+#endif
+}
+
+OrderGateway::~OrderGateway()
+{
+  for (const auto &x : _connections)
+    close_connection(x.first);
+  close_fds();
+#if defined(ORDERCACHE_HAVE_EPOLL)
+  unlink(_path.c_str());
+#endif
+}
+
+void OrderGateway::run()
+{
+#if defined(ORDERCACHE_HAVE_EPOLL)
+  epoll_event events[64];
+  while (true)
+  {
+    const auto count = epoll_wait(_epoll_fd, events, 64, -1);
+    if (count == -1)
+    {
+      if (errno == EINTR)
+        continue;
+      fail(_path, "epoll_wait failed");
+    }
+
+    for (auto i = 0; i != count; ++i)
+    {
+      const auto fd = events[i].data.fd;
+      if (fd == _stop_fd)
+      {
+        uint64_t value;
+        [[maybe_unused]] const auto bytes = read(_stop_fd, &value, sizeof(value));
+        return;
+      }
+
+      if (fd == _listen_fd)
+      {
+        accept_connections();
+        continue;
+      }
+
+      auto it = _connections.find(fd);
+      if (it == _connections.end())
+        continue;
+      auto &connection = *it->second;
+
+      auto open = true;
+      if ((events[i].events & (EPOLLERR | EPOLLHUP)) != 0 && (events[i].events & EPOLLIN) == 0)
+        open = false;
+      if (open == true && (events[i].events & EPOLLOUT) != 0)
+        open = write_responses(connection);
+      if (open == true && (events[i].events & EPOLLIN) != 0 && connection.writing == false)
+        open = read_requests(connection) && write_responses(connection);
+      if (open == true && connection.closing == true && connection.writing == false)
+        open = false;
+      if (open == false)
+      {
+        close_connection(fd);
+        _connections.erase(it);
+      }
+    }
+  }
+#endif
+}
+
+void OrderGateway::stop()
+{
+#if defined(ORDERCACHE_HAVE_EPOLL)
+  const uint64_t value = 1;
+  [[maybe_unused]] const auto bytes = write(_stop_fd, &value, sizeof(value));
+#endif
+}
+
+GatewayStats OrderGateway::stats() const
+{
+  GatewayStats stats;
+  stats.connections = _stats_connections.load(std::memory_order_relaxed);
+  stats.reads = _stats_reads.load(std::memory_order_relaxed);
+  stats.requests = _stats_requests.load(std::memory_order_relaxed);
+  stats.writes = _stats_writes.load(std::memory_order_relaxed);
+  return stats;
+}
+
+void OrderGateway::accept_connections()
+{
+#if defined(ORDERCACHE_HAVE_EPOLL)
+  while (true)
+  {
+    const auto fd = accept4(_listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd == -1)
+      return; // EAGAIN, or an aborted connection
+
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    if (epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0)
+    {
+      close(fd);
+      continue;
+    }
+
+    auto connection = std::make_unique<Connection>();
+    connection->fd = fd;
+    _connections.emplace(fd, std::move(connection));
+    _stats_connections.fetch_add(1, std::memory_order_relaxed);
+  }
+#endif
+}
+
+// read what is available and execute every complete request, queueing
+// their responses; false if the connection is broken. A connection shut
+// down by the peer is marked closing, for its responses to be sent first
+bool OrderGateway::read_requests(Connection &connection)
+{
+#if defined(ORDERCACHE_HAVE_EPOLL)
+  constexpr size_t read_size = 64 * 1024;
+  auto open = true;
+  while (true)
+  {
+    const auto used = connection.in.size();
+    connection.in.resize(used + read_size);
+    const auto bytes = read(connection.fd, &connection.in[used], read_size);
+    connection.in.resize(used + (bytes > 0 ? static_cast<size_t>(bytes) : 0));
+    if (bytes > 0 && static_cast<size_t>(bytes) == read_size)
+      continue;
+    if (bytes == 0)
+      connection.closing = true;
+    else if (bytes == -1 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+      open = false;
+    break;
+  }
+
+  uint64_t requests = 0;
+  while (true)
+  {
+    const std::string_view pending(connection.in.data() + connection.in_begin, connection.in.size() - connection.in_begin);
+    if (frame_too_short(pending) == true)
+      return false; // a frame that can't be a request
+    const auto size = frame_size(pending);
+    if (size == 0)
+    {
+      if (pending.size() >= sizeof(uint32_t) + gateway_max_request_size)
+        return false; // a frame that can't be a request
+      break;
+    }
+
+    uint32_t tag;
+    std::memcpy(&tag, pending.data() + sizeof(uint32_t), sizeof(tag));
+    const auto op = static_cast<GatewayOp>(pending[2 * sizeof(uint32_t)]);
+    execute(tag, op, pending.substr(gateway_frame_header_size, size - gateway_frame_header_size), connection.out);
+    connection.in_begin += size;
+    ++requests;
+  }
+
+  // keep the incomplete request at the start of the buffer
+  connection.in.erase(0, connection.in_begin);
+  connection.in_begin = 0;
+
+  if (requests != 0)
+  {
+    _stats_reads.fetch_add(1, std::memory_order_relaxed);
+    _stats_requests.fetch_add(requests, std::memory_order_relaxed);
+  }
+  return open;
+#else
+  return false;
+#endif
+}
+
+// send the queued responses, waiting for the socket to be writable (and
+// not reading more requests) if they don't all fit; false if broken
+bool OrderGateway::write_responses(Connection &connection)
+{
+#if defined(ORDERCACHE_HAVE_EPOLL)
+  while (connection.out_begin != connection.out.size())
+  {
+    const auto bytes = send(connection.fd, connection.out.data() + connection.out_begin, connection.out.size() - connection.out_begin, MSG_NOSIGNAL);
+    if (bytes == -1)
+    {
+      if (errno == EINTR)
+        continue;
+      if (errno != EAGAIN && errno != EWOULDBLOCK)
+        return false;
+      break;
+    }
+    connection.out_begin += static_cast<size_t>(bytes);
+    _stats_writes.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  const auto writing = connection.out_begin != connection.out.size();
+  if (writing == false)
+  {
+    connection.out.clear();
+    connection.out_begin = 0;
+  }
+
+  if (writing != connection.writing)
+  {
+    connection.writing = writing;
+    epoll_event event{};
+    event.events = writing ? EPOLLOUT : EPOLLIN;
+    event.data.fd = connection.fd;
+    epoll_ctl(_epoll_fd, EPOLL_CTL_MOD, connection.fd, &event);
+  }
+  return true;
+#else
+  return false;
+#endif
+}
+
+void OrderGateway::execute(uint32_t tag, GatewayOp op, std::string_view payload, std::string &out)
+{
+  PayloadParser parser{payload};
+  std::string_view id;
+  uint32_t value;
+
+  const auto error = [&out, tag](std::string_view message)
+  {
+    const auto begin = begin_frame(out, tag, static_cast<uint8_t>(GatewayStatus::Error));
+    put_string(out, message);
+    end_frame(out, begin);
+  };
+
+  const auto begin = begin_frame(out, tag, static_cast<uint8_t>(GatewayStatus::Ok));
+  try
+  {
+    switch (op)
+    {
+    case GatewayOp::AddOrder:
+    {
+      std::string_view fields[4];
+      uint8_t side;
+      if (parser.order(fields, side, value) == false)
+        break;
+      _cache.addOrder(Order{HashedStringView(fields[0]), HashedStringView(fields[1]), sides[side], value,
+                            HashedStringView(fields[2]), HashedStringView(fields[3])});
+      end_frame(out, begin);
+      return;
+    }
+
+    case GatewayOp::CancelOrder:
+    case GatewayOp::CancelOrdersForUser:
+      if (parser.string(id) == false)
+        break;
+      _id.assign(id);
+      if (op == GatewayOp::CancelOrder)
+        _cache.cancelOrder(_id);
+      else
+        _cache.cancelOrdersForUser(_id);
+      end_frame(out, begin);
+      return;
+
+    case GatewayOp::CancelOrdersForSecIdWithMinimumQty:
+      if (parser.string(id) == false || parser.u32(value) == false)
+        break;
+      _id.assign(id);
+      _cache.cancelOrdersForSecIdWithMinimumQty(_id, value);
+      end_frame(out, begin);
+      return;
+
+    case GatewayOp::GetMatchingSizeForSecurity:
+      if (parser.string(id) == false)
+        break;
+      _id.assign(id);
+      put_u32(out, _cache.getMatchingSizeForSecurity(_id));
+      end_frame(out, begin);
+      return;
+
+    case GatewayOp::GetAllOrders:
+    {
+      const auto orders = _cache.getAllOrders();
+      put_u32(out, static_cast<uint32_t>(orders.size()));
+      for (const auto &order : orders)
+        put_order(out, order.orderIdView(), order.securityIdView(), order.sideView() == "Buy", order.qty(), order.userView(), order.companyView());
+      end_frame(out, begin);
+      return;
+    }
+
+    default:
+      out.resize(begin);
+      error("unknown request");
+      return;
+    }
+
+    out.resize(begin);
+    error("malformed request");
+  }
+  catch (const std::exception &e)
+  {
+    out.resize(begin);
+    error(e.what());
+  }
+}
+
+void OrderGateway::close_connection(int fd)
+{
+#if defined(ORDERCACHE_HAVE_EPOLL)
+  epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+  close(fd);
+#endif
+}
+
+void OrderGateway::close_fds()
+{
+#if defined(ORDERCACHE_HAVE_EPOLL)
+  for (auto *fd : {&_listen_fd, &_epoll_fd, &_stop_fd})
+    if (*fd != -1)
+    {
+      close(*fd);
+      *fd = -1;
+    }
+#endif
+}
+
+GatewayClient::GatewayClient(const std::string &path)
+{
+#if defined(ORDERCACHE_HAVE_UNIX_SOCKETS)
+  sockaddr_un address{};
+  if (path.empty() == true || path.size() >= sizeof(address.sun_path))
+    fail(path, "invalid socket path");
+  address.sun_family = AF_UNIX;
+  std::memcpy(address.sun_path, path.c_str(), path.size());
+
+  errno = 0;
+  _fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (_fd == -1)
+    fail(path, "cannot create socket");
+  if (connect(_fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0)
+  {
+    close(_fd);
+    fail(path, "cannot connect");
+  }
+#else
+  fail(path, "Unix domain sockets aren't supported on this platform");
+#endif
+}
+
+GatewayClient::~GatewayClient()
+{
+#if defined(ORDERCACHE_HAVE_UNIX_SOCKETS)
+  close(_fd);
+#endif
+}
+
+void GatewayClient::addOrder(Order order)
+{
+  call(queueAddOrder(order.orderIdView(), order.securityIdView(), order.sideView(), order.qty(), order.userView(), order.companyView()));
+}
+
+void GatewayClient::cancelOrder(const std::string &orderId)
+{
+  call(queueCancelOrder(orderId));
+}
+
+void GatewayClient::cancelOrdersForUser(const std::string &user)
+{
+  call(queueCancelOrdersForUser(user));
+}
+
+void GatewayClient::cancelOrdersForSecIdWithMinimumQty(const std::string &securityId, unsigned int minQty)
+{
+  call(queueCancelOrdersForSecIdWithMinimumQty(securityId, minQty));
+}
+
+unsigned int GatewayClient::getMatchingSizeForSecurity(const std::string &securityId)
+{
+  return matchingSize(call(queueGetMatchingSizeForSecurity(securityId)));
+}
+
+std::vector<Order> GatewayClient::getAllOrders() const
+{
+  // const in the interface, but it's a round trip on the connection
+  auto &client = const_cast<GatewayClient &>(*this);
+  return orders(client.call(client.queueGetAllOrders()));
+}
+
+uint32_t GatewayClient::queueAddOrder(std::string_view orderId, std::string_view securityId, std::string_view side, unsigned int qty,
+                                      std::string_view user, std::string_view company)
+{
+  begin_request(GatewayOp::AddOrder);
+  put_order(_out, orderId, securityId, side == "Buy", qty, user, company);
+  return end_request();
+}
+
+uint32_t GatewayClient::queueCancelOrder(std::string_view orderId)
+{
+  begin_request(GatewayOp::CancelOrder);
+  put_string(_out, orderId);
+  return end_request();
+}
+
+uint32_t GatewayClient::queueCancelOrdersForUser(std::string_view user)
+{
+  begin_request(GatewayOp::CancelOrdersForUser);
+  put_string(_out, user);
+  return end_request();
+}
+
+uint32_t GatewayClient::queueCancelOrdersForSecIdWithMinimumQty(std::string_view securityId, unsigned int minQty)
+{
+  begin_request(GatewayOp::CancelOrdersForSecIdWithMinimumQty);
+  put_string(_out, securityId);
+  put_u32(_out, minQty);
+  return end_request();
+}
+
+uint32_t GatewayClient::queueGetMatchingSizeForSecurity(std::string_view securityId)
+{
+  begin_request(GatewayOp::GetMatchingSizeForSecurity);
+  put_string(_out, securityId);
+  return end_request();
+}
+
+uint32_t GatewayClient::queueGetAllOrders()
+{
+  begin_request(GatewayOp::GetAllOrders);
+  return end_request();
+}
+
+void GatewayClient::flush()
+{
+#if defined(ORDERCACHE_HAVE_UNIX_SOCKETS)
+  size_t sent = 0;
+  while (sent != _out.size())
+  {
+    const auto bytes = send(_fd, _out.data() + sent, _out.size() - sent, MSG_NOSIGNAL);
+    if (bytes == -1)
+    {
+      if (errno == EINTR)
+        continue;
+      fail("client", "cannot send");
+    }
+    sent += static_cast<size_t>(bytes);
+  }
+  _out.clear();
+#endif
+}
+
+GatewayResponse GatewayClient::readResponse()
+{
+  while (true)
+  {
+    const std::string_view pending(_in.data() + _in_begin, _in.size() - _in_begin);
+    if (frame_too_short(pending) == true)
+    {
+      errno = 0;
+      fail("client", "malformed response");
+    }
+    const auto size = frame_size(pending);
+    if (size != 0)
+    {
+      GatewayResponse response;
+      std::memcpy(&response.tag, pending.data() + sizeof(uint32_t), sizeof(response.tag));
+      response.status = static_cast<GatewayStatus>(pending[2 * sizeof(uint32_t)]);
+      response.payload.assign(pending.substr(gateway_frame_header_size, size - gateway_frame_header_size));
+      _in_begin += size;
+      return response;
+    }
+
+    _in.erase(0, _in_begin);
+    _in_begin = 0;
+    if (receive() == false)
+    {
+      errno = 0;
+      fail("client", "connection closed");
+    }
+  }
+}
+
+unsigned int GatewayClient::matchingSize(const GatewayResponse &response)
+{
+  PayloadParser parser{response.payload};
+  uint32_t value;
+  if (parser.u32(value) == false)
+    throw std::runtime_error("gateway: malformed response");
+  return value;
+}
+
+std::vector<Order> GatewayClient::orders(const GatewayResponse &response)
+{
+  PayloadParser parser{response.payload};
+  uint32_t count;
+  if (parser.u32(count) == false)
+    throw std::runtime_error("gateway: malformed response");
+
+  std::vector<Order> orders;
+  orders.reserve(count);
+  for (uint32_t i = 0; i != count; ++i)
+  {
+    std::string_view fields[4];
+    uint8_t side;
+    uint32_t qty;
+    if (parser.order(fields, side, qty) == false)
+      throw std::runtime_error("gateway: malformed response");
+    orders.emplace_back(HashedStringView(fields[0]), HashedStringView(fields[1]), sides[side], qty, HashedStringView(fields[2]), HashedStringView(fields[3]));
+  }
+  return orders;
+}
+
+uint32_t GatewayClient::begin_request(GatewayOp op)
+{
+  _request_begin = begin_frame(_out, _next_tag, static_cast<uint8_t>(op));
+  return _next_tag;
+}
+
+uint32_t GatewayClient::end_request()
+{
+  end_frame(_out, _request_begin);
+  return _next_tag++;
+}
+
+bool GatewayClient::receive()
+{
+#if defined(ORDERCACHE_HAVE_UNIX_SOCKETS)
+  constexpr size_t read_size = 64 * 1024;
+  while (true)
+  {
+    const auto used = _in.size();
+    _in.resize(used + read_size);
+    const auto bytes = recv(_fd, &_in[used], read_size, 0);
+    _in.resize(used + (bytes > 0 ? static_cast<size_t>(bytes) : 0));
+    if (bytes > 0)
+      return true;
+    if (bytes == 0)
+      return false;
+    if (errno != EINTR)
+      fail("client", "cannot receive");
+  }
+#else
+  return false;
+#endif
+}
+
+GatewayResponse GatewayClient::call(uint32_t tag)
+{
+  flush();
+  // the responses of earlier pipelined requests come first, and are dropped
+  while (true)
+  {
+    auto response = readResponse();
+    if (response.tag != tag)
+      continue;
+    if (response.status == GatewayStatus::Error)
+    {
+      PayloadParser parser{response.payload};
+      std::string_view message;
+      parser.string(message);
+      throw std::runtime_error("gateway: " + std::string(message));
+    }
+    return response;
+  }
+}
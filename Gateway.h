@@ -0,0 +1,195 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "OrderCache.h"
+
+// Order gateway: serves the OrderCacheInterface operations of a cache to
+// other processes over a Unix domain socket, and the matching client.
+//
+// Requests and responses are frames of a length-prefixed binary protocol,
+// with integers in host byte order (both ends are on the same host):
+//
+//   u32 size   bytes of the frame after this field
+//   u32 tag    chosen by the client, echoed by the response
+//   u8  code   GatewayOp (requests) or GatewayStatus (responses)
+//   payload
+//
+// Strings are a u16 size followed by their bytes. Request payloads:
+//
+//   AddOrder                            order id, security id, u8 side (0 buy, 1 sell),
+//                                       u32 qty, user, company
+//   CancelOrder                         order id
+//   CancelOrdersForUser                 user
+//   CancelOrdersForSecIdWithMinimumQty  security id, u32 min qty
+//   GetMatchingSizeForSecurity          security id
+//   GetAllOrders                        (empty)
+//
+// An Ok response carries the u32 matching size of GetMatchingSizeForSecurity
+// or the u32 count and orders (as in AddOrder) of GetAllOrders, and is empty
+// otherwise; an Error response carries a message string.
+//
+// Clients may pipeline requests: the server reads whatever is available on
+// a connection, executes every complete request of it in turn and writes
+// their responses back in one go, in request order. The server closes
+// connections sending a frame too short to hold its tag and code, or
+// larger than gateway_max_request_size; clients throw on too short
+// responses.
+//
+// The server needs epoll (Linux) and the client Unix domain sockets;
+// elsewhere the constructors throw.
+
+enum class GatewayOp : uint8_t
+{
+  AddOrder = 1,
+  CancelOrder,
+  CancelOrdersForUser,
+  CancelOrdersForSecIdWithMinimumQty,
+  GetMatchingSizeForSecurity,
+  GetAllOrders,
+};
+
+enum class GatewayStatus : uint8_t
+{
+  Ok = 0,
+  Error,
+};
+
+// size + tag + code
+constexpr size_t gateway_frame_header_size = 2 * sizeof(uint32_t) + 1;
+// largest request frame accepted by the server (responses aren't limited)
+constexpr size_t gateway_max_request_size = 1 << 16;
+
+struct GatewayStats
+{
+  uint64_t connections = 0; // accepted
+  uint64_t reads = 0;       // reads returning requests
+  uint64_t requests = 0;
+  uint64_t writes = 0;
+};
+
+// serves a cache on a Unix domain socket, on the thread calling run()
+class OrderGateway
+{
+public:
+  // listen on the socket `path`, replacing a socket file left behind by a
+  // previous server (it is removed by the destructor). The cache must
+  // outlive the gateway. Throws std::runtime_error if it can't listen.
+  OrderGateway(OrderCacheInterface &cache, const std::string &path);
+  ~OrderGateway();
+
+  OrderGateway(const OrderGateway &) = delete;
+  OrderGateway &operator=(const OrderGateway &) = delete;
+
+  const std::string &path() const { return _path; }
+
+  // serve the clients until stop() is called
+  void run();
+
+  // make run() return; callable from any thread (and from signal handlers)
+  void stop();
+
+  GatewayStats stats() const;
+
+private:
+  struct Connection
+  {
+    int fd;
+    std::string in; // received, from in_begin
+    size_t in_begin = 0;
+    std::string out; // to send, from out_begin
+    size_t out_begin = 0;
+    bool writing = false; // waiting for the socket to be writable
+    bool closing = false; // shut down by the peer: closed once the responses are sent
+  };
+
+  void accept_connections();
+  bool read_requests(Connection &connection);
+  bool write_responses(Connection &connection);
+  void execute(uint32_t tag, GatewayOp op, std::string_view payload, std::string &out);
+  void close_connection(int fd); // and its socket (not its Connection)
+  void close_fds();
+
+  OrderCacheInterface &_cache;
+  std::string _path;
+  int _listen_fd = -1;
+  int _epoll_fd = -1;
+  int _stop_fd = -1; // eventfd
+  std::unordered_map<int, std::unique_ptr<Connection>> _connections;
+  std::string _id; // reused for the std::string arguments of the cache
+
+  std::atomic<uint64_t> _stats_connections{0};
+  std::atomic<uint64_t> _stats_reads{0};
+  std::atomic<uint64_t> _stats_requests{0};
+  std::atomic<uint64_t> _stats_writes{0};
+};
+
+struct GatewayResponse
+{
+  uint32_t tag;
+  GatewayStatus status;
+  std::string payload;
+};
+
+// connection to an OrderGateway. The OrderCacheInterface methods send one
+// request and wait for its response (throwing std::runtime_error with the
+// message of an Error response), dropping the responses of the pipelined
+// requests sent before it; the queue methods build pipelined requests
+// instead, sent by flush() and answered through readResponse().
+// Not thread safe: use one client per thread.
+class GatewayClient : public OrderCacheInterface
+{
+public:
+  // throws std::runtime_error if it can't connect
+  explicit GatewayClient(const std::string &path);
+  ~GatewayClient();
+
+  GatewayClient(const GatewayClient &) = delete;
+  GatewayClient &operator=(const GatewayClient &) = delete;
+
+  void addOrder(Order order) override;
+  void cancelOrder(const std::string &orderId) override;
+  void cancelOrdersForUser(const std::string &user) override;
+  void cancelOrdersForSecIdWithMinimumQty(const std::string &securityId, unsigned int minQty) override;
+  unsigned int getMatchingSizeForSecurity(const std::string &securityId) override;
+  std::vector<Order> getAllOrders() const override;
+
+  // queue a request, returning its tag
+  uint32_t queueAddOrder(std::string_view orderId, std::string_view securityId, std::string_view side, unsigned int qty,
+                         std::string_view user, std::string_view company);
+  uint32_t queueCancelOrder(std::string_view orderId);
+  uint32_t queueCancelOrdersForUser(std::string_view user);
+  uint32_t queueCancelOrdersForSecIdWithMinimumQty(std::string_view securityId, unsigned int minQty);
+  uint32_t queueGetMatchingSizeForSecurity(std::string_view securityId);
+  uint32_t queueGetAllOrders();
+
+  // send the queued requests
+  void flush();
+
+  // wait for the next response (in request order)
+  GatewayResponse readResponse();
+
+  // payloads of Ok responses
+  static unsigned int matchingSize(const GatewayResponse &response);
+  static std::vector<Order> orders(const GatewayResponse &response);
+
+private:
+  uint32_t begin_request(GatewayOp op);
+  uint32_t end_request(); // returns the tag
+  bool receive(); // false at end of stream
+  GatewayResponse call(uint32_t tag);
+
+  int _fd = -1;
+  uint32_t _next_tag = 0;
+  std::string _out; // queued requests
+  size_t _request_begin = 0;
+  std::string _in;  // received, from _in_begin
+  size_t _in_begin = 0;
+};
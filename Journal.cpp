@@ -0,0 +1,439 @@
+#include "Journal.h"
+#include "Snapshot.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#define ORDERCACHE_HAVE_FSYNC 1
+#endif
+
+namespace
+{
+  constexpr char journal_magic[8] = {'O', 'C', 'J', 'R', 'N', 'L', '\0', '\0'};
+  constexpr uint32_t journal_version = 1;
+  constexpr uint32_t journal_byte_order_mark = 0x01020304;
+  constexpr size_t journal_header_size = 16;
+
+  // type + lsn, before the security id
+  constexpr size_t record_head_size = 1 + sizeof(uint64_t);
+  // body size + body checksum
+  constexpr size_t record_frame_size = 2 * sizeof(uint32_t);
+
+  uint32_t checksum32(const char *head, std::string_view fields)
+  {
+    SnapshotChecksum checksum;
+    checksum.update(head, record_head_size);
+    checksum.update(fields.data(), fields.size());
+    const auto value = checksum.value();
+    return static_cast<uint32_t>(value ^ (value >> 32));
+  }
+
+  void put_varint(std::string &out, uint64_t value)
+  {
+    while (value >= 0x80)
+    {
+      out.push_back(static_cast<char>(value | 0x80));
+      value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+  }
+
+  void put_string(std::string &out, std::string_view str)
+  {
+    put_varint(out, str.size());
+    out.append(str);
+  }
+
+  // bounds-checked decoding of a record body (false if malformed)
+  struct BodyParser
+  {
+    const char *position;
+    const char *end;
+
+    bool varint(uint64_t &value)
+    {
+      value = 0;
+      for (unsigned int shift = 0; shift < 64 && position != end; shift += 7)
+      {
+        const auto byte = static_cast<unsigned char>(*position++);
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0)
+          return true;
+      }
+      return false;
+    }
+
+    bool u32(unsigned int &value)
+    {
+      uint64_t v;
+      if (varint(v) == false || v > UINT32_MAX)
+        return false;
+      value = static_cast<unsigned int>(v);
+      return true;
+    }
+
+    bool string(std::string_view &str)
+    {
+      uint64_t size;
+      if (varint(size) == false || size > static_cast<uint64_t>(end - position))
+        return false;
+      str = {position, static_cast<size_t>(size)};
+      position += size;
+      return true;
+    }
+  };
+}
+
+Journal::Journal(const std::string &path, JournalOptions options) : _options(options)
+{
+  open(path);
+  _flush_thread = std::thread([this]()
+                              { flush_loop(); });
+}
+
+Journal::~Journal()
+{
+  {
+    std::lock_guard lock(_mutex);
+    _stop = true;
+  }
+  _flush_cv.notify_one();
+  _flush_thread.join();
+
+  std::fclose(_file);
+}
+
+void Journal::open(const std::string &path)
+{
+  std::error_code ec;
+  const auto existing = std::filesystem::file_size(path, ec) != 0 && !ec;
+
+  uint64_t last_lsn = 0;
+  if (existing == true)
+  {
+    bool torn_tail;
+    size_t valid_size;
+    {
+      JournalReader reader(path);
+      JournalRecord record;
+      while (reader.next(record) == true)
+        ;
+      last_lsn = reader.last_lsn();
+      torn_tail = reader.torn_tail();
+      valid_size = reader.valid_size();
+    }
+
+    // drop an incomplete last record, so new records follow valid ones
+    if (torn_tail == true)
+    {
+      std::filesystem::resize_file(path, valid_size, ec);
+      if (ec)
+        throw std::runtime_error("journal: cannot truncate " + path + ": " + ec.message());
+    }
+  }
+
+  _next_lsn = std::max(last_lsn + 1, _options.first_lsn);
+  _durable_lsn = _next_lsn - 1;
+
+  _file = std::fopen(path.c_str(), "ab");
+  if (_file == nullptr)
+    throw std::runtime_error("journal: cannot open " + path);
+
+  if (existing == false)
+  {
+    char header[journal_header_size];
+    std::memcpy(header, journal_magic, sizeof(journal_magic));
+    std::memcpy(header + 8, &journal_version, sizeof(journal_version));
+    std::memcpy(header + 12, &journal_byte_order_mark, sizeof(journal_byte_order_mark));
+
+    _batch.assign(header, header + sizeof(header));
+    try
+    {
+      write_batch();
+    }
+    catch (...)
+    {
+      std::fclose(_file);
+      throw;
+    }
+    _batch.clear();
+  }
+}
+
+uint64_t Journal::appendAddOrder(std::string_view security_id, std::string_view order_id, std::string_view side,
+                                 unsigned int qty, std::string_view user, std::string_view company)
+{
+  // encoded outside of the journal lock (only the lsn needs it)
+  thread_local std::string fields;
+  fields.clear();
+  put_string(fields, security_id);
+  put_string(fields, order_id);
+  put_string(fields, side);
+  put_varint(fields, qty);
+  put_string(fields, user);
+  put_string(fields, company);
+  return append(JournalRecordType::AddOrder, fields);
+}
+
+uint64_t Journal::appendCancelOrders(std::string_view security_id, const std::vector<std::string_view> &order_ids)
+{
+  thread_local std::string fields;
+  fields.clear();
+  put_string(fields, security_id);
+  put_varint(fields, order_ids.size());
+  for (const auto order_id : order_ids)
+    put_string(fields, order_id);
+  return append(JournalRecordType::CancelOrders, fields);
+}
+
+uint64_t Journal::appendAmendOrderQty(std::string_view security_id, std::string_view order_id, unsigned int qty)
+{
+  thread_local std::string fields;
+  fields.clear();
+  put_string(fields, security_id);
+  put_string(fields, order_id);
+  put_varint(fields, qty);
+  return append(JournalRecordType::AmendOrderQty, fields);
+}
+
+uint64_t Journal::append(JournalRecordType type, std::string_view fields)
+{
+  std::unique_lock lock(_mutex);
+  throw_if_failed();
+
+  const auto lsn = _next_lsn++;
+
+  char head[record_head_size];
+  head[0] = static_cast<char>(type);
+  std::memcpy(head + 1, &lsn, sizeof(lsn));
+
+  const uint32_t frame[2] = {static_cast<uint32_t>(record_head_size + fields.size()), checksum32(head, fields)};
+  const auto frame_data = reinterpret_cast<const char *>(frame);
+
+  _buffer.insert(_buffer.end(), frame_data, frame_data + record_frame_size);
+  _buffer.insert(_buffer.end(), head, head + record_head_size);
+  _buffer.insert(_buffer.end(), fields.begin(), fields.end());
+  ++_stats.records;
+
+  if (_buffer.size() >= _options.max_batch_bytes || _options.flush_interval.count() == 0)
+    _flush_cv.notify_one();
+
+  return lsn;
+}
+
+uint64_t Journal::lastLsn() const
+{
+  std::lock_guard lock(_mutex);
+  return _next_lsn - 1;
+}
+
+bool Journal::waitDurable(uint64_t lsn)
+{
+  std::unique_lock lock(_mutex);
+  if (_durable_lsn >= lsn)
+    return true;
+
+  // waiters make the flush thread commit right away, instead of at the
+  // end of the flush interval
+  ++_waiters;
+  _flush_cv.notify_one();
+  _durable_cv.wait(lock, [this, lsn]()
+                   { return _durable_lsn >= lsn || _error.empty() == false; });
+  --_waiters;
+
+  return _durable_lsn >= lsn;
+}
+
+void Journal::flush()
+{
+  if (waitDurable(lastLsn()) == false)
+  {
+    std::lock_guard lock(_mutex);
+    throw_if_failed();
+  }
+}
+
+JournalStats Journal::stats() const
+{
+  std::lock_guard lock(_mutex);
+  return _stats;
+}
+
+void Journal::flush_loop()
+{
+  std::unique_lock lock(_mutex);
+
+  auto ready = [this]()
+  {
+    return _stop == true || _buffer.size() >= _options.max_batch_bytes ||
+           (_buffer.empty() == false && (_waiters != 0 || _options.flush_interval.count() == 0));
+  };
+
+  while (true)
+  {
+    if (_options.flush_interval.count() == 0)
+      _flush_cv.wait(lock, ready);
+    else
+      _flush_cv.wait_for(lock, _options.flush_interval, ready);
+
+    if (_buffer.empty() == true)
+    {
+      if (_stop == true)
+        break;
+      continue;
+    }
+
+    // group commit: everything appended until now, while records appended
+    // during the write go into the next one
+    _batch.swap(_buffer);
+    const auto lsn = _next_lsn - 1;
+    lock.unlock();
+
+    std::string error;
+    try
+    {
+      write_batch();
+    }
+    catch (const std::exception &e)
+    {
+      error = e.what();
+    }
+
+    lock.lock();
+    if (error.empty() == true)
+    {
+      _durable_lsn = lsn;
+      ++_stats.group_commits;
+      _stats.bytes_written += _batch.size();
+    }
+    else
+      _error = error;
+    _batch.clear();
+    _durable_cv.notify_all();
+
+    if (_error.empty() == false)
+      break;
+  }
+}
+
+void Journal::write_batch()
+{
+  if (std::fwrite(_batch.data(), 1, _batch.size(), _file) != _batch.size() || std::fflush(_file) != 0)
+    throw std::runtime_error("journal: write failed");
+
+#if defined(ORDERCACHE_HAVE_FSYNC)
+  if (_options.durability != JournalDurability::Write)
+  {
+#if defined(__linux__)
+    const auto ret = fdatasync(fileno(_file));
+#else
+    const auto ret = fsync(fileno(_file));
+#endif
+    if (ret != 0)
+      throw std::runtime_error("journal: fsync failed");
+  }
+#endif
+}
+
+void Journal::throw_if_failed() const
+{
+  if (_error.empty() == false)
+    throw std::runtime_error(_error);
+}
+
+JournalReader::JournalReader(const std::string &path) : _file(std::make_unique<MappedFile>(path))
+{
+  const auto data = _file->data();
+  if (_file->size() < journal_header_size || std::memcmp(data, journal_magic, sizeof(journal_magic)) != 0)
+    throw std::runtime_error("journal: not a journal file: " + path);
+
+  uint32_t version, byte_order;
+  std::memcpy(&version, data + 8, sizeof(version));
+  std::memcpy(&byte_order, data + 12, sizeof(byte_order));
+  if (byte_order != journal_byte_order_mark)
+    throw std::runtime_error("journal: written with a different byte order: " + path);
+  if (version != journal_version)
+    throw std::runtime_error("journal: unsupported version " + std::to_string(version) + ": " + path);
+
+  _position = data + journal_header_size;
+  _end = data + _file->size();
+}
+
+JournalReader::~JournalReader() = default;
+
+bool JournalReader::next(JournalRecord &record)
+{
+  if (_position == _end || _torn_tail == true)
+    return false;
+
+  // anything that doesn't parse ends the journal: the last group commit
+  // may have been cut short
+  _torn_tail = true;
+
+  if (static_cast<size_t>(_end - _position) < record_frame_size)
+    return false;
+
+  uint32_t frame[2];
+  std::memcpy(frame, _position, record_frame_size);
+  const auto body = _position + record_frame_size;
+  const auto body_size = frame[0];
+  if (body_size < record_head_size || body_size > static_cast<size_t>(_end - body))
+    return false;
+
+  const std::string_view fields{body + record_head_size, body_size - record_head_size};
+  if (checksum32(body, fields) != frame[1])
+    return false;
+
+  record.type = static_cast<JournalRecordType>(body[0]);
+  std::memcpy(&record.lsn, body + 1, sizeof(record.lsn));
+  if (record.lsn <= _last_lsn)
+    return false;
+
+  BodyParser parser{fields.data(), fields.data() + fields.size()};
+  if (parser.string(record.security_id) == false)
+    return false;
+
+  switch (record.type)
+  {
+  case JournalRecordType::AddOrder:
+    if (parser.string(record.order_id) == false || parser.string(record.side) == false || parser.u32(record.qty) == false ||
+        parser.string(record.user) == false || parser.string(record.company) == false)
+      return false;
+    break;
+
+  case JournalRecordType::CancelOrders:
+  {
+    uint64_t count;
+    if (parser.varint(count) == false || count > fields.size())
+      return false;
+    record.order_ids.resize(count);
+    for (auto &order_id : record.order_ids)
+      if (parser.string(order_id) == false)
+        return false;
+    break;
+  }
+
+  case JournalRecordType::AmendOrderQty:
+    if (parser.string(record.order_id) == false || parser.u32(record.qty) == false)
+      return false;
+    break;
+
+  default:
+    return false;
+  }
+
+  if (parser.position != parser.end)
+    return false;
+
+  _torn_tail = false;
+  _position = body + body_size;
+  _last_lsn = record.lsn;
+  return true;
+}
+
+size_t JournalReader::valid_size() const
+{
+  return static_cast<size_t>(_position - _file->data());
+}
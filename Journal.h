@@ -0,0 +1,207 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+class MappedFile;
+
+// Write-ahead journal of OrderCache mutations, for crash recovery on top of
+// the latest snapshot (see OrderCache::saveSnapshot/replayJournal).
+//
+// A journal file is a 16 byte header (magic "OCJRNL\0\0", version, byte
+// order mark) followed by records, in native byte order:
+//
+//   u32 body size, u32 body checksum, body:
+//     u8 type, u64 lsn, security id string, then
+//       AddOrder:      order id, side, qty, user, company
+//       CancelOrders:  count, count x order id
+//       AmendOrderQty: order id, qty
+//
+// where integers in the body (other than the lsn) and string lengths are
+// LEB128 varints. Records are numbered by a log sequence number (LSN)
+// increasing by one per record, and each one only affects its security.
+// CancelOrders removes the orders and then re-matches the security once,
+// as the cancel operations do.
+
+enum class JournalRecordType : uint8_t
+{
+  AddOrder = 1,
+  CancelOrders = 2,
+  AmendOrderQty = 3,
+};
+
+struct JournalRecord
+{
+  JournalRecordType type;
+  uint64_t lsn;
+  std::string_view security_id;
+
+  // AddOrder (and AmendOrderQty: order_id, qty)
+  std::string_view order_id;
+  std::string_view side;
+  unsigned int qty = 0;
+  std::string_view user;
+  std::string_view company;
+
+  // CancelOrders
+  std::vector<std::string_view> order_ids;
+};
+
+// how far group commits go before records count as durable
+enum class JournalDurability
+{
+  // written to the OS without fsync: survives a process crash, but not a
+  // power loss
+  Write,
+  // fsync after each group commit, without mutations waiting for it: a
+  // power loss loses at most the last flush interval
+  Fsync,
+  // fsync after each group commit, and mutations only return once their
+  // record is synced (concurrent writers share each fsync)
+  FsyncWait,
+};
+
+struct JournalOptions
+{
+  JournalDurability durability = JournalDurability::Fsync;
+  // longest time records stay buffered before a group commit (zero:
+  // commit as soon as there are records)
+  std::chrono::microseconds flush_interval{1000};
+  // commit early once this many bytes are buffered
+  size_t max_batch_bytes = 1 << 20;
+  // LSN of the first record of a new journal, eg to start one after the
+  // LSN of the latest snapshot (an existing journal continues after its
+  // last record, if that is higher)
+  uint64_t first_lsn = 1;
+};
+
+struct JournalStats
+{
+  uint64_t records = 0;
+  uint64_t group_commits = 0;
+  uint64_t bytes_written = 0;
+};
+
+struct JournalReplayStats
+{
+  uint64_t records = 0;   // records applied
+  uint64_t last_lsn = 0;  // last valid record in the journal
+  bool torn_tail = false; // the journal ends with an incomplete/corrupt record
+};
+
+// Append-only journal with group commit: records are encoded into an
+// in-memory buffer, which a background thread writes out (and syncs,
+// depending on the durability mode) every flush interval. Opening an
+// existing journal truncates an incomplete last record (eg from a crash)
+// and continues numbering after the last valid one.
+// Throws std::runtime_error on I/O errors; once a group commit fails the
+// journal stops accepting records.
+class Journal
+{
+public:
+  explicit Journal(const std::string &path, JournalOptions options = {});
+  ~Journal();
+
+  Journal(const Journal &) = delete;
+  Journal &operator=(const Journal &) = delete;
+
+  const JournalOptions &options() const { return _options; }
+
+  // append a record, returning its LSN
+  uint64_t appendAddOrder(std::string_view security_id, std::string_view order_id, std::string_view side,
+                          unsigned int qty, std::string_view user, std::string_view company);
+  uint64_t appendCancelOrders(std::string_view security_id, const std::vector<std::string_view> &order_ids);
+  uint64_t appendAmendOrderQty(std::string_view security_id, std::string_view order_id, unsigned int qty);
+
+  // LSN of the last record appended
+  uint64_t lastLsn() const;
+
+  // wait until the record with this LSN is durable (per the durability
+  // mode); returns false if the journal failed before that
+  bool waitDurable(uint64_t lsn);
+
+  // commit everything appended so far, and wait for it
+  void flush();
+
+  JournalStats stats() const;
+
+private:
+  void open(const std::string &path);
+  uint64_t append(JournalRecordType type, std::string_view fields);
+  void flush_loop();
+  void write_batch();
+  void throw_if_failed() const;
+
+  JournalOptions _options;
+  std::FILE *_file = nullptr;
+
+  mutable std::mutex _mutex;
+  std::condition_variable _flush_cv;   // wakes the flush thread
+  std::condition_variable _durable_cv; // wakes waitDurable
+  std::vector<char> _buffer;           // records of the next group commit
+  std::vector<char> _batch;            // group commit being written
+  uint64_t _next_lsn = 1;
+  uint64_t _durable_lsn = 0;
+  unsigned int _waiters = 0;
+  bool _stop = false;
+  std::string _error;
+  JournalStats _stats;
+
+  std::thread _flush_thread;
+};
+
+// waits, on destruction, until the last record appended through it is
+// synced (only in JournalDurability::FsyncWait mode): cache operations
+// declare it before taking their locks, so they wait after releasing them
+class JournalCommit
+{
+public:
+  ~JournalCommit()
+  {
+    if (_journal != nullptr && _journal->options().durability == JournalDurability::FsyncWait)
+      _journal->waitDurable(_lsn);
+  }
+
+  void set(Journal *journal, uint64_t lsn)
+  {
+    _journal = journal;
+    _lsn = lsn;
+  }
+
+private:
+  Journal *_journal = nullptr;
+  uint64_t _lsn = 0;
+};
+
+// Sequential reader over a (memory mapped) journal file, stopping at the
+// first incomplete or corrupt record. String views in the records point
+// into the mapping. Throws std::runtime_error if the file can't be opened
+// or isn't a journal.
+class JournalReader
+{
+public:
+  explicit JournalReader(const std::string &path);
+  ~JournalReader();
+
+  bool next(JournalRecord &record);
+
+  uint64_t last_lsn() const { return _last_lsn; }
+  bool torn_tail() const { return _torn_tail; }
+  // offset in the file just past the last valid record
+  size_t valid_size() const;
+
+private:
+  std::unique_ptr<MappedFile> _file;
+  const char *_position;
+  const char *_end;
+  uint64_t _last_lsn = 0;
+  bool _torn_tail = false;
+};
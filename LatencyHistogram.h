@@ -0,0 +1,253 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// HDR-style log-linear histogram for latencies in nanoseconds.
+//
+// Values below `linear_count` get a bucket of their own; above that, every
+// power of two is split into `sub_bucket_count` linear sub-buckets, so the
+// relative error of any reported value is bounded by 1/sub_bucket_count
+// (~6%) over the whole 64-bit range while the footprint stays fixed.
+//
+// `record` is a couple of relaxed atomic increments, so it can be called
+// concurrently from any thread (including readers holding a shared lock).
+class LatencyHistogram
+{
+public:
+  static constexpr unsigned int sub_bucket_bits = 4;
+  static constexpr uint64_t sub_bucket_count = uint64_t{1} << sub_bucket_bits;
+  static constexpr uint64_t linear_count = sub_bucket_count * 2;
+  static constexpr size_t bucket_count = linear_count + (64 - sub_bucket_bits - 1) * sub_bucket_count;
+
+  struct Snapshot
+  {
+    uint64_t count = 0;
+    uint64_t sum = 0;
+    std::vector<uint64_t> buckets; // empty when count == 0
+
+    double mean() const { return count != 0 ? static_cast<double>(sum) / count : 0.0; }
+
+    // return the (upper bound of the) value at the given quantile, eg 0.99
+    uint64_t percentile(double quantile) const
+    {
+      if (count == 0)
+        return 0;
+
+      const auto rank = static_cast<uint64_t>(quantile * (count - 1)) + 1;
+      uint64_t seen = 0;
+      for (size_t i = 0; i != buckets.size(); ++i)
+      {
+        seen += buckets[i];
+        if (seen >= rank)
+          return bucket_upper_bound(i);
+      }
+      return bucket_upper_bound(buckets.size() - 1);
+    }
+
+    uint64_t min() const
+    {
+      for (size_t i = 0; i != buckets.size(); ++i)
+        if (buckets[i] != 0)
+          return bucket_lower_bound(i);
+      return 0;
+    }
+
+    uint64_t max() const
+    {
+      for (auto i = buckets.size(); i != 0; --i)
+        if (buckets[i - 1] != 0)
+          return bucket_upper_bound(i - 1);
+      return 0;
+    }
+  };
+
+  void record(uint64_t value) noexcept
+  {
+    _buckets[bucket_index(value)].fetch_add(1, std::memory_order_relaxed);
+    _sum.fetch_add(value, std::memory_order_relaxed);
+  }
+
+  Snapshot snapshot() const
+  {
+    Snapshot snapshot;
+    snapshot.buckets.resize(bucket_count);
+    for (size_t i = 0; i != bucket_count; ++i)
+    {
+      snapshot.buckets[i] = _buckets[i].load(std::memory_order_relaxed);
+      snapshot.count += snapshot.buckets[i];
+    }
+    snapshot.sum = _sum.load(std::memory_order_relaxed);
+    if (snapshot.count == 0)
+      snapshot.buckets.clear();
+    return snapshot;
+  }
+
+  static constexpr size_t bucket_index(uint64_t value) noexcept
+  {
+    if (value < linear_count)
+      return static_cast<size_t>(value);
+
+    // position of the most significant bit (>= sub_bucket_bits + 1 here)
+    const auto msb = 63 - static_cast<unsigned int>(count_leading_zeros(value));
+    const auto shift = msb - sub_bucket_bits;
+    const auto sub_bucket = (value >> shift) - sub_bucket_count;
+    return static_cast<size_t>(linear_count + (msb - sub_bucket_bits - 1) * sub_bucket_count + sub_bucket);
+  }
+
+  static constexpr uint64_t bucket_lower_bound(size_t index) noexcept
+  {
+    if (index < linear_count)
+      return index;
+
+    const auto octave = (index - linear_count) / sub_bucket_count;
+    const auto sub_bucket = (index - linear_count) % sub_bucket_count;
+    return (sub_bucket_count + sub_bucket) << (octave + 1);
+  }
+
+  static constexpr uint64_t bucket_upper_bound(size_t index) noexcept
+  {
+    if (index < linear_count)
+      return index;
+
+    const auto octave = (index - linear_count) / sub_bucket_count;
+    return bucket_lower_bound(index) + ((uint64_t{1} << (octave + 1)) - 1);
+  }
+
+private:
+  static constexpr int count_leading_zeros(uint64_t value) noexcept
+  {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_clzll(value);
+#else
+    int n = 0;
+    for (uint64_t bit = uint64_t{1} << 63; (value & bit) == 0; bit >>= 1)
+      ++n;
+    return n;
+#endif
+  }
+
+  std::array<std::atomic<uint64_t>, bucket_count> _buckets{};
+  std::atomic<uint64_t> _sum{0};
+};
+
+// Public operations and internal phases of OrderCache that are timed when
+// built with ORDERCACHE_ENABLE_LATENCY_HISTOGRAMS.
+enum class LatencyMetric : size_t
+{
+  AddOrder,
+  CancelOrder,
+  AmendOrderQty,
+  CancelOrdersForUser,
+  CancelOrdersForSecIdWithMinimumQty,
+  GetMatchingSizeForSecurity,
+  GetAllOrders,
+  LockWait,
+  Match,
+  Unmatch,
+  Rematch,
+  Count
+};
+
+inline const char *latency_metric_name(LatencyMetric metric)
+{
+  static constexpr const char *names[] = {
+      "addOrder",
+      "cancelOrder",
+      "amendOrderQty",
+      "cancelOrdersForUser",
+      "cancelOrdersForSecIdWithMinimumQty",
+      "getMatchingSizeForSecurity",
+      "getAllOrders",
+      "lock_wait",
+      "match",
+      "unmatch",
+      "rematch",
+  };
+  static_assert(sizeof(names) / sizeof(names[0]) == static_cast<size_t>(LatencyMetric::Count));
+  return names[static_cast<size_t>(metric)];
+}
+
+struct LatencyStats
+{
+  // false when the histograms have been compiled out (the default)
+  bool enabled = false;
+  std::array<LatencyHistogram::Snapshot, static_cast<size_t>(LatencyMetric::Count)> metrics;
+
+  const LatencyHistogram::Snapshot &operator[](LatencyMetric metric) const { return metrics[static_cast<size_t>(metric)]; }
+};
+
+#ifdef ORDERCACHE_ENABLE_LATENCY_HISTOGRAMS
+
+// One histogram per LatencyMetric
+class LatencyRecorder
+{
+public:
+  void record(LatencyMetric metric, uint64_t ns) noexcept { _histograms[static_cast<size_t>(metric)].record(ns); }
+
+  LatencyStats snapshot() const
+  {
+    LatencyStats stats;
+    stats.enabled = true;
+    for (size_t i = 0; i != _histograms.size(); ++i)
+      stats.metrics[i] = _histograms[i].snapshot();
+    return stats;
+  }
+
+private:
+  std::array<LatencyHistogram, static_cast<size_t>(LatencyMetric::Count)> _histograms;
+};
+
+// Records the time elapsed between construction and stop()/destruction
+class LatencyTimer
+{
+public:
+  using clock = std::chrono::steady_clock;
+
+  LatencyTimer(LatencyRecorder &recorder, LatencyMetric metric) noexcept
+      : _recorder(&recorder), _metric(metric), _start(clock::now()) {}
+
+  ~LatencyTimer() { stop(); }
+
+  LatencyTimer(const LatencyTimer &) = delete;
+  LatencyTimer &operator=(const LatencyTimer &) = delete;
+
+  void stop() noexcept
+  {
+    if (_recorder == nullptr)
+      return;
+
+    const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - _start);
+    _recorder->record(_metric, static_cast<uint64_t>(elapsed.count()));
+    _recorder = nullptr;
+  }
+
+private:
+  LatencyRecorder *_recorder;
+  LatencyMetric _metric;
+  clock::time_point _start;
+};
+
+#else
+
+// Compiled-out variants: empty types whose calls inline to nothing
+
+class LatencyRecorder
+{
+public:
+  void record(LatencyMetric, uint64_t) noexcept {}
+  LatencyStats snapshot() const { return {}; }
+};
+
+class LatencyTimer
+{
+public:
+  LatencyTimer(LatencyRecorder &, LatencyMetric) noexcept {}
+  void stop() noexcept {}
+};
+
+#endif
@@ -0,0 +1,166 @@
+#include "MatchingSizeNotifier.h"
+#include <algorithm>
+
+MatchingSizeNotifier::MatchingSizeNotifier(Delivery delivery, std::chrono::microseconds coalesce_interval)
+{
+  if (delivery == Delivery::Thread)
+    _delivery_thread = std::thread([this, coalesce_interval]()
+                                   { delivery_loop(coalesce_interval); });
+}
+
+MatchingSizeNotifier::~MatchingSizeNotifier()
+{
+  if (_delivery_thread.joinable() == true)
+  {
+    {
+      std::lock_guard lock(_mutex);
+      _stop = true;
+    }
+    _wake_cv.notify_one();
+    _delivery_thread.join();
+  }
+}
+
+MatchingSizeNotifier::SubscriptionId MatchingSizeNotifier::subscribe(const std::string &security_id, Listener listener)
+{
+  const auto security_hash = std::hash<std::string_view>{}(security_id);
+
+  std::lock_guard subscriptions_lock(_subscriptions_mutex);
+  const auto id = _next_id++;
+  _subscriptions[security_hash].push_back({id, std::move(listener)});
+  _subscription_security.emplace(id, security_hash);
+
+  std::lock_guard lock(_mutex);
+  ++_watched[security_hash];
+  return id;
+}
+
+MatchingSizeNotifier::SubscriptionId MatchingSizeNotifier::subscribeAll(Listener listener)
+{
+  std::lock_guard subscriptions_lock(_subscriptions_mutex);
+  const auto id = _next_id++;
+  _wildcard_subscriptions.push_back({id, std::move(listener)});
+
+  std::lock_guard lock(_mutex);
+  ++_wildcards;
+  return id;
+}
+
+void MatchingSizeNotifier::unsubscribe(SubscriptionId id)
+{
+  auto remove = [id](std::vector<Subscription> &subscriptions)
+  {
+    subscriptions.erase(std::remove_if(subscriptions.begin(), subscriptions.end(), [id](const auto &x)
+                                       { return x.id == id; }),
+                        subscriptions.end());
+  };
+
+  std::lock_guard subscriptions_lock(_subscriptions_mutex);
+  auto it = _subscription_security.find(id);
+  if (it != _subscription_security.end())
+  {
+    const auto security_hash = it->second;
+    _subscription_security.erase(it);
+
+    auto &subscriptions = _subscriptions[security_hash];
+    remove(subscriptions);
+    if (subscriptions.empty() == true)
+      _subscriptions.erase(security_hash);
+
+    std::lock_guard lock(_mutex);
+    if (--_watched[security_hash] == 0)
+      _watched.erase(security_hash);
+  }
+  else
+  {
+    const auto size = _wildcard_subscriptions.size();
+    remove(_wildcard_subscriptions);
+    if (_wildcard_subscriptions.size() != size)
+    {
+      std::lock_guard lock(_mutex);
+      --_wildcards;
+    }
+  }
+}
+
+void MatchingSizeNotifier::publish(std::string_view security_id, unsigned int old_size, unsigned int new_size)
+{
+  const auto security_hash = std::hash<std::string_view>{}(security_id);
+
+  std::lock_guard lock(_mutex);
+  if (_wildcards == 0 && _watched.count(security_hash) == 0)
+    return;
+
+  const auto [it, inserted] = _pending_index.try_emplace(security_hash, _pending.size());
+  if (inserted == true)
+  {
+    _pending.push_back({std::string(security_id), old_size, new_size});
+    if (_pending.size() == 1)
+      _wake_cv.notify_one();
+  }
+  else
+    _pending[it->second].new_size = new_size; // coalesced, keeping the first old size
+}
+
+std::vector<MatchingSizeChange> MatchingSizeNotifier::poll()
+{
+  std::lock_guard subscriptions_lock(_subscriptions_mutex);
+  auto changes = take_pending();
+  deliver(changes);
+  return changes;
+}
+
+std::vector<MatchingSizeChange> MatchingSizeNotifier::take_pending()
+{
+  std::vector<MatchingSizeChange> changes;
+  {
+    std::lock_guard lock(_mutex);
+    changes.swap(_pending);
+    _pending_index.clear();
+  }
+
+  // changes that cancelled out
+  changes.erase(std::remove_if(changes.begin(), changes.end(), [](const auto &change)
+                               { return change.old_size == change.new_size; }),
+                changes.end());
+  return changes;
+}
+
+void MatchingSizeNotifier::deliver(const std::vector<MatchingSizeChange> &changes)
+{
+  for (const auto &change : changes)
+  {
+    auto it = _subscriptions.find(std::hash<std::string_view>{}(change.security_id));
+    if (it != _subscriptions.end())
+      for (const auto &subscription : it->second)
+        if (subscription.listener)
+          subscription.listener(change);
+
+    for (const auto &subscription : _wildcard_subscriptions)
+      if (subscription.listener)
+        subscription.listener(change);
+  }
+}
+
+void MatchingSizeNotifier::delivery_loop(std::chrono::microseconds coalesce_interval)
+{
+  while (true)
+  {
+    {
+      // wait for a first change, then for the coalescing interval
+      std::unique_lock lock(_mutex);
+      _wake_cv.wait(lock, [this]()
+                    { return _stop || _pending.empty() == false; });
+      if (_wake_cv.wait_for(lock, coalesce_interval, [this]()
+                            { return _stop; }) == true)
+        break;
+    }
+
+    std::lock_guard subscriptions_lock(_subscriptions_mutex);
+    deliver(take_pending());
+  }
+
+  // changes published before the notifier was stopped
+  std::lock_guard subscriptions_lock(_subscriptions_mutex);
+  deliver(take_pending());
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+struct MatchingSizeChange
+{
+  std::string security_id;
+  unsigned int old_size;
+  unsigned int new_size;
+};
+
+// Subscriptions to changes of the matching size of securities, fed by
+// OrderCache::setNotifier.
+//
+// Changes are coalesced per security until they are delivered: a delta
+// carries the matching size at the previous delivery and the latest one
+// (and isn't delivered at all if they are equal). Only securities with a
+// subscription (or any, with a wildcard subscription) are tracked.
+//
+// Delivery is either on a background thread, every coalescing interval, or
+// whenever the owner calls poll(), which also returns the delivered
+// changes, so subscriptions without a listener act as a pollable queue.
+// Listeners run one at a time and must not (un)subscribe; once unsubscribe
+// returns its listener isn't called anymore.
+class MatchingSizeNotifier
+{
+public:
+  enum class Delivery
+  {
+    Thread,
+    Poll,
+  };
+
+  using Listener = std::function<void(const MatchingSizeChange &change)>;
+  using SubscriptionId = uint64_t;
+
+  explicit MatchingSizeNotifier(Delivery delivery = Delivery::Thread,
+                                std::chrono::microseconds coalesce_interval = std::chrono::milliseconds(1));
+  ~MatchingSizeNotifier();
+
+  MatchingSizeNotifier(const MatchingSizeNotifier &) = delete;
+  MatchingSizeNotifier &operator=(const MatchingSizeNotifier &) = delete;
+
+  // listener may be empty, for poll()
+  SubscriptionId subscribe(const std::string &security_id, Listener listener = nullptr);
+  SubscriptionId subscribeAll(Listener listener = nullptr);
+  void unsubscribe(SubscriptionId id);
+
+  // deliver the pending changes to the listeners on the calling thread
+  // and return them (in the order the securities first changed)
+  std::vector<MatchingSizeChange> poll();
+
+  // called by the cache, with the security's lock held
+  void publish(std::string_view security_id, unsigned int old_size, unsigned int new_size);
+
+private:
+  struct Subscription
+  {
+    SubscriptionId id;
+    Listener listener;
+  };
+
+  std::vector<MatchingSizeChange> take_pending();
+  void deliver(const std::vector<MatchingSizeChange> &changes);
+  void delivery_loop(std::chrono::microseconds coalesce_interval);
+
+  // pending changes (and the securities tracked)
+  std::mutex _mutex;
+  std::vector<MatchingSizeChange> _pending;
+  std::unordered_map<size_t, size_t> _pending_index; // security hash -> index in _pending
+  std::unordered_map<size_t, unsigned int> _watched; // security hash -> subscriptions
+  unsigned int _wildcards = 0;
+
+  // subscriptions, held while delivering
+  std::mutex _subscriptions_mutex;
+  std::unordered_map<size_t, std::vector<Subscription>> _subscriptions; // by security hash
+  std::vector<Subscription> _wildcard_subscriptions;
+  std::unordered_map<SubscriptionId, size_t> _subscription_security; // wildcards aren't in it
+  SubscriptionId _next_id = 1;
+
+  std::condition_variable _wake_cv; // wakes the delivery thread
+  bool _stop = false;
+  std::thread _delivery_thread;
+};
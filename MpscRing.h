@@ -0,0 +1,97 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <utility>
+
+// Bounded lock-free multi-producer/single-consumer ring buffer.
+//
+// Each cell carries a sequence number telling whether it is free for the
+// producer claiming position `pos` (sequence == pos) or holds the value
+// pushed there (sequence == pos + 1): producers claim positions with a CAS
+// on the tail and publish the value by bumping the sequence, so the
+// consumer never contends with them. The capacity is rounded up to a power
+// of two. Values only need to be move constructible.
+template <typename T>
+class MpscRing
+{
+public:
+  explicit MpscRing(size_t capacity)
+  {
+    size_t size = 2;
+    while (size < capacity)
+      size *= 2;
+
+    _mask = size - 1;
+    _cells = std::make_unique<Cell[]>(size);
+    for (size_t i = 0; i != size; ++i)
+      _cells[i].sequence.store(i, std::memory_order_relaxed);
+  }
+
+  MpscRing(const MpscRing &) = delete;
+  MpscRing &operator=(const MpscRing &) = delete;
+
+  size_t capacity() const { return _mask + 1; }
+
+  // any thread: false (leaving value untouched) if the ring is full
+  bool try_push(T &value)
+  {
+    auto pos = _tail.load(std::memory_order_relaxed);
+    while (true)
+    {
+      auto &cell = _cells[pos & _mask];
+      const auto sequence = cell.sequence.load(std::memory_order_acquire);
+      const auto diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+
+      if (diff == 0)
+      {
+        if (_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed) == true)
+        {
+          cell.value.emplace(std::move(value));
+          cell.sequence.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      }
+      else if (diff < 0)
+        return false; // the consumer hasn't freed this cell yet: full
+      else
+        pos = _tail.load(std::memory_order_relaxed);
+    }
+  }
+
+  // consumer thread only: nothing if the ring is empty
+  std::optional<T> try_pop()
+  {
+    auto &cell = _cells[_head & _mask];
+    if (cell.sequence.load(std::memory_order_acquire) != _head + 1)
+      return std::nullopt;
+
+    std::optional<T> value(std::move(*cell.value));
+    cell.value.reset();
+    cell.sequence.store(_head + _mask + 1, std::memory_order_release);
+    ++_head;
+    return value;
+  }
+
+  // consumer thread only
+  bool empty() const
+  {
+    return _cells[_head & _mask].sequence.load(std::memory_order_acquire) != _head + 1;
+  }
+
+private:
+  struct alignas(64) Cell
+  {
+    std::atomic<size_t> sequence;
+    std::optional<T> value;
+  };
+
+  std::unique_ptr<Cell[]> _cells;
+  size_t _mask;
+
+  alignas(64) std::atomic<size_t> _tail{0}; // next position claimed by producers
+  alignas(64) size_t _head = 0;             // next position read by the consumer
+};
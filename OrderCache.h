@@ -1,17 +1,145 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <vector>
+#include <array>
+#include <atomic>
 #include <list>
+#include <memory_resource>
+#include <set>
 #include <unordered_set>
 #include <unordered_map>
 #include <shared_mutex>
+#include <mutex>
 #include <functional>
 #include <utility>
 #include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <optional>
+#include <thread>
+#include <cstdint>
+
+#include "AdaptiveHashMap.h"
+#include "OrderCachePolicies.h"
+#include "Journal.h"
+#include "MatchingSizeNotifier.h"
+#include "OrderCacheStats.h"
+#include "SharedSegment.h"
+#include "TimerWheel.h"
+#include "Tracer.h"
+#include "TrackingResource.h"
 
 using str_hash = std::hash<std::string>;
 
+class ChangeFeed; // ChangeFeed.h, which needs Order
+struct OrderChanges;
+
+// string (view) with its precomputed str_hash value, to build orders from
+// strings that are shared by many of them (eg interned in a snapshot)
+// without hashing each occurrence again
+struct HashedStringView
+{
+  HashedStringView(std::string_view value) : value(value), hash(std::hash<std::string_view>{}(value)) {}
+  HashedStringView(std::string_view value, size_t hash) : value(value), hash(hash) {}
+
+  std::string_view value;
+  size_t hash;
+};
+
+// fields of an order, viewing strings owned elsewhere (eg a memory mapped
+// order file, see OrderFile.h), for BasicOrderCache::addOrders
+struct OrderRecord
+{
+  HashedStringView order_id;
+  HashedStringView security_id;
+  std::string_view side;
+  unsigned int qty;
+  HashedStringView user;
+  HashedStringView company;
+};
+
+// capacity hints and parallelism of BasicOrderCache::load
+struct BulkLoadOptions
+{
+  size_t securities = 0; // distinct securities in the input (0: unknown)
+  size_t users = 0;      // distinct users (0: unknown)
+  size_t companies = 0;  // distinct companies (0: unknown)
+  unsigned int threads = 0; // matching threads (0: one per hardware thread)
+};
+
+// when BasicOrderCache matches orders (BasicOrderCache::setMatchingMode)
+enum class MatchingMode
+{
+  Eager, // on every add, cancel and amend (default)
+  Lazy,  // once per security, when its matches are next read
+};
+
+// kinds of order changes in a ChangeFeed
+enum class OrderChangeType : uint8_t
+{
+  Added,
+  Cancelled,
+  Updated, // its matched qty, or its qty (amended), changed
+};
+
+// open orders of a security (BasicOrderCache::getSecurityAggregates)
+struct SecurityAggregates
+{
+  size_t buy_orders = 0;
+  size_t sell_orders = 0;
+  uint64_t buy_qty = 0;
+  uint64_t sell_qty = 0;
+  uint64_t buy_unmatched_qty = 0; // qty of the buy orders left unmatched
+  uint64_t sell_unmatched_qty = 0;
+  unsigned int matching_size = 0;
+};
+
+// open orders of a user or a company (BasicOrderCache::getUserAggregates,
+// getCompanyAggregates)
+struct OwnerAggregates
+{
+  uint64_t orders = 0;
+  uint64_t buy_qty = 0;
+  uint64_t sell_qty = 0;
+
+  uint64_t open_qty() const { return buy_qty + sell_qty; }
+};
+
+// bytes used by the orders of a security, or of every security
+// (BasicOrderCache::memoryUsage)
+struct SecurityMemoryUsage
+{
+  std::string security_id;
+  size_t orders = 0;
+  size_t match_edges = 0;     // matched (buy, sell) order pairs
+  uint64_t order_maps = 0;    // nodes (holding the orders) and buckets of the buy and sell order maps
+  uint64_t strings = 0;       // heap bytes of the orders' (and security id's) strings
+  uint64_t order_matches = 0; // the orders' sets of the orders they match
+  uint64_t matches = 0;       // map of the matched pairs
+
+  uint64_t total() const { return order_maps + strings + order_matches + matches; }
+};
+
+// memory used by a cache (BasicOrderCache::memoryUsage): the containers
+// allocating from its pool are counted exactly (by the bytes they
+// request), the maps of securities are estimated from their sizes
+struct MemoryUsage
+{
+  SecurityMemoryUsage totals;                  // of every security
+  std::vector<SecurityMemoryUsage> securities; // largest first
+  uint64_t security_maps = 0;                  // shards' maps of securities (estimated)
+  uint64_t ranking = 0;                        // getTopMatchingSecurities index
+  uint64_t owners = 0;                         // user and company aggregates
+  uint64_t pool_reserved = 0;                  // bytes the pool got from the heap, in use or free
+
+  uint64_t total() const { return totals.total() + security_maps + ranking + owners; }
+  double bytesPerOrder() const { return totals.orders != 0 ? static_cast<double>(total()) / totals.orders : 0.0; }
+  // bytes of both sets' entries and of the matches' entry of a match
+  double bytesPerMatchEdge() const { return totals.match_edges != 0 ? static_cast<double>(totals.order_matches + totals.matches) / totals.match_edges : 0.0; }
+};
+
 class Order
 {
 public:
@@ -24,16 +152,34 @@ public:
       const std::string &user,
       const std::string &company)
       : m_orderId(ordId),
-        m_orderIdHash(str_hash{}(ordId)),
         m_securityId(secId),
-        m_securityIdHash(str_hash{}(secId)),
         m_side(side),
         m_qty(qty),
         m_user(user),
-        m_userHash(str_hash{}(user)),
         m_company(company),
+        m_orderIdHash(str_hash{}(ordId)),
+        m_securityIdHash(str_hash{}(secId)),
+        m_userHash(str_hash{}(user)),
         m_companyHash(str_hash{}(company)) {}
 
+  Order(
+      const HashedStringView &ordId,
+      const HashedStringView &secId,
+      std::string_view side,
+      const unsigned int qty,
+      const HashedStringView &user,
+      const HashedStringView &company)
+      : m_orderId(ordId.value),
+        m_securityId(secId.value),
+        m_side(side),
+        m_qty(qty),
+        m_user(user.value),
+        m_company(company.value),
+        m_orderIdHash(ordId.hash),
+        m_securityIdHash(secId.hash),
+        m_userHash(user.hash),
+        m_companyHash(company.hash) {}
+
   // do not alter these accessor methods
   std::string orderId() const { return m_orderId; }
   std::string securityId() const { return m_securityId; }
@@ -42,11 +188,35 @@ public:
   std::string company() const { return m_company; }
   unsigned int qty() const { return m_qty; }
 
+  // non-owning access to the strings, valid while the order is alive
+  std::string_view orderIdView() const { return m_orderId; }
+  std::string_view securityIdView() const { return m_securityId; }
+  std::string_view sideView() const { return m_side; }
+  std::string_view userView() const { return m_user; }
+  std::string_view companyView() const { return m_company; }
+
   size_t orderIdHash() const { return m_orderIdHash; }
   size_t securityIdHash() const { return m_securityIdHash; }
   size_t userHash() const { return m_userHash; }
   size_t companyHash() const { return m_companyHash; }
 
+  // amended qty (BasicOrderCache::amendOrderQty)
+  void setQty(unsigned int qty) { m_qty = qty; }
+
+  // heap bytes of the strings, beyond their small string buffers
+  // (BasicOrderCache::memoryUsage)
+  size_t stringHeapBytes() const
+  {
+    return heap_bytes(m_orderId) + heap_bytes(m_securityId) + heap_bytes(m_side) + heap_bytes(m_user) + heap_bytes(m_company);
+  }
+
+  static size_t heap_bytes(const std::string &s)
+  {
+    const auto *begin = reinterpret_cast<const char *>(&s);
+    const bool inline_buffer = std::less_equal<const char *>{}(begin, s.data()) && std::less<const char *>{}(s.data(), begin + sizeof(s));
+    return inline_buffer ? 0 : s.capacity() + 1;
+  }
+
 private:
   // use the below to hold the order data
   // do not remove the these member variables
@@ -91,22 +261,193 @@ public:
   virtual std::vector<Order> getAllOrders() const = 0;
 };
 
-class OrderCache : public OrderCacheInterface
+// OrderCache implementation, parameterized on a locking policy and a
+// matching rule (see OrderCachePolicies.h). OrderCache is the default
+// instantiation, with a single std::shared_mutex and orders from the same
+// company not matching each other.
+template <typename LockPolicy, typename MatchPolicy = DifferentCompanyMatchPolicy>
+class BasicOrderCache : public OrderCacheInterface
 {
 
 public:
+  // clock of order expiry times (expiries aren't persisted by snapshots or
+  // the journal: its time points don't survive a restart)
+  using expiry_clock = std::chrono::steady_clock;
+
+  BasicOrderCache() = default;
+
+  // cache built from a known set of orders with load (moves from them)
+  explicit BasicOrderCache(std::vector<Order> &&orders, const BulkLoadOptions &options = {});
+
+  ~BasicOrderCache();
+
   void addOrder(Order order) override;
 
-  void cancelOrder(const std::string &orderId) override;
+  // add a good-till-time order: it is cancelled by the first advanceTime
+  // at or after `expiry`, rounded up to the millisecond
+  void addOrder(Order order, expiry_clock::time_point expiry);
+
+  // cancel the orders that expired by `now`, re-matching each of their
+  // securities once; returns the number of orders cancelled. Expiries are
+  // kept in a timer wheel (TimerWheel.h), so this only visits due orders.
+  size_t advanceTime(expiry_clock::time_point now = expiry_clock::now());
+
+  // call advanceTime every `interval` on a background thread, until
+  // stopExpiryThread or the cache is destroyed. Throws std::logic_error
+  // with a lock policy that isn't thread safe.
+  void startExpiryThread(std::chrono::milliseconds interval = std::chrono::milliseconds(1));
+  void stopExpiryThread();
 
-  void cancelOrdersForUser(const std::string &user) override;
+  // in lazy mode, adds, cancels and amends only mark their security dirty
+  // and it is re-matched from scratch, in one pass over its orders, when
+  // its matching size (or aggregates, rank or a snapshot) is next read,
+  // which saves the incremental matching of write-heavy securities that
+  // are rarely read. Matching greedily from scratch gives the same matching
+  // size as eager matching when every order can match (any order can be
+  // reached by some history), but with restrictive policies the matches
+  // may differ, as they do between histories with eager matching. Setting
+  // eager mode re-matches the dirty securities first.
+  void setMatchingMode(MatchingMode mode);
 
-  void cancelOrdersForSecIdWithMinimumQty(const std::string &securityId, unsigned int minQty) override;
+  // re-match the dirty securities (lazy mode) now, returning their number
+  size_t refreshMatches();
 
-  unsigned int getMatchingSizeForSecurity(const std::string &securityId) override;
+  // call refreshMatches every `interval` on a background thread, until
+  // stopRefreshThread or the cache is destroyed. Throws std::logic_error
+  // with a lock policy that isn't thread safe.
+  void startRefreshThread(std::chrono::milliseconds interval = std::chrono::milliseconds(10));
+  void stopRefreshThread();
+
+  // the string_view overloads (and the const char * ones, which would be
+  // ambiguous otherwise) look orders and securities up without building a
+  // std::string
+  void cancelOrder(const std::string &orderId) override { cancelOrder(std::string_view(orderId)); }
+  void cancelOrder(std::string_view orderId);
+  void cancelOrder(const char *orderId) { cancelOrder(std::string_view(orderId)); }
+
+  // change the qty of an order in place, keeping its matches as far as
+  // possible: an increase only matches the extra qty, and a reduction below
+  // the matched qty only trims matches (re-matching the other side orders
+  // that got qty back). A new qty of zero cancels the order. Returns false
+  // if there is no such order.
+  bool amendOrderQty(std::string_view orderId, unsigned int newQty);
+
+  void cancelOrdersForUser(const std::string &user) override { cancelOrdersForUser(std::string_view(user)); }
+  void cancelOrdersForUser(std::string_view user);
+  void cancelOrdersForUser(const char *user) { cancelOrdersForUser(std::string_view(user)); }
+
+  void cancelOrdersForSecIdWithMinimumQty(const std::string &securityId, unsigned int minQty) override { cancelOrdersForSecIdWithMinimumQty(std::string_view(securityId), minQty); }
+  void cancelOrdersForSecIdWithMinimumQty(std::string_view securityId, unsigned int minQty);
+  void cancelOrdersForSecIdWithMinimumQty(const char *securityId, unsigned int minQty) { cancelOrdersForSecIdWithMinimumQty(std::string_view(securityId), minQty); }
+
+  unsigned int getMatchingSizeForSecurity(const std::string &securityId) override { return getMatchingSizeForSecurity(std::string_view(securityId)); }
+  unsigned int getMatchingSizeForSecurity(std::string_view securityId);
+  unsigned int getMatchingSizeForSecurity(const char *securityId) { return getMatchingSizeForSecurity(std::string_view(securityId)); }
 
   std::vector<Order> getAllOrders() const override;
 
+  // the (at most) n securities with the largest matching size, largest
+  // first (ties by security id), with their matching size; securities with
+  // nothing matching aren't included. Read from an index kept up to date
+  // as matching sizes change, so it costs O(n) whatever the number of
+  // securities. Not const, as in lazy mode the dirty securities are
+  // re-matched first.
+  std::vector<std::pair<std::string, unsigned int>> getTopMatchingSecurities(size_t n);
+
+  // totals of the open orders of a security, user or company (zero for
+  // unknown ones), kept up to date by the add and cancel paths so that they
+  // cost a lookup instead of a scan of getAllOrders(). getSecurityAggregates
+  // isn't const, as in lazy mode a dirty security is re-matched first.
+  SecurityAggregates getSecurityAggregates(std::string_view securityId);
+  OwnerAggregates getUserAggregates(std::string_view user) const;
+  OwnerAggregates getCompanyAggregates(std::string_view company) const;
+
+  // add orders in bulk: equivalent to calling addOrder for each of them in
+  // turn, but taking each shard lock once and building the orders directly
+  // from the (already hashed) fields
+  void addOrders(const std::vector<OrderRecord> &records);
+  void addOrders(std::vector<Order> &&orders); // moves from the orders
+
+  // add orders in bulk, grouped by security first: the containers are
+  // sized for the new orders up front, and the securities are matched in
+  // parallel (with thread safe lock policies), each one adding its orders
+  // in input order as addOrder would. Holds every shard lock throughout.
+  void load(const std::vector<OrderRecord> &records, const BulkLoadOptions &options = {});
+  void load(std::vector<Order> &&orders, const BulkLoadOptions &options = {}); // moves from the orders
+
+  // snapshot of the per-operation/per-phase latency histograms (only
+  // populated when built with ORDERCACHE_ENABLE_LATENCY_HISTOGRAMS)
+  LatencyStats getLatencyStats() const;
+
+  // snapshot of the operational counters (and latency histograms, if enabled)
+  OrderCacheStats stats() const;
+
+  // attach a tracer to record spans of the write operations and internal
+  // phases (nullptr, the default, disables tracing); the tracer must
+  // outlive the cache or be detached first
+  void setTracer(Tracer *tracer);
+
+  // attach a notifier receiving the changes of the securities' matching
+  // size (nullptr, the default, disables it); the notifier must outlive
+  // the cache or be detached first. loadSnapshot doesn't notify.
+  void setNotifier(MatchingSizeNotifier *notifier);
+
+  // attach a shared memory segment to publish the matching size and order
+  // totals of every security to, for other processes to read (nullptr, the
+  // default, disables it). Every security is published when attached, then
+  // after each operation changing it. The segment must outlive the cache
+  // or be detached first.
+  void setSharedSegment(SharedSegmentWriter *segment);
+
+  // attach a feed recording every order-level change (added, cancelled,
+  // matched or amended qty) with a version, for downstream copies to
+  // follow (nullptr, the default, disables it). Attaching (and loading a
+  // snapshot) resets the feed, so that its consumers resync. In lazy mode
+  // the matched qty of a security's orders changes when it is re-matched.
+  // The feed must outlive the cache or be detached first.
+  void setChangeFeed(ChangeFeed *feed);
+
+  // every order with its unmatched qty (as Added changes), and the version
+  // of the attached change feed that they are at (0 without a feed), taken
+  // together, for consumers of the feed to resync from. Unlike
+  // getMatchingSizeForSecurity, doesn't re-match dirty securities (lazy
+  // mode), as the feed doesn't have their changes yet either.
+  OrderChanges getOrderStates() const;
+
+  // bytes used by the orders (per kind of container, in total and per
+  // security) and by the other structures of the cache, counted by
+  // tracking resources in front of its pool, and bytes per order and per
+  // match edge, to size hosts and compare layouts. Takes every shard lock
+  // (shared) and walks the orders for their strings.
+  MemoryUsage memoryUsage() const;
+
+  // write the whole state of the cache (orders, their unmatched qty and the
+  // matches between them) to a binary snapshot file (see Snapshot.h),
+  // together with the LSN of the last journal record it includes.
+  // Not const, as in lazy mode the dirty securities are re-matched first.
+  // Throws std::runtime_error if the file can't be written.
+  void saveSnapshot(const std::string &path);
+
+  // replace the contents of the cache with a snapshot written by
+  // saveSnapshot, restoring matches as they were instead of re-matching,
+  // and return the journal LSN it includes (0 without a journal).
+  // Throws std::runtime_error if the file can't be read or is corrupt, in
+  // which case the cache is left unchanged.
+  uint64_t loadSnapshot(const std::string &path);
+
+  // attach a write-ahead journal recording every mutation (nullptr, the
+  // default, disables it); the journal must outlive the cache or be
+  // detached first
+  void setJournal(Journal *journal);
+
+  // re-apply the records of a journal after `after_lsn` (eg the one
+  // returned by loadSnapshot), stopping at an incomplete last record.
+  // Records of different securities are independent, so with several
+  // threads each one replays the records of its share of the securities.
+  // Replayed records aren't journaled again. Throws std::runtime_error if
+  // the journal can't be read.
+  JournalReplayStats replayJournal(const std::string &path, uint64_t after_lsn = 0, unsigned int threads = 1);
+
 private:
   struct pair_hash
   {
@@ -119,31 +460,230 @@ private:
     }
   };
 
+  // the containers of every order and security allocate from the cache's
+  // pool (_pool), so that once it has blocks to recycle, adding and
+  // cancelling orders doesn't go to the heap
   struct OrderInfo
   {
-    OrderInfo(unsigned int qty) : unmatched(qty) {}
-    std::unordered_set<size_t> order_matches;
+    OrderInfo(unsigned int qty, std::pmr::memory_resource *resource) : order_matches(resource), unmatched(qty) {}
+    OrderInfo(OrderInfo &&) = default;
+    OrderInfo(const OrderInfo &) = delete; // a copy's matches would allocate from the heap
+    AdaptiveHashMap<size_t, void> order_matches;
     unsigned int unmatched;
+    uint64_t expiry_timer = 0; // TimerWheel handle, 0 without expiry
   };
 
   struct AssetData
   {
     using OrderData = std::pair<Order, OrderInfo>;
-    using OrdersMap = std::unordered_map<size_t, OrderData>;
+    using OrdersMap = AdaptiveHashMap<size_t, OrderData>;
+
+    explicit AssetData(std::pmr::memory_resource *resource)
+        : order_maps_memory(resource), order_matches_memory(resource), matches_memory(resource),
+          buy_orders(&order_maps_memory), sell_orders(&order_maps_memory), matches(&matches_memory) {}
+    AssetData(const AssetData &) = delete; // the containers point to its resources
+
+    // bytes of each kind of container of the security (memoryUsage),
+    // declared first so that they outlive the containers; only used with
+    // the security locked. The orders' sets of matches (OrderInfo) are
+    // created with order_matches_memory.
+    TrackingResource<> order_maps_memory;
+    TrackingResource<> order_matches_memory;
+    TrackingResource<> matches_memory;
 
     OrdersMap buy_orders;
     OrdersMap sell_orders;
 
     using MatchedOrderPair = std::pair<size_t, size_t>;
 
-    std::unordered_map<MatchedOrderPair, unsigned int, pair_hash> matches;
+    AdaptiveHashMap<MatchedOrderPair, unsigned int, pair_hash> matches;
     unsigned int matching_size = 0;
+
+    // total qty of the orders of each side: every match takes the same qty
+    // from a buy and a sell order, so each side's unmatched qty is its
+    // total minus matching_size
+    uint64_t buy_qty = 0;
+    uint64_t sell_qty = 0;
+
+    std::string security_id;
+    size_t security_id_hash = 0;
+
+    // lazy mode: the matches (and matching size) are stale, and whether the
+    // security is in its shard's dirty list
+    bool dirty = false;
+    bool dirty_queued = false;
+
+    // in the shared segment, once published, or shared_overflow if the
+    // segment had no room left for it
+    uint32_t shared_slot = SharedSegmentWriter::no_slot;
+    static constexpr uint32_t shared_overflow = SharedSegmentWriter::no_slot - 1;
+  };
+
+  using mutex_type = typename LockPolicy::mutex_type;
+
+  struct Shard
+  {
+    std::unordered_map<size_t, AssetData> orders_by_security;
+    std::vector<AssetData *> dirty; // lazy mode: securities to re-match
+    mutable mutex_type mutex;
+  };
+
+  // securities with a non-zero matching size, largest first, viewing the
+  // security_id of their AssetData; locked after (inside) the shard locks
+  struct RankedSecurity
+  {
+    unsigned int matching_size;
+    std::string_view security_id;
+
+    bool operator<(const RankedSecurity &other) const
+    {
+      return matching_size != other.matching_size ? matching_size > other.matching_size : security_id < other.security_id;
+    }
   };
 
-  std::unordered_map<size_t, AssetData> _orders_by_security;
-  mutable std::shared_mutex _mutex;
+  struct Ranking
+  {
+    explicit Ranking(std::pmr::memory_resource *resource) : securities(resource) {}
+    std::pmr::set<RankedSecurity> securities;
+    mutable mutex_type mutex;
+  };
 
-  static inline AssetData::MatchedOrderPair get_matched_order_pair(const size_t order_id, const size_t other_side_order_id, const bool is_buy_order)
+  // open orders by user and by company hash (entries go away with their
+  // last order); locked after (inside) the shard locks
+  struct Owners
+  {
+    using Map = std::pmr::unordered_map<size_t, OwnerAggregates>;
+
+    explicit Owners(std::pmr::memory_resource *resource) : users(resource), companies(resource) {}
+    Map users;
+    Map companies;
+    mutable mutex_type mutex;
+  };
+
+  // pool of the order and security containers (declared first, so that it
+  // outlives them); thread safe with thread safe lock policies, as
+  // securities of one shard may be matched by several threads (load,
+  // replayJournal). Pools blocks of up to 1 MiB, for the order arrays of
+  // deep securities to be recycled too
+  using pool_resource = std::conditional_t<LockPolicy::thread_safe, std::pmr::synchronized_pool_resource, std::pmr::unsynchronized_pool_resource>;
+  mutable TrackingResource<std::atomic<uint64_t>> _pool_memory; // heap bytes of the pool
+  mutable pool_resource _pool{std::pmr::pool_options{0, size_t{1} << 20}, &_pool_memory};
+
+  std::array<Shard, LockPolicy::shard_count> _shards;
+  // pending order expiries, in ticks of one millisecond; locked after
+  // (inside) the shard locks
+  struct ExpiryTimer
+  {
+    size_t order_id_hash;
+    size_t security_id_hash;
+  };
+
+  using ExpiryWheel = TimerWheel<ExpiryTimer>;
+
+  struct Expiries
+  {
+    ExpiryWheel wheel{expiry_tick(expiry_clock::now())};
+    mutable mutex_type mutex;
+  };
+
+  // background thread calling a function every interval (expiries, lazy
+  // matching refreshes)
+  struct PeriodicThread
+  {
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool stopping = false;
+
+    template <typename Func>
+    void start(std::chrono::milliseconds interval, Func func)
+    {
+      stop();
+      stopping = false;
+      thread = std::thread([this, interval, func]()
+                           {
+                             std::unique_lock lock(mutex);
+                             while (stopping == false)
+                             {
+                               cv.wait_for(lock, interval);
+                               if (stopping == true)
+                                 break;
+
+                               lock.unlock();
+                               func();
+                               lock.lock();
+                             } });
+    }
+
+    void stop()
+    {
+      if (thread.joinable() == false)
+        return;
+
+      {
+        std::lock_guard lock(mutex);
+        stopping = true;
+      }
+      cv.notify_one();
+      thread.join();
+    }
+  };
+
+  // ticks up to a time (an expiry falls on the following tick, unless it is
+  // exactly at one)
+  static uint64_t expiry_tick(expiry_clock::time_point time) { return std::chrono::floor<std::chrono::milliseconds>(time.time_since_epoch()).count(); }
+  static uint64_t expiry_deadline_tick(expiry_clock::time_point time) { return std::chrono::ceil<std::chrono::milliseconds>(time.time_since_epoch()).count(); }
+
+  void add_single_order(Order &&order, const std::optional<uint64_t> expiry);
+
+  // bytes of the ranking and of the owner maps (memoryUsage), atomic as
+  // loadSnapshot builds owner maps outside of the locks
+  TrackingResource<std::atomic<uint64_t>> _ranking_memory{&_pool};
+  TrackingResource<std::atomic<uint64_t>> _owners_memory{&_pool};
+  Ranking _ranking{&_ranking_memory};
+  Owners _owners{&_owners_memory};
+  Expiries _expiries;
+  PeriodicThread _expiry_thread;
+  PeriodicThread _refresh_thread;
+  std::atomic<MatchingMode> _matching_mode{MatchingMode::Eager}; // changed with every shard lock held
+  mutable LatencyRecorder _latency;
+  mutable StatsCounters<LockPolicy::thread_safe> _counters;
+  Tracer *_tracer = nullptr;
+  MatchingSizeNotifier *_notifier = nullptr;
+  SharedSegmentWriter *_shared_segment = nullptr;
+  ChangeFeed *_change_feed = nullptr;
+  Journal *_journal = nullptr;
+
+  Shard &shard_for(const size_t security_id_hash) { return _shards[security_id_hash % LockPolicy::shard_count]; }
+  const Shard &shard_for(const size_t security_id_hash) const { return _shards[security_id_hash % LockPolicy::shard_count]; }
+
+  std::unique_lock<mutex_type> write_lock(const Shard &shard) const
+  {
+    LatencyTimer timer(_latency, LatencyMetric::LockWait);
+    return std::unique_lock(shard.mutex);
+  }
+
+  std::shared_lock<mutex_type> read_lock(const Shard &shard) const
+  {
+    LatencyTimer timer(_latency, LatencyMetric::LockWait);
+    return std::shared_lock(shard.mutex);
+  }
+
+  // data of a security, created on its first order
+  AssetData &security_data(Shard &shard, const HashedStringView &security_id)
+  {
+    auto [asset_it, new_security] = shard.orders_by_security.try_emplace(security_id.hash, &_pool);
+    auto &asset_data = asset_it->second;
+    if (new_security == true)
+    {
+      asset_data.security_id = security_id.value;
+      asset_data.security_id_hash = security_id.hash;
+      _counters.add(StatsCounter::Securities);
+    }
+    return asset_data;
+  }
+
+  static inline typename AssetData::MatchedOrderPair get_matched_order_pair(const size_t order_id, const size_t other_side_order_id, const bool is_buy_order)
   {
     if (is_buy_order == true)
       return {other_side_order_id, order_id};
@@ -151,22 +691,35 @@ private:
       return {order_id, other_side_order_id};
   }
 
-  static inline void match_order(const Order &order, OrderInfo &order_info, AssetData &asset_data, const bool is_buy_order)
+  // append the change of an order to the change feed, if any (defined in
+  // OrderCacheImpl.h, with ChangeFeed)
+  inline void record_change(OrderChangeType type, const typename AssetData::OrderData &order_data);
+
+  inline void match_order(const Order &order, OrderInfo &order_info, AssetData &asset_data, const bool is_buy_order)
   {
+    TraceScope trace(_tracer, TraceSpan::MatchOrder, asset_data.security_id);
+    _counters.add(StatsCounter::MatchOrderCalls);
+
     // if the order has already been fully matched, stop
     if (order_info.unmatched == 0)
       return;
 
     auto &orders = is_buy_order == true ? asset_data.sell_orders : asset_data.buy_orders;
 
+    uint64_t visited = 0, edges = 0;
     for (auto &order_elem : orders)
     {
+      ++visited;
       auto &other_side_order_data = order_elem.second;
-      if (other_side_order_data.second.unmatched != 0 && other_side_order_data.first.companyHash() != order.companyHash())
+      if (other_side_order_data.second.unmatched == 0)
+        continue;
+
+      // determine how much we can match from both orders and, if the
+      // matching rule allows it, remove from pending/available qty for
+      // further matches
+      const auto match = std::min(order_info.unmatched, other_side_order_data.second.unmatched);
+      if (MatchPolicy{}(order, other_side_order_data.first, match) == true)
       {
-        // determine how much we can match from both orders and remove
-        // from pending/available qty for further matches
-        const auto match = std::min(order_info.unmatched, other_side_order_data.second.unmatched);
         order_info.unmatched -= match;
         other_side_order_data.second.unmatched -= match;
         asset_data.matching_size += match;
@@ -178,17 +731,32 @@ private:
         order_info.order_matches.insert(other_side_order_id);
         other_side_order_data.second.order_matches.insert(order_id);
 
-        asset_data.matches.insert({get_matched_order_pair(order_id, other_side_order_id, is_buy_order), match});
+        // the orders may already match (eg one of them got qty back)
+        auto [match_it, new_match] = asset_data.matches.try_emplace(get_matched_order_pair(order_id, other_side_order_id, is_buy_order), 0);
+        match_it->second += match;
+        edges += new_match;
+
+        // the order itself is recorded by the caller
+        if (asset_data.dirty == false)
+          record_change(OrderChangeType::Updated, other_side_order_data);
 
         // if the order has already been fully matched, stop
         if (order_info.unmatched == 0)
           break;
       }
     }
+
+    trace.set_orders_visited(static_cast<uint32_t>(visited));
+    _counters.add(StatsCounter::MatchOrdersVisited, visited);
+    _counters.add(StatsCounter::MatchEdgesCreated, edges);
   };
 
-  static inline void unmatch_order(AssetData &asset_data, AssetData::OrderData &order_data, const bool is_buy_order)
+  inline void unmatch_order(AssetData &asset_data, typename AssetData::OrderData &order_data, const bool is_buy_order)
   {
+    LatencyTimer timer(_latency, LatencyMetric::Unmatch);
+    TraceScope trace(_tracer, TraceSpan::UnmatchOrder, asset_data.security_id);
+    trace.set_orders_visited(static_cast<uint32_t>(order_data.second.order_matches.size()));
+
     const auto order_id = order_data.first.orderIdHash();
     auto &other_side_orders = is_buy_order == true ? asset_data.sell_orders : asset_data.buy_orders;
 
@@ -204,6 +772,7 @@ private:
 
       // restore previously matched qty
       other_side_order_info.unmatched += match_info_it->second;
+      record_change(OrderChangeType::Updated, other_side_order_it->second);
 
       // remove unmatched order from other side's matched orders
       other_side_order_info.order_matches.erase(order_id);
@@ -214,18 +783,437 @@ private:
       // remove match info entry
       asset_data.matches.erase(match_info_it);
     }
+
+    _counters.add(StatsCounter::MatchEdgesRemoved, order_data.second.order_matches.size());
   };
 
+  // count an added (or removed) order in the totals of its user and company
+  static void update_owners(typename Owners::Map &users, typename Owners::Map &companies,
+                            const Order &order, const bool is_buy_order, const bool added)
+  {
+    for (auto [owners, hash] : {std::pair{&users, order.userHash()}, std::pair{&companies, order.companyHash()}})
+    {
+      auto &aggregates = (*owners)[hash];
+      auto &qty = is_buy_order ? aggregates.buy_qty : aggregates.sell_qty;
+      if (added == true)
+      {
+        ++aggregates.orders;
+        qty += order.qty();
+      }
+      else if (--aggregates.orders == 0)
+        owners->erase(hash);
+      else
+        qty -= order.qty();
+    }
+  }
+
+  inline void on_order_added(AssetData &asset_data, const Order &order, const bool is_buy_order)
+  {
+    _counters.add(StatsCounter::OrdersAdded);
+    _counters.add(is_buy_order ? StatsCounter::BuyOrders : StatsCounter::SellOrders);
+
+    (is_buy_order ? asset_data.buy_qty : asset_data.sell_qty) += order.qty();
+    std::lock_guard lock(_owners.mutex);
+    update_owners(_owners.users, _owners.companies, order, is_buy_order, true);
+  }
+
+  // before the order is erased
+  inline void on_order_removed(AssetData &asset_data, const typename AssetData::OrderData &order_data, const bool is_buy_order)
+  {
+    const auto &[order, order_info] = order_data;
+    _counters.add(StatsCounter::OrdersCancelled);
+    _counters.sub(is_buy_order ? StatsCounter::BuyOrders : StatsCounter::SellOrders);
+
+    if (order_info.expiry_timer != 0)
+    {
+      std::lock_guard lock(_expiries.mutex);
+      _expiries.wheel.cancel(order_info.expiry_timer);
+    }
+
+    (is_buy_order ? asset_data.buy_qty : asset_data.sell_qty) -= order.qty();
+    record_change(OrderChangeType::Cancelled, order_data);
+    std::lock_guard lock(_owners.mutex);
+    update_owners(_owners.users, _owners.companies, order, is_buy_order, false);
+  }
+
   inline void update_matches(AssetData &asset_data)
   {
+    LatencyTimer timer(_latency, LatencyMetric::Rematch);
+    TraceScope trace(_tracer, TraceSpan::UpdateMatches, asset_data.security_id);
+    trace.set_orders_visited(static_cast<uint32_t>(asset_data.sell_orders.size()));
+    _counters.add(StatsCounter::UpdateMatchesCalls);
+
     for (auto &sell_order_data : asset_data.sell_orders)
-      match_order(sell_order_data.second.first, sell_order_data.second.second, asset_data, false);
+    {
+      auto &[order, order_info] = sell_order_data.second;
+      const auto unmatched = order_info.unmatched;
+      match_order(order, order_info, asset_data, false);
+      if (order_info.unmatched != unmatched && asset_data.dirty == false)
+        record_change(OrderChangeType::Updated, sell_order_data.second);
+    }
+  }
+
+  // in lazy mode, leave the matches of a security stale (to be recomputed
+  // by refresh_matches) instead of maintaining them: true if so
+  inline bool defer_matching(AssetData &asset_data)
+  {
+    if (_matching_mode.load(std::memory_order_relaxed) == MatchingMode::Eager)
+      return false;
+
+    _counters.add(StatsCounter::MatchingDeferred);
+    asset_data.dirty = true;
+    queue_dirty(asset_data);
+    return true;
+  }
+
+  // add a security to its shard's dirty list, once. The parallel phases of
+  // load() and replayJournal() queue their securities up front (matching
+  // threads share shards, and only modify their own securities)
+  inline void queue_dirty(AssetData &asset_data)
+  {
+    if (asset_data.dirty_queued == false)
+    {
+      asset_data.dirty_queued = true;
+      shard_for(asset_data.security_id_hash).dirty.push_back(&asset_data);
+    }
+  }
+
+  // match a dirty security from scratch, in one pass over its sell orders
+  inline void refresh_matches(AssetData &asset_data)
+  {
+    // the matching size was left as it was when it got dirty
+    const auto old_size = asset_data.matching_size;
+    _counters.add(StatsCounter::MatchRefreshes);
+
+    // unmatched qty of the orders (in iteration order) before, to record
+    // the net changes only (matching doesn't record them while dirty)
+    std::vector<unsigned int> old_unmatched;
+    if (_change_feed != nullptr)
+      old_unmatched.reserve(asset_data.buy_orders.size() + asset_data.sell_orders.size());
+
+    asset_data.matches.clear();
+    asset_data.matching_size = 0;
+    for (auto *orders : {&asset_data.buy_orders, &asset_data.sell_orders})
+      for (auto &order_elem : *orders)
+      {
+        if (_change_feed != nullptr)
+          old_unmatched.push_back(order_elem.second.second.unmatched);
+        order_elem.second.second.order_matches.clear();
+        order_elem.second.second.unmatched = order_elem.second.first.qty();
+      }
+
+    update_matches(asset_data);
+    asset_data.dirty = false;
+
+    if (_change_feed != nullptr)
+    {
+      auto old_it = old_unmatched.begin();
+      for (auto *orders : {&asset_data.buy_orders, &asset_data.sell_orders})
+        for (auto &order_elem : *orders)
+          if (order_elem.second.second.unmatched != *old_it++)
+            record_change(OrderChangeType::Updated, order_elem.second);
+    }
+
+    on_security_changed(asset_data, old_size);
+  }
+
+  // re-match the dirty securities of a shard (write lock held)
+  size_t refresh_shard(Shard &shard)
+  {
+    size_t refreshed = 0;
+    for (auto *asset_data : shard.dirty)
+    {
+      asset_data->dirty_queued = false;
+      if (asset_data->dirty == true)
+      {
+        refresh_matches(*asset_data);
+        ++refreshed;
+      }
+    }
+    shard.dirty.clear();
+    return refreshed;
+  }
+
+  // re-match a security if it's dirty, returning its matching size; also
+  // called by const readers, as matches are derived from the orders
+  unsigned int refresh_security(const size_t security_id_hash)
+  {
+    auto &shard = shard_for(security_id_hash);
+    const auto lock = write_lock(shard); // write lock (exclusive access)
+    auto it = shard.orders_by_security.find(security_id_hash);
+    if (it == shard.orders_by_security.end())
+      return 0;
+
+    if (it->second.dirty == true)
+      refresh_matches(it->second);
+    return it->second.matching_size;
+  }
+
+  // bulk path of addOrders, for OrderRecord or Order elements
+  template <typename Records>
+  void add_orders(Records &records);
+
+  // bulk path of load
+  template <typename Records>
+  void load_orders(Records &records, const BulkLoadOptions &options);
+
+  static HashedStringView security_of(const OrderRecord &record) { return record.security_id; }
+  static HashedStringView security_of(const Order &order) { return {order.securityIdView(), order.securityIdHash()}; }
+
+  static std::string_view side_of(const OrderRecord &record) { return record.side; }
+  static std::string_view side_of(const Order &order) { return order.sideView(); }
+
+  static Order make_order(const OrderRecord &record) { return Order{record.order_id, record.security_id, record.side, record.qty, record.user, record.company}; }
+  static Order make_order(Order &order) { return std::move(order); }
+
+  uint64_t journal_add(const OrderRecord &record)
+  {
+    return _journal->appendAddOrder(record.security_id.value, record.order_id.value, record.side, record.qty, record.user.value, record.company.value);
+  }
+  uint64_t journal_add(const Order &order)
+  {
+    return _journal->appendAddOrder(order.securityIdView(), order.orderIdView(), order.sideView(), order.qty(), order.userView(), order.companyView());
+  }
+
+  // store the values of a security in the shared segment, interning it
+  // first if needed (once: a security that didn't fit isn't retried)
+  inline void publish_shared(AssetData &asset_data)
+  {
+    if (asset_data.shared_slot == AssetData::shared_overflow)
+      return;
+    if (asset_data.shared_slot == SharedSegmentWriter::no_slot)
+    {
+      const auto slot = _shared_segment->intern(asset_data.security_id);
+      asset_data.shared_slot = slot != SharedSegmentWriter::no_slot ? slot : AssetData::shared_overflow;
+      if (slot == SharedSegmentWriter::no_slot)
+        return;
+    }
+
+    _shared_segment->publish(asset_data.shared_slot, {asset_data.buy_orders.size(), asset_data.sell_orders.size(), asset_data.buy_qty, asset_data.sell_qty, asset_data.matching_size});
+  }
+
+  // give back the storage of the containers that an operation shrank
+  // (AdaptiveHashMap::compact)
+  static inline void compact_security(AssetData &asset_data)
+  {
+    asset_data.buy_orders.compact();
+    asset_data.sell_orders.compact();
+    asset_data.matches.compact();
+  }
+
+  // after an operation on a security: compact it, publish it to the shared
+  // segment, then, if its matching size changed, re-rank it and notify the
+  // change
+  inline void on_security_changed(AssetData &asset_data, const unsigned int old_size)
+  {
+    compact_security(asset_data);
+
+    if (_shared_segment != nullptr)
+      publish_shared(asset_data);
+
+    if (asset_data.matching_size == old_size)
+      return;
+
+    {
+      std::lock_guard lock(_ranking.mutex);
+      if (old_size != 0)
+        _ranking.securities.erase({old_size, asset_data.security_id});
+      if (asset_data.matching_size != 0)
+        _ranking.securities.insert({asset_data.matching_size, asset_data.security_id});
+    }
+
+    if (_notifier != nullptr)
+      _notifier->publish(asset_data.security_id, old_size, asset_data.matching_size);
+  }
+
+  // match and store a new order (addOrder and journal replay), optionally
+  // with the tick it expires at
+  inline void add_order(AssetData &asset_data, Order &&order, const std::optional<uint64_t> expiry = std::nullopt)
+  {
+    // an order id already in the security is ignored, before its expiry,
+    // matches and aggregates account for the new order
+    const auto order_id = order.orderIdHash();
+    if (asset_data.buy_orders.count(order_id) != 0 || asset_data.sell_orders.count(order_id) != 0)
+      return;
+
+    const auto old_size = asset_data.matching_size;
+    const bool is_buy_order = order.sideView() == "Buy";
+
+    OrderInfo order_info(order.qty(), &asset_data.order_matches_memory);
+    if (expiry.has_value() == true)
+    {
+      std::lock_guard lock(_expiries.mutex);
+      order_info.expiry_timer = _expiries.wheel.insert(*expiry, {order.orderIdHash(), order.securityIdHash()});
+    }
+
+    if (defer_matching(asset_data) == false)
+    {
+      LatencyTimer match_timer(_latency, LatencyMetric::Match);
+      match_order(order, order_info, asset_data, is_buy_order);
+    }
+
+    auto &orders = is_buy_order ? asset_data.buy_orders : asset_data.sell_orders;
+
+    on_order_added(asset_data, order, is_buy_order);
+
+    const auto it = orders.try_emplace(order_id, std::move(order), std::move(order_info)).first;
+    record_change(OrderChangeType::Added, it->second);
+
+    on_security_changed(asset_data, old_size);
+  }
+
+  // change the qty of an order (amendOrderQty and journal replay)
+  inline void amend_order_qty(AssetData &asset_data, typename AssetData::OrderData &order_data, const bool is_buy_order, const unsigned int qty)
+  {
+    auto &[order, order_info] = order_data;
+    const auto old_qty = order.qty();
+    const auto old_size = asset_data.matching_size;
+    const auto matched = old_qty - order_info.unmatched;
+
+    auto &side_qty = is_buy_order ? asset_data.buy_qty : asset_data.sell_qty;
+    side_qty = side_qty - old_qty + qty;
+    {
+      std::lock_guard lock(_owners.mutex);
+      update_owners(_owners.users, _owners.companies, order, is_buy_order, false);
+      order.setQty(qty);
+      update_owners(_owners.users, _owners.companies, order, is_buy_order, true);
+    }
+
+    if (defer_matching(asset_data) == true)
+    {
+      record_change(OrderChangeType::Updated, order_data);
+      return on_security_changed(asset_data, old_size);
+    }
+
+    if (qty > old_qty)
+    {
+      // only the extra qty is matched
+      order_info.unmatched += qty - old_qty;
+      LatencyTimer match_timer(_latency, LatencyMetric::Match);
+      match_order(order, order_info, asset_data, is_buy_order);
+    }
+    else if (qty >= matched)
+      order_info.unmatched -= old_qty - qty;
+    else
+    {
+      order_info.unmatched = 0;
+      trim_matches(asset_data, order_data, is_buy_order, matched - qty);
+    }
+
+    record_change(OrderChangeType::Updated, order_data);
+    on_security_changed(asset_data, old_size);
+  }
+
+  // by order id, if it is in the security (journal replay)
+  inline void amend_order_qty(AssetData &asset_data, const std::string_view order_id, const unsigned int qty)
+  {
+    const auto order_id_hash = std::hash<std::string_view>{}(order_id);
+    for (const auto is_buy_order : {true, false})
+    {
+      auto &orders = is_buy_order ? asset_data.buy_orders : asset_data.sell_orders;
+      auto it = orders.find(order_id_hash);
+      if (it != orders.end())
+        return amend_order_qty(asset_data, it->second, is_buy_order, qty);
+    }
+  }
+
+  // take `excess` qty off the matches of an order, then re-match the other
+  // side orders that got qty back against the rest of the book
+  inline void trim_matches(AssetData &asset_data, typename AssetData::OrderData &order_data, const bool is_buy_order, unsigned int excess)
+  {
+    LatencyTimer timer(_latency, LatencyMetric::Unmatch);
+    const auto order_id = order_data.first.orderIdHash();
+    auto &order_matches = order_data.second.order_matches;
+    auto &other_side_orders = is_buy_order == true ? asset_data.sell_orders : asset_data.buy_orders;
+
+    std::vector<typename AssetData::OrderData *> trimmed;
+    for (auto it = order_matches.begin(); excess != 0 && it != order_matches.end();)
+    {
+      auto &other_side_order_data = other_side_orders.find(*it)->second;
+      auto match_it = asset_data.matches.find(get_matched_order_pair(order_id, *it, is_buy_order));
+
+      const auto trim = std::min(excess, match_it->second);
+      match_it->second -= trim;
+      other_side_order_data.second.unmatched += trim;
+      asset_data.matching_size -= trim;
+      excess -= trim;
+      trimmed.push_back(&other_side_order_data);
+
+      if (match_it->second == 0)
+      {
+        asset_data.matches.erase(match_it);
+        other_side_order_data.second.order_matches.erase(order_id);
+        it = order_matches.erase(it);
+        _counters.add(StatsCounter::MatchEdgesRemoved);
+      }
+      else
+        ++it;
+    }
+
+    LatencyTimer match_timer(_latency, LatencyMetric::Rematch);
+    for (auto *other_side_order_data : trimmed)
+    {
+      match_order(other_side_order_data->first, other_side_order_data->second, asset_data, !is_buy_order);
+      record_change(OrderChangeType::Updated, *other_side_order_data);
+    }
+  }
+
+  // remove orders of a security by id and re-match it once (journal replay)
+  inline void cancel_orders(AssetData &asset_data, const std::vector<std::string_view> &order_ids)
+  {
+    // hashed up front: the ids may view orders of the security, which
+    // erasing other orders can move (AdaptiveHashMap)
+    std::vector<size_t> order_id_hashes;
+    order_id_hashes.reserve(order_ids.size());
+    for (const auto order_id : order_ids)
+      order_id_hashes.push_back(std::hash<std::string_view>{}(order_id));
+
+    const auto old_size = asset_data.matching_size;
+    auto cancelled_orders = false;
+    for (const auto order_id_hash : order_id_hashes)
+    {
+      for (const auto is_buy_order : {true, false})
+      {
+        auto &orders = is_buy_order ? asset_data.buy_orders : asset_data.sell_orders;
+        auto it = orders.find(order_id_hash);
+        if (it != orders.end())
+        {
+          if (defer_matching(asset_data) == false)
+            unmatch_order(asset_data, it->second, is_buy_order);
+          on_order_removed(asset_data, it->second, is_buy_order);
+          orders.erase(it);
+          cancelled_orders = true;
+          break;
+        }
+      }
+    }
+
+    if (cancelled_orders == true)
+    {
+      if (asset_data.dirty == false)
+        update_matches(asset_data);
+      on_security_changed(asset_data, old_size);
+    }
   }
 
   template <typename Pred>
-  inline void cancelSecurityOrdersHelper(AssetData &asset_data, Pred pred)
+  inline void cancelSecurityOrdersHelper(AssetData &asset_data, Pred pred, JournalCommit &commit)
   {
-    auto cancel_helper = [&asset_data](auto &orders, auto pred, const bool is_buy_order)
+    if (_journal != nullptr)
+    {
+      // journal the orders about to be cancelled
+      std::vector<std::string_view> order_ids;
+      for (const auto *orders : {&asset_data.buy_orders, &asset_data.sell_orders})
+        for (const auto &order_elem : *orders)
+          if (pred(order_elem.second.first) == true)
+            order_ids.push_back(order_elem.second.first.orderIdView());
+
+      if (order_ids.empty() == false)
+        commit.set(_journal, _journal->appendCancelOrders(asset_data.security_id, order_ids));
+    }
+
+    const auto old_size = asset_data.matching_size;
+    auto cancel_helper = [this, &asset_data](auto &orders, auto pred, const bool is_buy_order)
     {
       auto cancelled_orders = false;
       for (auto it = orders.begin(); it != orders.end();)
@@ -233,7 +1221,9 @@ private:
         const auto ret = pred(it->second.first);
         if (ret == true)
         {
-          unmatch_order(asset_data, it->second, is_buy_order);
+          if (defer_matching(asset_data) == false)
+            unmatch_order(asset_data, it->second, is_buy_order);
+          on_order_removed(asset_data, it->second, is_buy_order);
           it = orders.erase(it);
           cancelled_orders = true;
         }
@@ -248,13 +1238,31 @@ private:
     cancelled_orders |= cancel_helper(asset_data.sell_orders, pred, false);
 
     if (cancelled_orders == true)
-      update_matches(asset_data);
+    {
+      if (asset_data.dirty == false)
+        update_matches(asset_data);
+      on_security_changed(asset_data, old_size);
+    }
   }
 
   template <typename Pred>
   inline void cancelOrdersHelper(Pred pred)
   {
-    for (auto &x : _orders_by_security)
-      cancelSecurityOrdersHelper(x.second, pred);
+    JournalCommit commit; // waits for the journal once the locks are released
+
+    for (auto &shard : _shards)
+    {
+      const auto lock = write_lock(shard); // write lock (exclusive access)
+
+      for (auto &x : shard.orders_by_security)
+        cancelSecurityOrdersHelper(x.second, pred, commit);
+    }
   }
 };
+
+using OrderCache = BasicOrderCache<SharedMutexLockPolicy>;
+
+// instantiated in OrderCache.cpp; other combinations need OrderCacheImpl.h
+extern template class BasicOrderCache<NullLockPolicy>;
+extern template class BasicOrderCache<SharedMutexLockPolicy>;
+extern template class BasicOrderCache<ShardedLockPolicy<>>;
@@ -0,0 +1,1152 @@
+#pragma once
+
+// Definitions of the BasicOrderCache members. Only needs to be included to
+// instantiate policies other than the ones built in OrderCache.cpp.
+
+#include "ChangeFeed.h"
+#include "OrderCache.h"
+#include "Snapshot.h"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <numeric>
+#include <stdexcept>
+#include <thread>
+
+template <typename LockPolicy, typename MatchPolicy>
+BasicOrderCache<LockPolicy, MatchPolicy>::BasicOrderCache(std::vector<Order> &&orders, const BulkLoadOptions &options)
+{
+  load(std::move(orders), options);
+}
+
+template <typename LockPolicy, typename MatchPolicy>
+inline void BasicOrderCache<LockPolicy, MatchPolicy>::record_change(OrderChangeType type, const typename AssetData::OrderData &order_data)
+{
+  if (_change_feed != nullptr)
+    _change_feed->append(type, order_data.first, order_data.second.unmatched);
+}
+
+template <typename LockPolicy, typename MatchPolicy>
+BasicOrderCache<LockPolicy, MatchPolicy>::~BasicOrderCache()
+{
+  stopExpiryThread();
+  stopRefreshThread();
+}
+
+template <typename LockPolicy, typename MatchPolicy>
+void BasicOrderCache<LockPolicy, MatchPolicy>::addOrder(Order order)
+{
+  add_single_order(std::move(order), std::nullopt);
+}
+
+template <typename LockPolicy, typename MatchPolicy>
+void BasicOrderCache<LockPolicy, MatchPolicy>::addOrder(Order order, expiry_clock::time_point expiry)
+{
+  add_single_order(std::move(order), expiry_deadline_tick(expiry));
+}
+
+template <typename LockPolicy, typename MatchPolicy>
+void BasicOrderCache<LockPolicy, MatchPolicy>::add_single_order(Order &&order, const std::optional<uint64_t> expiry)
+{
+  LatencyTimer op_timer(_latency, LatencyMetric::AddOrder);
+  JournalCommit commit; // waits for the journal once the lock is released
+  auto &shard = shard_for(order.securityIdHash());
+  const auto lock = write_lock(shard); // write lock (exclusive access)
+  TraceScope trace(_tracer, TraceSpan::AddOrder);
+
+  // journaled first: if the journal has failed, the cache is left unchanged
+  if (_journal != nullptr)
+    commit.set(_journal, journal_add(order));
+
+  auto &asset_data = security_data(shard, {order.securityIdView(), order.securityIdHash()});
+  trace.set_security(asset_data.security_id);
+
+  add_order(asset_data, std::move(order), expiry);
+}
+
+template <typename LockPolicy, typename MatchPolicy>
+void BasicOrderCache<LockPolicy, MatchPolicy>::addOrders(const std::vector<OrderRecord> &records)
+{
+  add_orders(records);
+}
+
+template <typename LockPolicy, typename MatchPolicy>
+void BasicOrderCache<LockPolicy, MatchPolicy>::addOrders(std::vector<Order> &&orders)
+{
+  add_orders(orders);
+}
+
+template <typename LockPolicy, typename MatchPolicy>
+template <typename Records>
+void BasicOrderCache<LockPolicy, MatchPolicy>::add_orders(Records &records)
+{
+  JournalCommit commit; // waits for the journal once the locks are released
+
+  // group the records by shard (keeping their order, which is all that
+  // matters for matching within each security)
+  std::vector<size_t> indexes;
+  std::array<size_t, LockPolicy::shard_count + 1> shard_begin{};
+  if constexpr (LockPolicy::shard_count > 1)
+  {
+    for (const auto &record : records)
+      ++shard_begin[security_of(record).hash % LockPolicy::shard_count + 1];
+    for (size_t i = 1; i != shard_begin.size(); ++i)
+      shard_begin[i] += shard_begin[i - 1];
+
+    auto next = shard_begin;
+    indexes.resize(records.size());
+    for (size_t i = 0; i != records.size(); ++i)
+      indexes[next[security_of(records[i]).hash % LockPolicy::shard_count]++] = i;
+  }
+  else
+    shard_begin[1] = records.size();
+
+  for (size_t s = 0; s != LockPolicy::shard_count; ++s)
+  {
+    if (shard_begin[s] == shard_begin[s + 1])
+      continue;
+
+    auto &shard = _shards[s];
+    const auto lock = write_lock(shard); // write lock (exclusive access)
+
+    // consecutive records are often for the same security
+    AssetData *asset_data = nullptr;
+    size_t security_id_hash = 0;
+
+    for (auto i = shard_begin[s]; i != shard_begin[s + 1]; ++i)
+    {
+      auto &record = LockPolicy::shard_count > 1 ? records[indexes[i]] : records[i];
+      const auto security_id = security_of(record);
+
+      if (_journal != nullptr)
+        commit.set(_journal, journal_add(record));
+
+      if (asset_data == nullptr || security_id.hash != security_id_hash)
+      {
+        asset_data = &security_data(shard, security_id);
+        security_id_hash = security_id.hash;
+      }
+
+      add_order(*asset_data, make_order(record));
+    }
+  }
+}
+
+template <typename LockPolicy, typename MatchPolicy>
+void BasicOrderCache<LockPolicy, MatchPolicy>::load(const std::vector<OrderRecord> &records, const BulkLoadOptions &options)
+{
+  load_orders(records, options);
+}
+
+template <typename LockPolicy, typename MatchPolicy>
+void BasicOrderCache<LockPolicy, MatchPolicy>::load(std::vector<Order> &&orders, const BulkLoadOptions &options)
+{
+  load_orders(orders, options);
+}
+
+template <typename LockPolicy, typename MatchPolicy>
+template <typename Records>
+void BasicOrderCache<LockPolicy, MatchPolicy>::load_orders(Records &records, const BulkLoadOptions &options)
+{
+  JournalCommit commit; // waits for the journal once the locks are released
+
+  struct Group
+  {
+    HashedStringView security_id;
+    size_t begin = 0; // in indexes
+    size_t end = 0;   // (the number of orders while grouping)
+    size_t buy_orders = 0;
+    AssetData *asset_data = nullptr;
+  };
+
+  // group the records by security, keeping their order
+  std::vector<Group> groups;
+  std::vector<uint32_t> group_of(records.size());
+  {
+    std::unordered_map<size_t, uint32_t> group_index;
+    group_index.reserve(options.securities);
+    for (size_t i = 0; i != records.size(); ++i)
+    {
+      const auto security_id = security_of(records[i]);
+      const auto [it, inserted] = group_index.try_emplace(security_id.hash, static_cast<uint32_t>(groups.size()));
+      if (inserted == true)
+        groups.push_back({security_id});
+
+      auto &group = groups[it->second];
+      ++group.end;
+      group.buy_orders += side_of(records[i]) == "Buy";
+      group_of[i] = it->second;
+    }
+  }
+
+  // indexes of the records of each group, in [begin, end)
+  size_t offset = 0;
+  for (auto &group : groups)
+  {
+    const auto orders = group.end;
+    group.begin = group.end = offset;
+    offset += orders;
+  }
+
+  std::vector<size_t> indexes(records.size());
+  for (size_t i = 0; i != records.size(); ++i)
+    indexes[groups[group_of[i]].end++] = i;
+
+  // write lock (exclusive access) on every shard for the whole load
+  std::array<std::unique_lock<mutex_type>, LockPolicy::shard_count> locks;
+  for (size_t i = 0; i != _shards.size(); ++i)
+    locks[i] = write_lock(_shards[i]);
+
+  if (_journal != nullptr)
+    for (const auto &record : records)
+      commit.set(_journal, journal_add(record));
+
+  // size every container for the new orders, creating the securities up
+  // front so that matching threads only modify their own securities
+  std::array<size_t, LockPolicy::shard_count> new_securities{};
+  for (const auto &group : groups)
+    new_securities[group.security_id.hash % LockPolicy::shard_count] += 1;
+  for (size_t i = 0; i != _shards.size(); ++i)
+    _shards[i].orders_by_security.reserve(_shards[i].orders_by_security.size() + new_securities[i]);
+
+  for (auto &group : groups)
+  {
+    auto &asset_data = security_data(shard_for(group.security_id.hash), group.security_id);
+    const auto sell_orders = group.end - group.begin - group.buy_orders;
+    asset_data.buy_orders.reserve(asset_data.buy_orders.size() + group.buy_orders);
+    asset_data.sell_orders.reserve(asset_data.sell_orders.size() + sell_orders);
+    asset_data.matches.reserve(asset_data.matches.size() + std::max(group.buy_orders, sell_orders));
+    group.asset_data = &asset_data;
+    if (_matching_mode.load(std::memory_order_relaxed) == MatchingMode::Lazy)
+      queue_dirty(asset_data);
+  }
+
+  {
+    std::lock_guard owners_lock(_owners.mutex);
+    _owners.users.reserve(_owners.users.size() + options.users);
+    _owners.companies.reserve(_owners.companies.size() + options.companies);
+  }
+
+  // counters of single threaded caches aren't safe to update concurrently
+  auto threads = options.threads != 0 ? options.threads : std::thread::hardware_concurrency();
+  if (LockPolicy::thread_safe == false)
+    threads = 1;
+  threads = static_cast<unsigned int>(std::clamp<size_t>(threads, 1, std::max<size_t>(groups.size(), 1)));
+
+  // largest securities first, so that a large one isn't left for last
+  std::vector<uint32_t> schedule(groups.size());
+  std::iota(schedule.begin(), schedule.end(), 0);
+  std::sort(schedule.begin(), schedule.end(), [&groups](const auto a, const auto b)
+            { return groups[a].end - groups[a].begin > groups[b].end - groups[b].begin; });
+
+  std::atomic<size_t> next{0};
+  auto match = [&]()
+  {
+    for (auto n = next.fetch_add(1); n < schedule.size(); n = next.fetch_add(1))
+    {
+      const auto &group = groups[schedule[n]];
+      for (auto i = group.begin; i != group.end; ++i)
+        add_order(*group.asset_data, make_order(records[indexes[i]]));
+    }
+  };
+
+  std::vector<std::exception_ptr> errors(threads);
+  auto run = [&match, &errors](unsigned int part)
+  {
+    try
+    {
+      match();
+    }
+    catch (...)
+    {
+      errors[part] = std::current_exception();
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for (auto t = 1u; t < threads; ++t)
+    workers.emplace_back(run, t);
+  run(0);
+  for (auto &worker : workers)
+    worker.join();
+
+  for (const auto &error : errors)
+    if (error)
+      std::rethrow_exception(error);
+}
+
+template <typename LockPolicy, typename MatchPolicy>
+void BasicOrderCache<LockPolicy, MatchPolicy>::cancelOrder(std::string_view orderId)
+{
+  LatencyTimer op_timer(_latency, LatencyMetric::CancelOrder);
+  TraceScope trace(_tracer, TraceSpan::CancelOrder);
+  _counters.add(StatsCounter::CancelOrderCalls);
+
+  // NOTE: cancelOrder doesn't use cancelOrdersHelper in this version
+  // because we can leverage that orders are stored in a map with their
+  // orderIdHash as a key and find it more efficiently (than iterating
+  // through all the orders)
+
+  const auto order_id_hash = std::hash<std::string_view>{}(orderId);
+  JournalCommit commit; // waits for the journal once the lock is released
+
+  auto cancel_helper = [this, order_id_hash, &orderId, &commit](AssetData &asset_data, auto &orders, const bool is_buy_order)
+  {
+    auto it = orders.find(order_id_hash);
+    if (it != orders.end())
+    {
+      if (_journal != nullptr)
+        commit.set(_journal, _journal->appendCancelOrders(asset_data.security_id, {orderId}));
+
+      if (defer_matching(asset_data) == false)
+        unmatch_order(asset_data, it->second, is_buy_order);
+      on_order_removed(asset_data, it->second, is_buy_order);
+      orders.erase(it);
+      return true;
+    }
+    return false;
+  };
+
+  for (auto &shard : _shards)
+  {
+    const auto lock = write_lock(shard); // write lock (exclusive access)
+
+    for (auto &x : shard.orders_by_security)
+    {
+      auto &asset_data = x.second;
+      const auto old_size = asset_data.matching_size;
+      if (cancel_helper(asset_data, asset_data.buy_orders, true) == true || cancel_helper(asset_data, asset_data.sell_orders, false) == true)
+      {
+        trace.set_security(asset_data.security_id);
+
+        // update matches because an order has been cancelled
+        if (asset_data.dirty == false)
+          update_matches(asset_data);
+        on_security_changed(asset_data, old_size);
+
+        // order has already been found and cancelled, stop
+        return;
+      }
+    }
+  }
+}
+
+template <typename LockPolicy, typename MatchPolicy>
+bool BasicOrderCache<LockPolicy, MatchPolicy>::amendOrderQty(std::string_view orderId, unsigned int newQty)
+{
+  LatencyTimer op_timer(_latency, LatencyMetric::AmendOrderQty);
+  TraceScope trace(_tracer, TraceSpan::AmendOrderQty);
+  _counters.add(StatsCounter::AmendOrderQtyCalls);
+
+  const auto order_id_hash = std::hash<std::string_view>{}(orderId);
+  JournalCommit commit; // waits for the journal once the lock is released
+
+  // like cancelOrder, the order is looked up in every security
+  for (auto &shard : _shards)
+  {
+    const auto lock = write_lock(shard); // write lock (exclusive access)
+
+    for (auto &x : shard.orders_by_security)
+    {
+      auto &asset_data = x.second;
+      for (const auto is_buy_order : {true, false})
+      {
+        auto &orders = is_buy_order ? asset_data.buy_orders : asset_data.sell_orders;
+        auto it = orders.find(order_id_hash);
+        if (it == orders.end())
+          continue;
+
+        trace.set_security(asset_data.security_id);
+        if (newQty == 0)
+        {
+          if (_journal != nullptr)
+            commit.set(_journal, _journal->appendCancelOrders(asset_data.security_id, {orderId}));
+          cancel_orders(asset_data, {orderId});
+        }
+        else if (newQty != it->second.first.qty())
+        {
+          if (_journal != nullptr)
+            commit.set(_journal, _journal->appendAmendOrderQty(asset_data.security_id, orderId, newQty));
+          amend_order_qty(asset_data, it->second, is_buy_order, newQty);
+        }
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+template <typename LockPolicy, typename MatchPolicy>
+size_t BasicOrderCache<LockPolicy, MatchPolicy>::advanceTime(expiry_clock::time_point now)
+{
+  std::vector<std::pair<typename ExpiryWheel::Handle, ExpiryTimer>> due;
+  {
+    std::lock_guard lock(_expiries.mutex);
+    _expiries.wheel.advance(expiry_tick(now), due);
+  }
+  if (due.empty() == true)
+    return 0;
+
+  // grouped by shard and security, to take each lock and re-match each
+  // security once
+  auto shard_index = [](const auto &x)
+  { return x.second.security_id_hash % LockPolicy::shard_count; };
+  std::sort(due.begin(), due.end(), [&shard_index](const auto &a, const auto &b)
+            { return std::make_pair(shard_index(a), a.second.security_id_hash) < std::make_pair(shard_index(b), b.second.security_id_hash); });
+
+  JournalCommit commit; // waits for the journal once the locks are released
+  size_t expired = 0;
+  std::vector<std::string_view> order_ids;
+
+  for (size_t i = 0; i != due.size();)
+  {
+    const auto shard = shard_index(due[i]);
+    const auto lock = write_lock(_shards[shard]); // write lock (exclusive access)
+    auto &orders_by_security = _shards[shard].orders_by_security;
+
+    while (i != due.size() && shard_index(due[i]) == shard)
+    {
+      const auto security_id_hash = due[i].second.security_id_hash;
+      auto asset_it = orders_by_security.find(security_id_hash);
+
+      order_ids.clear();
+      for (; i != due.size() && due[i].second.security_id_hash == security_id_hash; ++i)
+      {
+        if (asset_it == orders_by_security.end())
+          continue;
+
+        // skip orders cancelled since (or re-added with another expiry)
+        for (auto *orders : {&asset_it->second.buy_orders, &asset_it->second.sell_orders})
+        {
+          auto it = orders->find(due[i].second.order_id_hash);
+          if (it != orders->end() && it->second.second.expiry_timer == due[i].first)
+          {
+            it->second.second.expiry_timer = 0; // already out of the wheel
+            order_ids.push_back(it->second.first.orderIdView());
+            break;
+          }
+        }
+      }
+
+      if (order_ids.empty() == true)
+        continue;
+
+      auto &asset_data = asset_it->second;
+      if (_journal != nullptr)
+        commit.set(_journal, _journal->appendCancelOrders(asset_data.security_id, order_ids));
+      cancel_orders(asset_data, order_ids);
+      expired += order_ids.size();
+    }
+  }
+
+  _counters.add(StatsCounter::OrdersExpired, expired);
+  return expired;
+}
+
+template <typename LockPolicy, typename MatchPolicy>
+void BasicOrderCache<LockPolicy, MatchPolicy>::startExpiryThread(std::chrono::milliseconds interval)
+{
+  if constexpr (LockPolicy::thread_safe == false)
+    throw std::logic_error("expiry thread needs a thread safe lock policy");
+
+  _expiry_thread.start(interval, [this]()
+                       { advanceTime(); });
+}
+
+template <typename LockPolicy, typename MatchPolicy>
+void BasicOrderCache<LockPolicy, MatchPolicy>::stopExpiryThread()
+{
+  _expiry_thread.stop();
+}
+
+template <typename LockPolicy, typename MatchPolicy>
+void BasicOrderCache<LockPolicy, MatchPolicy>::setMatchingMode(MatchingMode mode)
+{
+  // write lock (exclusive access) on every shard, so that no operation
+  // is running while the mode changes
+  std::array<std::unique_lock<mutex_type>, LockPolicy::shard_count> locks;
+  for (size_t i = 0; i != _shards.size(); ++i)
+    locks[i] = write_lock(_shards[i]);
+
+  _matching_mode = mode;
+  if (mode == MatchingMode::Eager)
+    for (auto &shard : _shards)
+      refresh_shard(shard);
+}
+
+template <typename LockPolicy, typename MatchPolicy>
+size_t BasicOrderCache<LockPolicy, MatchPolicy>::refreshMatches()
+{
+  size_t refreshed = 0;
+  for (auto &shard : _shards)
+  {
+    const auto lock = write_lock(shard); // write lock (exclusive access)
+    refreshed += refresh_shard(shard);
+  }
+  return refreshed;
+}
+
+template <typename LockPolicy, typename MatchPolicy>
+void BasicOrderCache<LockPolicy, MatchPolicy>::startRefreshThread(std::chrono::milliseconds interval)
+{
+  if constexpr (LockPolicy::thread_safe == false)
+    throw std::logic_error("refresh thread needs a thread safe lock policy");
+
+  _refresh_thread.start(interval, [this]()
+                        { refreshMatches(); });
+}
+
+template <typename LockPolicy, typename MatchPolicy>
+void BasicOrderCache<LockPolicy, MatchPolicy>::stopRefreshThread()
+{
+  _refresh_thread.stop();
+}
+
+template <typename LockPolicy, typename MatchPolicy>
+void BasicOrderCache<LockPolicy, MatchPolicy>::cancelOrdersForUser(std::string_view user)
+{
+  LatencyTimer op_timer(_latency, LatencyMetric::CancelOrdersForUser);
+  TraceScope trace(_tracer, TraceSpan::CancelOrdersForUser);
+  _counters.add(StatsCounter::CancelOrdersForUserCalls);
+
+  const auto user_hash = std::hash<std::string_view>{}(user);
+
+  // locks each shard in turn
+  cancelOrdersHelper([user_hash](const auto &order)
+                     { return order.userHash() == user_hash; });
+}
+
+template <typename LockPolicy, typename MatchPolicy>
+void BasicOrderCache<LockPolicy, MatchPolicy>::cancelOrdersForSecIdWithMinimumQty(std::string_view securityId, unsigned int minQty)
+{
+  LatencyTimer op_timer(_latency, LatencyMetric::CancelOrdersForSecIdWithMinimumQty);
+  JournalCommit commit; // waits for the journal once the lock is released
+  const auto security_id_hash = std::hash<std::string_view>{}(securityId);
+  auto &shard = shard_for(security_id_hash);
+  const auto lock = write_lock(shard); // write lock (exclusive access)
+
+  TraceScope trace(_tracer, TraceSpan::CancelOrdersForSecIdWithMinimumQty, securityId);
+  _counters.add(StatsCounter::CancelOrdersForSecIdCalls);
+
+  auto it = shard.orders_by_security.find(security_id_hash);
+  if (it == shard.orders_by_security.end())
+    return;
+
+  cancelSecurityOrdersHelper(
+      it->second, [minQty](const auto &order)
+      { return order.qty() >= minQty; },
+      commit);
+}
+
+template <typename LockPolicy, typename MatchPolicy>
+unsigned int BasicOrderCache<LockPolicy, MatchPolicy>::getMatchingSizeForSecurity(std::string_view securityId)
+{
+  LatencyTimer op_timer(_latency, LatencyMetric::GetMatchingSizeForSecurity);
+  const auto security_id_hash = std::hash<std::string_view>{}(securityId);
+  auto &shard = shard_for(security_id_hash);
+
+  _counters.add(StatsCounter::GetMatchingSizeCalls);
+  {
+    const auto lock = read_lock(shard); // read lock (shared access)
+    auto it = shard.orders_by_security.find(security_id_hash);
+    if (it == shard.orders_by_security.end())
+      return 0;
+    if (it->second.dirty == false)
+      return it->second.matching_size;
+  }
+
+  // lazy mode: re-matched first
+  return refresh_security(security_id_hash);
+}
+
+template <typename LockPolicy, typename MatchPolicy>
+std::vector<Order> BasicOrderCache<LockPolicy, MatchPolicy>::getAllOrders() const
+{
+  LatencyTimer op_timer(_latency, LatencyMetric::GetAllOrders);
+
+  // read lock (shared access) on every shard, always taken in the same
+  // order, for a consistent copy of the cache
+  std::array<std::shared_lock<mutex_type>, LockPolicy::shard_count> locks;
+  for (size_t i = 0; i != _shards.size(); ++i)
+    locks[i] = read_lock(_shards[i]);
+
+  _counters.add(StatsCounter::GetAllOrdersCalls);
+
+  auto copy_orders = [](const auto &src, auto &dst)
+  {
+    std::transform(src.begin(), src.end(), std::back_inserter(dst), [](const auto &x)
+                   { return x.second.first; });
+  };
+
+  std::vector<Order> orders;
+  for (const auto &shard : _shards)
+  {
+    for (const auto &x : shard.orders_by_security)
+    {
+      copy_orders(x.second.buy_orders, orders);
+      copy_orders(x.second.sell_orders, orders);
+    }
+  }
+  return orders;
+}
+
+template <typename LockPolicy, typename MatchPolicy>
+std::vector<std::pair<std::string, unsigned int>> BasicOrderCache<LockPolicy, MatchPolicy>::getTopMatchingSecurities(size_t n)
+{
+  // lazy mode: dirty securities are ranked by their matching size from
+  // before they got dirty, so they are re-matched first
+  if (_matching_mode.load(std::memory_order_relaxed) == MatchingMode::Lazy)
+    refreshMatches();
+
+  const std::shared_lock lock(_ranking.mutex); // read lock (shared access)
+
+  std::vector<std::pair<std::string, unsigned int>> securities;
+  securities.reserve(std::min(n, _ranking.securities.size()));
+  for (auto it = _ranking.securities.begin(); it != _ranking.securities.end() && securities.size() != n; ++it)
+    securities.emplace_back(it->security_id, it->matching_size);
+  return securities;
+}
+
+template <typename LockPolicy, typename MatchPolicy>
+SecurityAggregates BasicOrderCache<LockPolicy, MatchPolicy>::getSecurityAggregates(std::string_view securityId)
+{
+  const auto security_id_hash = std::hash<std::string_view>{}(securityId);
+  auto &shard = shard_for(security_id_hash);
+  auto lock = read_lock(shard); // read lock (shared access)
+
+  SecurityAggregates aggregates;
+  auto it = shard.orders_by_security.find(security_id_hash);
+  while (it != shard.orders_by_security.end() && it->second.dirty == true)
+  {
+    // lazy mode: re-matched first
+    lock.unlock();
+    refresh_security(security_id_hash);
+    lock.lock();
+    it = shard.orders_by_security.find(security_id_hash);
+  }
+
+  if (it != shard.orders_by_security.end())
+  {
+    const auto &asset_data = it->second;
+    aggregates.buy_orders = asset_data.buy_orders.size();
+    aggregates.sell_orders = asset_data.sell_orders.size();
+    aggregates.buy_qty = asset_data.buy_qty;
+    aggregates.sell_qty = asset_data.sell_qty;
+    aggregates.buy_unmatched_qty = asset_data.buy_qty - asset_data.matching_size;
+    aggregates.sell_unmatched_qty = asset_data.sell_qty - asset_data.matching_size;
+    aggregates.matching_size = asset_data.matching_size;
+  }
+  return aggregates;
+}
+
+template <typename LockPolicy, typename MatchPolicy>
+OwnerAggregates BasicOrderCache<LockPolicy, MatchPolicy>::getUserAggregates(std::string_view user) const
+{
+  const std::shared_lock lock(_owners.mutex); // read lock (shared access)
+  auto it = _owners.users.find(std::hash<std::string_view>{}(user));
+  return it != _owners.users.end() ? it->second : OwnerAggregates{};
+}
+
+template <typename LockPolicy, typename MatchPolicy>
+OwnerAggregates BasicOrderCache<LockPolicy, MatchPolicy>::getCompanyAggregates(std::string_view company) const
+{
+  const std::shared_lock lock(_owners.mutex); // read lock (shared access)
+  auto it = _owners.companies.find(std::hash<std::string_view>{}(company));
+  return it != _owners.companies.end() ? it->second : OwnerAggregates{};
+}
+
+template <typename LockPolicy, typename MatchPolicy>
+LatencyStats BasicOrderCache<LockPolicy, MatchPolicy>::getLatencyStats() const
+{
+  return _latency.snapshot();
+}
+
+template <typename LockPolicy, typename MatchPolicy>
+OrderCacheStats BasicOrderCache<LockPolicy, MatchPolicy>::stats() const
+{
+  OrderCacheStats stats;
+  for (size_t i = 0; i != stats.counters.size(); ++i)
+    stats.counters[i] = _counters.get(static_cast<StatsCounter>(i));
+  stats.latency = _latency.snapshot();
+  return stats;
+}
+
+template <typename LockPolicy, typename MatchPolicy>
+void BasicOrderCache<LockPolicy, MatchPolicy>::setTracer(Tracer *tracer)
+{
+  // write lock (exclusive access) on every shard, so that no operation
+  // is running while the tracer changes
+  std::array<std::unique_lock<mutex_type>, LockPolicy::shard_count> locks;
+  for (size_t i = 0; i != _shards.size(); ++i)
+    locks[i] = write_lock(_shards[i]);
+
+  _tracer = tracer;
+}
+
+template <typename LockPolicy, typename MatchPolicy>
+void BasicOrderCache<LockPolicy, MatchPolicy>::setNotifier(MatchingSizeNotifier *notifier)
+{
+  // write lock (exclusive access) on every shard, so that no operation
+  // is running while the notifier changes
+  std::array<std::unique_lock<mutex_type>, LockPolicy::shard_count> locks;
+  for (size_t i = 0; i != _shards.size(); ++i)
+    locks[i] = write_lock(_shards[i]);
+
+  _notifier = notifier;
+}
+
+template <typename LockPolicy, typename MatchPolicy>
+void BasicOrderCache<LockPolicy, MatchPolicy>::setSharedSegment(SharedSegmentWriter *segment)
+{
+  // write lock (exclusive access) on every shard, so that no operation
+  // is running while the segment changes
+  std::array<std::unique_lock<mutex_type>, LockPolicy::shard_count> locks;
+  for (size_t i = 0; i != _shards.size(); ++i)
+    locks[i] = write_lock(_shards[i]);
+
+  _shared_segment = segment;
+  for (auto &shard : _shards)
+    for (auto &x : shard.orders_by_security)
+    {
+      x.second.shared_slot = SharedSegmentWriter::no_slot;
+      if (_shared_segment != nullptr)
+        publish_shared(x.second);
+    }
+}
+
+template <typename LockPolicy, typename MatchPolicy>
+void BasicOrderCache<LockPolicy, MatchPolicy>::setChangeFeed(ChangeFeed *feed)
+{
+  // write lock (exclusive access) on every shard, so that consumers resync
+  // from a state that the first change applies to
+  std::array<std::unique_lock<mutex_type>, LockPolicy::shard_count> locks;
+  for (size_t i = 0; i != _shards.size(); ++i)
+    locks[i] = write_lock(_shards[i]);
+
+  _change_feed = feed;
+  if (_change_feed != nullptr)
+    _change_feed->reset();
+}
+
+template <typename LockPolicy, typename MatchPolicy>
+OrderChanges BasicOrderCache<LockPolicy, MatchPolicy>::getOrderStates() const
+{
+  // read lock (shared access) on every shard: changes are appended to the
+  // feed under the write lock of their security's shard
+  std::array<std::shared_lock<mutex_type>, LockPolicy::shard_count> locks;
+  for (size_t i = 0; i != _shards.size(); ++i)
+    locks[i] = read_lock(_shards[i]);
+
+  OrderChanges states;
+  states.version = _change_feed != nullptr ? _change_feed->version() : 0;
+  for (const auto &shard : _shards)
+    for (const auto &x : shard.orders_by_security)
+      for (const auto *orders : {&x.second.buy_orders, &x.second.sell_orders})
+        for (const auto &order_elem : *orders)
+        {
+          const auto &order = order_elem.second.first;
+          states.changes.push_back({states.version, OrderChangeType::Added, std::string(order.orderIdView()), std::string(order.securityIdView()),
+                                    std::string(order.sideView()), order.qty(), std::string(order.userView()), std::string(order.companyView()),
+                                    order_elem.second.second.unmatched});
+        }
+  return states;
+}
+
+template <typename LockPolicy, typename MatchPolicy>
+MemoryUsage BasicOrderCache<LockPolicy, MatchPolicy>::memoryUsage() const
+{
+  // read lock (shared access) on every shard: the containers of a security
+  // only allocate with its shard's write lock
+  std::array<std::shared_lock<mutex_type>, LockPolicy::shard_count> locks;
+  for (size_t i = 0; i != _shards.size(); ++i)
+    locks[i] = read_lock(_shards[i]);
+
+  MemoryUsage usage;
+  auto &totals = usage.totals;
+  for (const auto &shard : _shards)
+  {
+    // nodes (key, AssetData and next pointer) and buckets
+    const auto &securities = shard.orders_by_security;
+    usage.security_maps += securities.size() * (sizeof(typename std::unordered_map<size_t, AssetData>::value_type) + sizeof(void *)) +
+                           securities.bucket_count() * sizeof(void *) + shard.dirty.capacity() * sizeof(AssetData *);
+
+    for (const auto &x : securities)
+    {
+      const auto &asset_data = x.second;
+      SecurityMemoryUsage security;
+      security.security_id = asset_data.security_id;
+      security.orders = asset_data.buy_orders.size() + asset_data.sell_orders.size();
+      security.match_edges = asset_data.matches.size();
+      security.order_maps = asset_data.order_maps_memory.bytes();
+      security.order_matches = asset_data.order_matches_memory.bytes();
+      security.matches = asset_data.matches_memory.bytes();
+      security.strings = Order::heap_bytes(asset_data.security_id);
+      for (const auto *orders : {&asset_data.buy_orders, &asset_data.sell_orders})
+        for (const auto &order_elem : *orders)
+          security.strings += order_elem.second.first.stringHeapBytes();
+
+      totals.orders += security.orders;
+      totals.match_edges += security.match_edges;
+      totals.order_maps += security.order_maps;
+      totals.strings += security.strings;
+      totals.order_matches += security.order_matches;
+      totals.matches += security.matches;
+      usage.securities.push_back(std::move(security));
+    }
+  }
+
+  // shared resources, with atomic counters
+  usage.ranking = _ranking_memory.bytes();
+  usage.owners = _owners_memory.bytes();
+  usage.pool_reserved = _pool_memory.bytes();
+
+  std::sort(usage.securities.begin(), usage.securities.end(), [](const auto &a, const auto &b)
+            { return a.total() != b.total() ? a.total() > b.total() : a.security_id < b.security_id; });
+  return usage;
+}
+
+template <typename LockPolicy, typename MatchPolicy>
+void BasicOrderCache<LockPolicy, MatchPolicy>::saveSnapshot(const std::string &path)
+{
+  // read lock (shared access) on every shard, always taken in the same
+  // order, for a consistent snapshot
+  std::array<std::shared_lock<mutex_type>, LockPolicy::shard_count> locks;
+  while (true)
+  {
+    for (size_t i = 0; i != _shards.size(); ++i)
+      locks[i] = read_lock(_shards[i]);
+
+    // lazy mode: the stale matches of dirty securities are re-matched first
+    if (std::all_of(_shards.begin(), _shards.end(), [](const auto &shard)
+                    { return shard.dirty.empty(); }))
+      break;
+
+    for (auto &lock : locks)
+      lock.unlock();
+    refreshMatches();
+  }
+
+  // intern strings while encoding the orders, as strings have to be
+  // written first
+  std::unordered_map<std::string_view, uint32_t> string_ids;
+  std::vector<std::string_view> strings;
+  auto intern = [&](std::string_view str)
+  {
+    const auto [it, inserted] = string_ids.try_emplace(str, static_cast<uint32_t>(strings.size()));
+    if (inserted == true)
+      strings.push_back(str);
+    return it->second;
+  };
+
+  SnapshotHeader header{};
+  // records are journaled under the shard locks: all of them up to this
+  // one are in the snapshot, and none after it
+  header.journal_lsn = _journal != nullptr ? _journal->lastLsn() : 0;
+
+  std::vector<uint32_t> records;
+  std::unordered_map<size_t, uint32_t> order_indexes[2]; // by order id hash, for buy/sell orders
+
+  for (const auto &shard : _shards)
+  {
+    for (const auto &x : shard.orders_by_security)
+    {
+      const auto &asset_data = x.second;
+
+      records.insert(records.end(), {intern(asset_data.security_id),
+                                     static_cast<uint32_t>(asset_data.buy_orders.size()),
+                                     static_cast<uint32_t>(asset_data.sell_orders.size()),
+                                     static_cast<uint32_t>(asset_data.matches.size()),
+                                     asset_data.matching_size});
+
+      auto encode_orders = [&](const auto &orders, auto &indexes)
+      {
+        indexes.clear();
+        for (const auto &order_elem : orders)
+        {
+          const auto &order = order_elem.second.first;
+          indexes.emplace(order.orderIdHash(), static_cast<uint32_t>(indexes.size()));
+          records.insert(records.end(), {intern(order.orderIdView()),
+                                         intern(order.sideView()),
+                                         intern(order.userView()),
+                                         intern(order.companyView()),
+                                         order.qty(),
+                                         order_elem.second.second.unmatched});
+        }
+      };
+      encode_orders(asset_data.buy_orders, order_indexes[0]);
+      encode_orders(asset_data.sell_orders, order_indexes[1]);
+
+      // NOTE: matches are keyed by (sell order, buy order)
+      for (const auto &match : asset_data.matches)
+        records.insert(records.end(), {order_indexes[0].at(match.first.second), order_indexes[1].at(match.first.first), match.second});
+
+      ++header.security_count;
+      header.order_count += asset_data.buy_orders.size() + asset_data.sell_orders.size();
+      header.edge_count += asset_data.matches.size();
+    }
+  }
+
+  SnapshotWriter writer(path);
+  for (const auto &str : strings)
+    writer.write_string(str);
+  for (const auto record : records)
+    writer.write_u32(record);
+
+  header.string_count = strings.size();
+  writer.commit(header);
+}
+
+template <typename LockPolicy, typename MatchPolicy>
+uint64_t BasicOrderCache<LockPolicy, MatchPolicy>::loadSnapshot(const std::string &path)
+{
+  SnapshotReader reader(path);
+  const auto &header = reader.header();
+
+  // strings are hashed once here, instead of once per order using them
+  std::vector<HashedStringView> strings;
+  strings.reserve(header.string_count);
+  for (uint64_t i = 0; i != header.string_count; ++i)
+    strings.emplace_back(reader.read_string());
+
+  auto string_at = [&strings](uint32_t index) -> const HashedStringView &
+  {
+    if (index >= strings.size())
+      SnapshotReader::fail("string index out of range");
+    return strings[index];
+  };
+
+  // build the new state aside, so that the cache is unchanged on errors
+  std::array<std::unordered_map<size_t, AssetData>, LockPolicy::shard_count> orders_by_security;
+  for (auto &x : orders_by_security)
+    x.reserve(header.security_count / LockPolicy::shard_count + 1);
+
+  uint64_t buy_order_count = 0, sell_order_count = 0;
+  std::vector<size_t> order_ids[2]; // by index, for buy/sell orders
+  typename Owners::Map users(&_owners_memory), companies(&_owners_memory);
+
+  for (uint64_t s = 0; s != header.security_count; ++s)
+  {
+    const auto &security_id = string_at(reader.read_u32());
+    const uint32_t counts[2] = {reader.read_u32(), reader.read_u32()};
+    const auto edge_count = reader.read_u32();
+    const auto matching_size = reader.read_u32();
+
+    auto [asset_it, inserted] = orders_by_security[security_id.hash % LockPolicy::shard_count].try_emplace(security_id.hash, &_pool);
+    if (inserted == false)
+      SnapshotReader::fail("duplicate security");
+
+    auto &asset_data = asset_it->second;
+    asset_data.security_id = security_id.value;
+    asset_data.security_id_hash = security_id.hash;
+    asset_data.matching_size = matching_size;
+
+    for (auto side = 0; side != 2; ++side)
+    {
+      auto &orders = side == 0 ? asset_data.buy_orders : asset_data.sell_orders;
+      orders.reserve(counts[side]);
+      order_ids[side].clear();
+
+      for (uint32_t i = 0; i != counts[side]; ++i)
+      {
+        const auto &order_id = string_at(reader.read_u32());
+        const auto &order_side = string_at(reader.read_u32());
+        const auto &user = string_at(reader.read_u32());
+        const auto &company = string_at(reader.read_u32());
+        const auto qty = reader.read_u32();
+        const auto unmatched = reader.read_u32();
+        if (unmatched > qty)
+          SnapshotReader::fail("unmatched qty greater than order qty");
+
+        OrderInfo order_info(qty, &asset_data.order_matches_memory);
+        order_info.unmatched = unmatched;
+
+        const auto [it, order_inserted] = orders.try_emplace(order_id.hash, Order{order_id, security_id, order_side.value, qty, user, company}, std::move(order_info));
+        if (order_inserted == false)
+          SnapshotReader::fail("duplicate order");
+        order_ids[side].push_back(order_id.hash);
+
+        (side == 0 ? asset_data.buy_qty : asset_data.sell_qty) += qty;
+        update_owners(users, companies, it->second.first, side == 0, true);
+      }
+    }
+
+    asset_data.matches.reserve(edge_count);
+    uint64_t matched = 0;
+
+    for (uint32_t i = 0; i != edge_count; ++i)
+    {
+      const auto buy_index = reader.read_u32();
+      const auto sell_index = reader.read_u32();
+      const auto qty = reader.read_u32();
+      if (buy_index >= order_ids[0].size() || sell_index >= order_ids[1].size())
+        SnapshotReader::fail("match order index out of range");
+
+      const auto buy_order_id = order_ids[0][buy_index];
+      const auto sell_order_id = order_ids[1][sell_index];
+
+      asset_data.matches.insert({get_matched_order_pair(buy_order_id, sell_order_id, true), qty});
+      asset_data.buy_orders.find(buy_order_id)->second.second.order_matches.insert(sell_order_id);
+      asset_data.sell_orders.find(sell_order_id)->second.second.order_matches.insert(buy_order_id);
+      matched += qty;
+    }
+
+    if (matched != matching_size)
+      SnapshotReader::fail("matches don't add up to the matching size");
+
+    buy_order_count += counts[0];
+    sell_order_count += counts[1];
+  }
+
+  if (reader.at_end() == false)
+    SnapshotReader::fail("trailing data");
+
+  // write lock (exclusive access) on every shard to swap the new state in
+  std::array<std::unique_lock<mutex_type>, LockPolicy::shard_count> locks;
+  for (size_t i = 0; i != _shards.size(); ++i)
+    locks[i] = write_lock(_shards[i]);
+
+  for (size_t i = 0; i != _shards.size(); ++i)
+  {
+    _shards[i].orders_by_security.swap(orders_by_security[i]);
+    _shards[i].dirty.clear(); // loaded matches are up to date
+  }
+
+  {
+    std::lock_guard owners_lock(_owners.mutex);
+    _owners.users.swap(users);
+    _owners.companies.swap(companies);
+  }
+
+  // the changes before the snapshot don't apply to it anymore
+  if (_change_feed != nullptr)
+    _change_feed->reset();
+
+  // loaded orders have no expiry
+  {
+    std::lock_guard expiries_lock(_expiries.mutex);
+    _expiries.wheel = ExpiryWheel(_expiries.wheel.now());
+  }
+
+  // rank the loaded securities, before the old ones go away
+  {
+    std::lock_guard ranking_lock(_ranking.mutex);
+    _ranking.securities.clear();
+    for (const auto &shard : _shards)
+      for (const auto &x : shard.orders_by_security)
+        if (x.second.matching_size != 0)
+          _ranking.securities.insert({x.second.matching_size, x.second.security_id});
+  }
+
+  // publish the loaded securities, and the old ones as empty
+  if (_shared_segment != nullptr)
+  {
+    for (auto &old_orders_by_security : orders_by_security)
+      for (auto &x : old_orders_by_security)
+        if (x.second.shared_slot != SharedSegmentWriter::no_slot && x.second.shared_slot != AssetData::shared_overflow)
+          _shared_segment->publish(x.second.shared_slot, {});
+
+    for (auto &shard : _shards)
+      for (auto &x : shard.orders_by_security)
+        publish_shared(x.second);
+  }
+
+  _counters.set(StatsCounter::BuyOrders, buy_order_count);
+  _counters.set(StatsCounter::SellOrders, sell_order_count);
+  _counters.set(StatsCounter::Securities, header.security_count);
+
+  return header.journal_lsn;
+}
+
+template <typename LockPolicy, typename MatchPolicy>
+void BasicOrderCache<LockPolicy, MatchPolicy>::setJournal(Journal *journal)
+{
+  // write lock (exclusive access) on every shard, so that no operation
+  // is running while the journal changes
+  std::array<std::unique_lock<mutex_type>, LockPolicy::shard_count> locks;
+  for (size_t i = 0; i != _shards.size(); ++i)
+    locks[i] = write_lock(_shards[i]);
+
+  _journal = journal;
+}
+
+template <typename LockPolicy, typename MatchPolicy>
+JournalReplayStats BasicOrderCache<LockPolicy, MatchPolicy>::replayJournal(const std::string &path, uint64_t after_lsn, unsigned int threads)
+{
+  JournalReader reader(path);
+
+  std::vector<JournalRecord> records;
+  for (JournalRecord record; reader.next(record) == true;)
+    if (record.lsn > after_lsn)
+      records.push_back(std::move(record));
+
+  JournalReplayStats result;
+  result.records = records.size();
+  result.last_lsn = reader.last_lsn();
+  result.torn_tail = reader.torn_tail();
+
+  // write lock (exclusive access) on every shard for the whole replay
+  std::array<std::unique_lock<mutex_type>, LockPolicy::shard_count> locks;
+  for (size_t i = 0; i != _shards.size(); ++i)
+    locks[i] = write_lock(_shards[i]);
+
+  // securities are created up front, so that replay threads only modify
+  // the data of their own securities
+  std::vector<AssetData *> asset_data(records.size());
+  std::vector<size_t> security_hashes(records.size());
+  for (size_t i = 0; i != records.size(); ++i)
+  {
+    const HashedStringView security_id(records[i].security_id);
+    security_hashes[i] = security_id.hash;
+    asset_data[i] = &security_data(shard_for(security_id.hash), security_id);
+    if (_matching_mode.load(std::memory_order_relaxed) == MatchingMode::Lazy)
+      queue_dirty(*asset_data[i]);
+  }
+
+  // counters of single threaded caches aren't safe to update concurrently
+  if (LockPolicy::thread_safe == false || records.size() < 2)
+    threads = 1;
+  threads = std::max(threads, 1u);
+
+  auto replay = [&](unsigned int part)
+  {
+    for (size_t i = 0; i != records.size(); ++i)
+    {
+      if (security_hashes[i] % threads != part)
+        continue;
+
+      const auto &record = records[i];
+      if (record.type == JournalRecordType::AddOrder)
+        add_order(*asset_data[i], Order{record.order_id, {record.security_id, security_hashes[i]}, record.side, record.qty, record.user, record.company});
+      else if (record.type == JournalRecordType::AmendOrderQty)
+        amend_order_qty(*asset_data[i], record.order_id, record.qty);
+      else
+        cancel_orders(*asset_data[i], record.order_ids);
+    }
+  };
+
+  std::vector<std::exception_ptr> errors(threads);
+  auto run = [&replay, &errors](unsigned int part)
+  {
+    try
+    {
+      replay(part);
+    }
+    catch (...)
+    {
+      errors[part] = std::current_exception();
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for (auto t = 1u; t < threads; ++t)
+    workers.emplace_back(run, t);
+  run(0);
+  for (auto &worker : workers)
+    worker.join();
+
+  for (const auto &error : errors)
+    if (error)
+      std::rethrow_exception(error);
+
+  return result;
+}
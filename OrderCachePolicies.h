@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstddef>
+#include <shared_mutex>
+
+// Locking policies for BasicOrderCache.
+//
+// A policy provides:
+//   - mutex_type: shared mutex (lock/unlock + lock_shared/unlock_shared)
+//   - shard_count: number of independently locked partitions of the
+//     securities (a security always lives in shard hash % shard_count)
+//   - thread_safe: whether the cache may be used from several threads at
+//     once (otherwise counters don't need atomic read-modify-writes)
+
+// no-op mutex: every lock compiles out
+struct NullMutex
+{
+  void lock() noexcept {}
+  bool try_lock() noexcept { return true; }
+  void unlock() noexcept {}
+  void lock_shared() noexcept {}
+  bool try_lock_shared() noexcept { return true; }
+  void unlock_shared() noexcept {}
+};
+
+// single-threaded use (eg driven from one pinned thread): no synchronization
+struct NullLockPolicy
+{
+  using mutex_type = NullMutex;
+  static constexpr size_t shard_count = 1;
+  static constexpr bool thread_safe = false;
+};
+
+// one reader/writer lock for the whole cache (default)
+struct SharedMutexLockPolicy
+{
+  using mutex_type = std::shared_mutex;
+  static constexpr size_t shard_count = 1;
+  static constexpr bool thread_safe = true;
+};
+
+// one reader/writer lock per shard of securities: writers to different
+// shards don't contend. Operations spanning several securities (cancelOrder,
+// cancelOrdersForUser) visit the shards one at a time, and getAllOrders
+// holds all of them (in order) for a consistent copy.
+template <size_t N = 16>
+struct ShardedLockPolicy
+{
+  static_assert(N > 0);
+
+  using mutex_type = std::shared_mutex;
+  static constexpr size_t shard_count = N;
+  static constexpr bool thread_safe = true;
+};
+
+// Matching rules for BasicOrderCache.
+//
+// A rule is a stateless predicate object deciding whether a new/re-matched
+// order can match `match_qty` against an order on the other side (whose
+// remaining qty is non-zero). It is a template parameter so match_order
+// inlines the check, at no more cost than a hard-coded comparison.
+
+// orders from the same company can't match (default)
+struct DifferentCompanyMatchPolicy
+{
+  template <typename OrderT>
+  constexpr bool operator()(const OrderT &order, const OrderT &other_side_order, unsigned int) const
+  {
+    return order.companyHash() != other_side_order.companyHash();
+  }
+};
+
+// user-level self-match prevention: only orders from the same user can't
+// match (different users of the same company can)
+struct DifferentUserMatchPolicy
+{
+  template <typename OrderT>
+  constexpr bool operator()(const OrderT &order, const OrderT &other_side_order, unsigned int) const
+  {
+    return order.userHash() != other_side_order.userHash();
+  }
+};
+
+// any buy order can match any sell order
+struct NoRestrictionMatchPolicy
+{
+  template <typename OrderT>
+  constexpr bool operator()(const OrderT &, const OrderT &, unsigned int) const
+  {
+    return true;
+  }
+};
+
+// only match when at least MinQty can be filled, on top of another rule
+template <unsigned int MinQty, typename BasePolicy = DifferentCompanyMatchPolicy>
+struct MinimumFillSizeMatchPolicy
+{
+  template <typename OrderT>
+  constexpr bool operator()(const OrderT &order, const OrderT &other_side_order, unsigned int match_qty) const
+  {
+    return match_qty >= MinQty && BasePolicy{}(order, other_side_order, match_qty);
+  }
+};
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+#include "LatencyHistogram.h"
+
+// Operational counters/gauges maintained by OrderCache
+enum class StatsCounter : size_t
+{
+  OrdersAdded,
+  OrdersCancelled,
+  OrdersExpired,
+  CancelOrderCalls,
+  AmendOrderQtyCalls,
+  CancelOrdersForUserCalls,
+  CancelOrdersForSecIdCalls,
+  GetMatchingSizeCalls,
+  GetAllOrdersCalls,
+  MatchOrderCalls,
+  MatchOrdersVisited,
+  MatchEdgesCreated,
+  MatchEdgesRemoved,
+  UpdateMatchesCalls,
+  MatchingDeferred,
+  MatchRefreshes,
+  BuyOrders,
+  SellOrders,
+  Securities,
+  Count
+};
+
+enum class StatsCounterType
+{
+  Counter, // monotonically increasing
+  Gauge    // current value, may go up and down
+};
+
+struct StatsCounterInfo
+{
+  const char *name;
+  StatsCounterType type;
+  const char *help;
+};
+
+inline const StatsCounterInfo &stats_counter_info(StatsCounter counter)
+{
+  static constexpr StatsCounterInfo info[] = {
+      {"orders_added_total", StatsCounterType::Counter, "Orders added to the cache"},
+      {"orders_cancelled_total", StatsCounterType::Counter, "Orders removed from the cache by any cancel operation"},
+      {"orders_expired_total", StatsCounterType::Counter, "Orders cancelled because their expiry time passed"},
+      {"cancel_order_calls_total", StatsCounterType::Counter, "Calls to cancelOrder"},
+      {"amend_order_qty_calls_total", StatsCounterType::Counter, "Calls to amendOrderQty"},
+      {"cancel_orders_for_user_calls_total", StatsCounterType::Counter, "Calls to cancelOrdersForUser"},
+      {"cancel_orders_for_sec_id_calls_total", StatsCounterType::Counter, "Calls to cancelOrdersForSecIdWithMinimumQty"},
+      {"get_matching_size_calls_total", StatsCounterType::Counter, "Calls to getMatchingSizeForSecurity"},
+      {"get_all_orders_calls_total", StatsCounterType::Counter, "Calls to getAllOrders"},
+      {"match_order_calls_total", StatsCounterType::Counter, "Calls to match_order (including re-matches)"},
+      {"match_orders_visited_total", StatsCounterType::Counter, "Other side orders visited by match_order"},
+      {"match_edges_created_total", StatsCounterType::Counter, "Matches created between a buy and a sell order"},
+      {"match_edges_removed_total", StatsCounterType::Counter, "Matches reverted by unmatch_order"},
+      {"update_matches_calls_total", StatsCounterType::Counter, "Calls to update_matches after cancellations"},
+      {"matching_deferred_total", StatsCounterType::Counter, "Adds, cancels and amends whose matching was deferred by lazy matching mode"},
+      {"match_refreshes_total", StatsCounterType::Counter, "Securities re-matched from scratch after lazy matching mode deferred their matching"},
+      {"buy_orders", StatsCounterType::Gauge, "Buy orders currently in the cache"},
+      {"sell_orders", StatsCounterType::Gauge, "Sell orders currently in the cache"},
+      {"securities", StatsCounterType::Gauge, "Securities known to the cache"},
+  };
+  static_assert(sizeof(info) / sizeof(info[0]) == static_cast<size_t>(StatsCounter::Count));
+  return info[static_cast<size_t>(counter)];
+}
+
+// Relaxed atomic counters: they are only ever read as a statistical
+// snapshot, so no ordering with the cache data is required.
+//
+// With a single writer thread (ThreadSafe == false) updates are plain
+// relaxed load/store pairs instead of locked read-modify-writes, which
+// still lets another thread take a snapshot safely.
+template <bool ThreadSafe = true>
+class StatsCounters
+{
+public:
+  void add(StatsCounter counter, uint64_t n = 1) noexcept
+  {
+    auto &value = _values[static_cast<size_t>(counter)];
+    if constexpr (ThreadSafe)
+      value.fetch_add(n, std::memory_order_relaxed);
+    else
+      value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+  }
+
+  void sub(StatsCounter counter, uint64_t n = 1) noexcept { add(counter, uint64_t{0} - n); }
+
+  // reset a gauge when the whole state is replaced (eg snapshot loading)
+  void set(StatsCounter counter, uint64_t value) noexcept { _values[static_cast<size_t>(counter)].store(value, std::memory_order_relaxed); }
+
+  uint64_t get(StatsCounter counter) const noexcept { return _values[static_cast<size_t>(counter)].load(std::memory_order_relaxed); }
+
+private:
+  std::array<std::atomic<uint64_t>, static_cast<size_t>(StatsCounter::Count)> _values{};
+};
+
+// Point-in-time copy of the counters and latency histograms of a cache
+struct OrderCacheStats
+{
+  std::array<uint64_t, static_cast<size_t>(StatsCounter::Count)> counters{};
+  LatencyStats latency;
+
+  uint64_t operator[](StatsCounter counter) const { return counters[static_cast<size_t>(counter)]; }
+
+  // average number of other side orders visited per match_order call
+  double ordersVisitedPerMatch() const
+  {
+    const auto calls = (*this)[StatsCounter::MatchOrderCalls];
+    return calls != 0 ? static_cast<double>((*this)[StatsCounter::MatchOrdersVisited]) / calls : 0.0;
+  }
+};
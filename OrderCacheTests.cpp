@@ -1,5 +1,26 @@
-#include "OrderCache.h"
+#include "AdaptiveHashMap.h"
+#include "AsyncOrderCache.h"
+#include "ChangeFeed.h"
+#include "Gateway.h"
+#include "OrderCacheImpl.h"
+#include "OrderFile.h"
+#include "PartitionedOrderCache.h"
+#include "ReadReplica.h"
+#include "SharedSegment.h"
+#include "StatsExporter.h"
+#include "TimerWheel.h"
 #include "gtest/gtest.h"
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
 
 class OrderCacheTest : public ::testing::Test
 {
@@ -320,6 +341,1803 @@ TEST_F(OrderCacheTest, XX_UnitTest_getMatchingSizeForSecurityTest_Example1)
     ASSERT_EQ(matchingSize, 2700);
 }
 
+// Test H1: Latency histogram buckets bound the relative error of recorded values
+TEST(LatencyHistogramTest, H1_LatencyHistogramTest_BucketsAndPercentiles)
+{
+    for (uint64_t value : {0ull, 1ull, 31ull, 32ull, 33ull, 1000ull, 123456789ull, ~0ull})
+    {
+        const auto index = LatencyHistogram::bucket_index(value);
+        ASSERT_LT(index, LatencyHistogram::bucket_count);
+        ASSERT_LE(LatencyHistogram::bucket_lower_bound(index), value);
+        ASSERT_GE(LatencyHistogram::bucket_upper_bound(index), value);
+        ASSERT_LE(LatencyHistogram::bucket_upper_bound(index) - LatencyHistogram::bucket_lower_bound(index), value / LatencyHistogram::sub_bucket_count);
+    }
+
+    LatencyHistogram histogram;
+    for (uint64_t value = 1; value <= 1000; ++value)
+        histogram.record(value);
+
+    const auto snapshot = histogram.snapshot();
+    ASSERT_EQ(snapshot.count, 1000);
+    ASSERT_EQ(snapshot.sum, 500500);
+    ASSERT_EQ(snapshot.min(), 1);
+    ASSERT_NEAR(snapshot.percentile(0.5), 500, 500 / LatencyHistogram::sub_bucket_count);
+    ASSERT_NEAR(snapshot.percentile(0.99), 990, 990 / LatencyHistogram::sub_bucket_count);
+    ASSERT_GE(snapshot.max(), 1000);
+}
+
+// Test H2: Latency stats snapshot reflects the operations performed
+TEST_F(OrderCacheTest, H2_LatencyHistogramTest_getLatencyStats)
+{
+    cache.addOrder(Order{"OrdId1", "SecId1", "Buy", 1000, "User1", "CompanyA"});
+    cache.addOrder(Order{"OrdId2", "SecId1", "Sell", 500, "User2", "CompanyB"});
+    cache.cancelOrder("OrdId1");
+    cache.getMatchingSizeForSecurity("SecId1");
+
+    const auto stats = cache.getLatencyStats();
+#ifdef ORDERCACHE_ENABLE_LATENCY_HISTOGRAMS
+    ASSERT_TRUE(stats.enabled);
+    ASSERT_EQ(stats[LatencyMetric::AddOrder].count, 2);
+    ASSERT_EQ(stats[LatencyMetric::Match].count, 2);
+    ASSERT_EQ(stats[LatencyMetric::CancelOrder].count, 1);
+    ASSERT_EQ(stats[LatencyMetric::Unmatch].count, 1);
+    ASSERT_EQ(stats[LatencyMetric::Rematch].count, 1);
+    ASSERT_EQ(stats[LatencyMetric::GetMatchingSizeForSecurity].count, 1);
+    ASSERT_EQ(stats[LatencyMetric::LockWait].count, 4);
+#else
+    ASSERT_FALSE(stats.enabled);
+    ASSERT_EQ(stats[LatencyMetric::AddOrder].count, 0);
+#endif
+}
+
+// Test S1: Operational counters track the work done by the cache
+TEST_F(OrderCacheTest, S1_StatsTest_Counters)
+{
+    cache.addOrder(Order{"OrdId1", "SecId1", "Buy", 1000, "User1", "CompanyA"});
+    cache.addOrder(Order{"OrdId2", "SecId1", "Sell", 300, "User2", "CompanyB"});
+    cache.addOrder(Order{"OrdId3", "SecId1", "Sell", 300, "User3", "CompanyC"});
+    cache.addOrder(Order{"OrdId4", "SecId2", "Sell", 300, "User4", "CompanyC"});
+    cache.cancelOrder("OrdId1");
+    cache.getMatchingSizeForSecurity("SecId1");
+
+    const auto stats = cache.stats();
+    ASSERT_EQ(stats[StatsCounter::OrdersAdded], 4);
+    ASSERT_EQ(stats[StatsCounter::OrdersCancelled], 1);
+    ASSERT_EQ(stats[StatsCounter::CancelOrderCalls], 1);
+    ASSERT_EQ(stats[StatsCounter::GetMatchingSizeCalls], 1);
+    ASSERT_EQ(stats[StatsCounter::MatchEdgesCreated], 2);
+    ASSERT_EQ(stats[StatsCounter::MatchEdgesRemoved], 2);
+    ASSERT_EQ(stats[StatsCounter::UpdateMatchesCalls], 1);
+    ASSERT_EQ(stats[StatsCounter::BuyOrders], 0);
+    ASSERT_EQ(stats[StatsCounter::SellOrders], 3);
+    ASSERT_EQ(stats[StatsCounter::Securities], 2);
+    // 4 adds + 2 re-matched sell orders in SecId1 after the cancellation
+    ASSERT_EQ(stats[StatsCounter::MatchOrderCalls], 6);
+    ASSERT_EQ(stats[StatsCounter::MatchOrdersVisited], 2);
+}
+
+// Test S2: Stats are exported in Prometheus text format
+TEST_F(OrderCacheTest, S2_StatsTest_PrometheusExport)
+{
+    cache.addOrder(Order{"OrdId1", "SecId1", "Buy", 1000, "User1", "CompanyA"});
+    cache.addOrder(Order{"OrdId2", "SecId1", "Sell", 300, "User2", "CompanyB"});
+
+    std::ostringstream os;
+    writePrometheusText(os, cache.stats());
+    const auto text = os.str();
+
+    ASSERT_NE(text.find("# TYPE ordercache_orders_added_total counter\nordercache_orders_added_total 2\n"), std::string::npos);
+    ASSERT_NE(text.find("# TYPE ordercache_buy_orders gauge\nordercache_buy_orders 1\n"), std::string::npos);
+    ASSERT_NE(text.find("ordercache_match_edges_created_total 1\n"), std::string::npos);
+#ifdef ORDERCACHE_ENABLE_LATENCY_HISTOGRAMS
+    ASSERT_NE(text.find("ordercache_latency_ns_count{op=\"addOrder\"} 2\n"), std::string::npos);
+#endif
+}
+
+// Test T1: Tracer records spans of the write operations as Chrome trace events
+TEST_F(OrderCacheTest, T1_TracerTest_ChromeTraceEvents)
+{
+    Tracer tracer;
+    cache.addOrder(Order{"OrdId1", "SecId1", "Buy", 1000, "User1", "CompanyA"}); // not traced
+    cache.setTracer(&tracer);
+    cache.addOrder(Order{"OrdId2", "SecId1", "Sell", 300, "User2", "CompanyB"});
+    cache.cancelOrder("OrdId1");
+    cache.setTracer(nullptr);
+    cache.cancelOrder("OrdId2"); // not traced
+
+    std::ostringstream os;
+    tracer.writeChromeTrace(os);
+    const auto json = os.str();
+
+    auto count = [&json](const std::string &str)
+    {
+        size_t n = 0;
+        for (auto pos = json.find(str); pos != std::string::npos; pos = json.find(str, pos + 1))
+            ++n;
+        return n;
+    };
+
+    ASSERT_EQ(count("\"ph\":\"X\""), 6);
+    ASSERT_EQ(count("\"name\":\"addOrder\""), 1);
+    ASSERT_EQ(count("\"name\":\"match_order\""), 2); // add + re-match of OrdId2
+    ASSERT_EQ(count("\"name\":\"cancelOrder\""), 1);
+    ASSERT_EQ(count("\"name\":\"unmatch_order\""), 1);
+    ASSERT_EQ(count("\"name\":\"update_matches\""), 1);
+    ASSERT_EQ(count("\"security\":\"SecId1\""), 6);
+    ASSERT_NE(json.find("\"name\":\"match_order\",\"cat\":\"ordercache\",\"ph\":\"X\",\"pid\":1,\"tid\":1"), std::string::npos);
+    ASSERT_NE(json.find("\"orders_visited\":1}"), std::string::npos);
+}
+
+// Test T2: Tracer ring buffers keep the latest spans when they wrap around
+TEST(TracerTest, T2_TracerTest_RingWrapAround)
+{
+    Tracer tracer(4);
+    for (uint32_t i = 0; i != 10; ++i)
+        tracer.record(TraceSpan::MatchOrder, i, i + 1, "SecId1", i);
+
+    std::ostringstream os;
+    tracer.writeChromeTrace(os);
+    const auto json = os.str();
+
+    ASSERT_EQ(json.find("\"orders_visited\":5}"), std::string::npos);
+    for (auto i : {6, 7, 8, 9})
+        ASSERT_NE(json.find("\"orders_visited\":" + std::to_string(i) + "}"), std::string::npos);
+}
+
+// Lock policies must behave the same as the default OrderCache
+template <typename Cache>
+class LockPolicyTest : public ::testing::Test
+{
+protected:
+    Cache cache;
+};
+
+using LockPolicyCaches = ::testing::Types<BasicOrderCache<NullLockPolicy>, BasicOrderCache<SharedMutexLockPolicy>, BasicOrderCache<ShardedLockPolicy<4>>>;
+TYPED_TEST_SUITE(LockPolicyTest, LockPolicyCaches);
+
+// Test P1: First example from README.txt with cancel and re-add, for every lock policy
+TYPED_TEST(LockPolicyTest, P1_LockPolicyTest_Example1)
+{
+    auto &cache = this->cache;
+
+    cache.addOrder(Order{"OrdId1", "SecId1", "Buy", 1000, "User1", "CompanyA"});
+    cache.addOrder(Order{"OrdId2", "SecId2", "Sell", 3000, "User2", "CompanyB"});
+    cache.addOrder(Order{"OrdId3", "SecId1", "Sell", 500, "User3", "CompanyA"});
+    cache.addOrder(Order{"OrdId4", "SecId2", "Buy", 600, "User4", "CompanyC"});
+    cache.addOrder(Order{"OrdId5", "SecId2", "Buy", 100, "User5", "CompanyB"});
+    cache.addOrder(Order{"OrdId6", "SecId3", "Buy", 1000, "User6", "CompanyD"});
+    cache.addOrder(Order{"OrdId7", "SecId2", "Buy", 2000, "User7", "CompanyE"});
+    cache.addOrder(Order{"OrdId8", "SecId2", "Sell", 5000, "User8", "CompanyE"});
+
+    ASSERT_EQ(cache.getMatchingSizeForSecurity("SecId1"), 0);
+    ASSERT_EQ(cache.getMatchingSizeForSecurity("SecId2"), 2700);
+    ASSERT_EQ(cache.getMatchingSizeForSecurity("SecId3"), 0);
+
+    cache.cancelOrder("OrdId8");
+    ASSERT_EQ(cache.getMatchingSizeForSecurity("SecId2"), 2600);
+
+    cache.addOrder(Order{"OrdId8", "SecId2", "Sell", 5000, "User8", "CompanyE"});
+    ASSERT_EQ(cache.getMatchingSizeForSecurity("SecId2"), 2700);
+
+    cache.cancelOrdersForUser("User2");
+    cache.cancelOrdersForSecIdWithMinimumQty("SecId1", 1000);
+    ASSERT_EQ(cache.getAllOrders().size(), 6);
+    ASSERT_EQ(cache.stats()[StatsCounter::OrdersCancelled], 3);
+}
+
+// Test P2: Concurrent writers on different securities with a sharded lock
+TEST(ShardedLockPolicyTest, P2_LockPolicyTest_ConcurrentWriters)
+{
+    BasicOrderCache<ShardedLockPolicy<8>> cache;
+
+    std::vector<std::thread> threads;
+    for (auto t = 0; t != 4; ++t)
+        threads.emplace_back([&cache, t]()
+                             {
+                                 const auto security = "SecId" + std::to_string(t);
+                                 for (auto i = 0; i != 250; ++i)
+                                 {
+                                     const auto id = std::to_string(t) + "_" + std::to_string(i);
+                                     cache.addOrder(Order{"Buy" + id, security, "Buy", 100, "User1", "CompanyA"});
+                                     cache.addOrder(Order{"Sell" + id, security, "Sell", 100, "User2", "CompanyB"});
+                                     if (i % 2 == 0)
+                                         cache.cancelOrder("Sell" + id);
+                                 } });
+    for (auto &thread : threads)
+        thread.join();
+
+    for (auto t = 0; t != 4; ++t)
+        ASSERT_EQ(cache.getMatchingSizeForSecurity("SecId" + std::to_string(t)), 125 * 100);
+    ASSERT_EQ(cache.getAllOrders().size(), 4 * 375);
+    ASSERT_EQ(cache.stats()[StatsCounter::Securities], 4);
+}
+
+// Test R1: User-level self-match prevention lets users of the same company match
+TEST(MatchPolicyTest, R1_MatchPolicyTest_DifferentUser)
+{
+    BasicOrderCache<SharedMutexLockPolicy, DifferentUserMatchPolicy> cache;
+    cache.addOrder(Order{"1", "SecId1", "Buy", 2000, "User1", "CompanyA"});
+    cache.addOrder(Order{"2", "SecId1", "Sell", 500, "User1", "CompanyA"}); // same user
+    cache.addOrder(Order{"3", "SecId1", "Sell", 700, "User2", "CompanyA"}); // same company, other user
+
+    ASSERT_EQ(cache.getMatchingSizeForSecurity("SecId1"), 700);
+
+    cache.cancelOrder("3");
+    ASSERT_EQ(cache.getMatchingSizeForSecurity("SecId1"), 0);
+}
+
+// Test R2: Without restrictions every buy order can match every sell order
+TEST(MatchPolicyTest, R2_MatchPolicyTest_NoRestriction)
+{
+    BasicOrderCache<NullLockPolicy, NoRestrictionMatchPolicy> cache;
+    cache.addOrder(Order{"1", "SecId3", "Buy", 2000, "User1", "CompanyA"});
+    cache.addOrder(Order{"2", "SecId3", "Sell", 2000, "User1", "CompanyA"});
+
+    ASSERT_EQ(cache.getMatchingSizeForSecurity("SecId3"), 2000);
+}
+
+// Test R3: Minimum fill size skips matches smaller than the threshold
+TEST(MatchPolicyTest, R3_MatchPolicyTest_MinimumFillSize)
+{
+    BasicOrderCache<SharedMutexLockPolicy, MinimumFillSizeMatchPolicy<500>> cache;
+    cache.addOrder(Order{"1", "SecId1", "Buy", 1200, "User1", "CompanyA"});
+    cache.addOrder(Order{"2", "SecId1", "Sell", 400, "User2", "CompanyB"});  // too small
+    cache.addOrder(Order{"3", "SecId1", "Sell", 1000, "User3", "CompanyC"}); // 1000 matched, 200 left in 1
+    cache.addOrder(Order{"4", "SecId1", "Sell", 600, "User4", "CompanyA"});  // same company
+    cache.addOrder(Order{"5", "SecId1", "Buy", 600, "User5", "CompanyB"});   // matches 4
+
+    ASSERT_EQ(cache.getMatchingSizeForSecurity("SecId1"), 1600);
+
+    // cancelling 3 frees 1000 in order 1: only order 2 is left to match
+    // (400, but below the minimum fill size)
+    cache.cancelOrder("3");
+    ASSERT_EQ(cache.getMatchingSizeForSecurity("SecId1"), 600);
+}
+
+// Test N1: Snapshot round trip restores orders, matches and unmatched qty
+TEST_F(OrderCacheTest, N1_SnapshotTest_SaveAndLoad)
+{
+    cache.addOrder(Order{"OrdId1", "SecId1", "Buy", 1000, "User1", "CompanyA"});
+    cache.addOrder(Order{"OrdId2", "SecId2", "Sell", 3000, "User2", "CompanyB"});
+    cache.addOrder(Order{"OrdId3", "SecId1", "Sell", 500, "User3", "CompanyA"});
+    cache.addOrder(Order{"OrdId4", "SecId2", "Buy", 600, "User4", "CompanyC"});
+    cache.addOrder(Order{"OrdId5", "SecId2", "Buy", 100, "User5", "CompanyB"});
+    cache.addOrder(Order{"OrdId6", "SecId3", "Buy", 1000, "User6", "CompanyD"});
+    cache.addOrder(Order{"OrdId7", "SecId2", "Buy", 2000, "User7", "CompanyE"});
+    cache.addOrder(Order{"OrdId8", "SecId2", "Sell", 5000, "User8", "CompanyE"});
+
+    const std::string path = ::testing::TempDir() + "N1_snapshot.bin";
+    cache.saveSnapshot(path);
+
+    BasicOrderCache<ShardedLockPolicy<4>> loaded;
+    loaded.loadSnapshot(path);
+    std::remove(path.c_str());
+
+    ASSERT_EQ(loaded.getAllOrders().size(), 8);
+    ASSERT_EQ(loaded.getMatchingSizeForSecurity("SecId1"), 0);
+    ASSERT_EQ(loaded.getMatchingSizeForSecurity("SecId2"), 2700);
+    ASSERT_EQ(loaded.getMatchingSizeForSecurity("SecId3"), 0);
+    ASSERT_EQ(loaded.stats()[StatsCounter::BuyOrders], 5);
+    ASSERT_EQ(loaded.stats()[StatsCounter::Securities], 3);
+
+    // match edges were restored: cancelling unmatches and re-matches as before
+    cache.cancelOrder("OrdId4");
+    loaded.cancelOrder("OrdId4");
+    ASSERT_EQ(loaded.getMatchingSizeForSecurity("SecId2"), cache.getMatchingSizeForSecurity("SecId2"));
+
+    loaded.addOrder(Order{"OrdId9", "SecId1", "Sell", 800, "User9", "CompanyB"});
+    ASSERT_EQ(loaded.getMatchingSizeForSecurity("SecId1"), 800);
+}
+
+// Test N2: A corrupt snapshot is rejected and leaves the cache unchanged
+TEST_F(OrderCacheTest, N2_SnapshotTest_CorruptFile)
+{
+    cache.addOrder(Order{"OrdId1", "SecId1", "Buy", 1000, "User1", "CompanyA"});
+    cache.addOrder(Order{"OrdId2", "SecId1", "Sell", 300, "User2", "CompanyB"});
+
+    const std::string path = ::testing::TempDir() + "N2_snapshot.bin";
+    cache.saveSnapshot(path);
+
+    {
+        std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(-3, std::ios::end);
+        file.put('\x7f');
+    }
+
+    OrderCache loaded;
+    loaded.addOrder(Order{"OrdId3", "SecId2", "Buy", 100, "User3", "CompanyC"});
+    ASSERT_THROW(loaded.loadSnapshot(path), std::runtime_error);
+    ASSERT_THROW(loaded.loadSnapshot(path + ".missing"), std::runtime_error);
+    std::remove(path.c_str());
+
+    ASSERT_EQ(loaded.getAllOrders().size(), 1);
+    ASSERT_EQ(loaded.getMatchingSizeForSecurity("SecId1"), 0);
+}
+
+// Test J1: Recovery from a snapshot and the journal records after it
+TEST(JournalTest, J1_JournalTest_RecoverFromSnapshotAndJournal)
+{
+    const std::string snapshot_path = ::testing::TempDir() + "J1_snapshot.bin";
+    const std::string journal_path = ::testing::TempDir() + "J1_journal.bin";
+    std::remove(journal_path.c_str());
+
+    BasicOrderCache<ShardedLockPolicy<4>> cache;
+    {
+        Journal journal(journal_path, {JournalDurability::Write, std::chrono::microseconds(0)});
+        cache.setJournal(&journal);
+
+        cache.addOrder(Order{"OrdId1", "SecId1", "Buy", 1000, "User1", "CompanyA"});
+        cache.addOrder(Order{"OrdId2", "SecId2", "Sell", 3000, "User2", "CompanyB"});
+        cache.addOrder(Order{"OrdId3", "SecId1", "Sell", 500, "User3", "CompanyB"});
+        cache.saveSnapshot(snapshot_path);
+
+        cache.addOrder(Order{"OrdId4", "SecId2", "Buy", 600, "User4", "CompanyC"});
+        cache.addOrder(Order{"OrdId5", "SecId2", "Buy", 100, "User5", "CompanyB"});
+        cache.addOrder(Order{"OrdId6", "SecId3", "Buy", 1000, "User6", "CompanyD"});
+        cache.addOrder(Order{"OrdId7", "SecId3", "Sell", 700, "User7", "CompanyE"});
+        cache.cancelOrder("OrdId3");
+        cache.cancelOrdersForUser("User4");
+        cache.cancelOrdersForSecIdWithMinimumQty("SecId3", 1000);
+        cache.addOrder(Order{"OrdId8", "SecId1", "Sell", 300, "User8", "CompanyE"});
+
+        journal.flush();
+        ASSERT_EQ(journal.lastLsn(), 11);
+        ASSERT_EQ(journal.stats().records, 11);
+        cache.setJournal(nullptr);
+    }
+
+    BasicOrderCache<ShardedLockPolicy<4>> recovered;
+    const auto snapshot_lsn = recovered.loadSnapshot(snapshot_path);
+    ASSERT_EQ(snapshot_lsn, 3);
+    ASSERT_EQ(recovered.getMatchingSizeForSecurity("SecId1"), 500);
+
+    const auto replay = recovered.replayJournal(journal_path, snapshot_lsn, 3);
+    ASSERT_EQ(replay.records, 8);
+    ASSERT_EQ(replay.last_lsn, 11);
+    ASSERT_FALSE(replay.torn_tail);
+
+    // replaying the whole journal on an empty cache gives the same state
+    OrderCache replayed;
+    ASSERT_EQ(replayed.replayJournal(journal_path).records, 11);
+
+    for (auto *other : {static_cast<OrderCacheInterface *>(&recovered), static_cast<OrderCacheInterface *>(&replayed)})
+    {
+        ASSERT_EQ(other->getAllOrders().size(), cache.getAllOrders().size());
+        for (const auto *security : {"SecId1", "SecId2", "SecId3"})
+            ASSERT_EQ(other->getMatchingSizeForSecurity(security), cache.getMatchingSizeForSecurity(security));
+    }
+    ASSERT_EQ(cache.getMatchingSizeForSecurity("SecId1"), 300);
+    ASSERT_EQ(cache.getMatchingSizeForSecurity("SecId2"), 0);
+    ASSERT_EQ(cache.getMatchingSizeForSecurity("SecId3"), 0);
+
+    std::remove(snapshot_path.c_str());
+    std::remove(journal_path.c_str());
+}
+
+// Test J2: An incomplete last record is ignored on replay and dropped on reopening
+TEST(JournalTest, J2_JournalTest_TornTail)
+{
+    const std::string journal_path = ::testing::TempDir() + "J2_journal.bin";
+    std::remove(journal_path.c_str());
+
+    {
+        Journal journal(journal_path, {JournalDurability::FsyncWait});
+        OrderCache cache;
+        cache.setJournal(&journal);
+        cache.addOrder(Order{"OrdId1", "SecId1", "Buy", 1000, "User1", "CompanyA"});
+        cache.addOrder(Order{"OrdId2", "SecId1", "Sell", 400, "User2", "CompanyB"});
+        cache.setJournal(nullptr);
+    }
+
+    // a crash in the middle of writing a record
+    {
+        std::ofstream file(journal_path, std::ios::binary | std::ios::app);
+        file.write("\x20\x00\x00\x00\x01\x02", 6);
+    }
+
+    OrderCache recovered;
+    const auto replay = recovered.replayJournal(journal_path);
+    ASSERT_EQ(replay.records, 2);
+    ASSERT_EQ(replay.last_lsn, 2);
+    ASSERT_TRUE(replay.torn_tail);
+    ASSERT_EQ(recovered.getMatchingSizeForSecurity("SecId1"), 400);
+
+    {
+        Journal journal(journal_path, {JournalDurability::Write});
+        ASSERT_EQ(journal.lastLsn(), 2);
+        recovered.setJournal(&journal);
+        recovered.cancelOrder("OrdId2");
+        recovered.setJournal(nullptr);
+    }
+
+    OrderCache reopened;
+    const auto reopened_replay = reopened.replayJournal(journal_path);
+    ASSERT_EQ(reopened_replay.records, 3);
+    ASSERT_FALSE(reopened_replay.torn_tail);
+    ASSERT_EQ(reopened.getMatchingSizeForSecurity("SecId1"), 0);
+    ASSERT_EQ(reopened.getAllOrders().size(), 1);
+
+    std::remove(journal_path.c_str());
+}
+
+// Test F1: Orders loaded from a text file in several chunks match as if added one by one
+TEST(OrderFileTest, F1_OrderFileTest_LoadExample2)
+{
+    const std::string path = ::testing::TempDir() + "F1_orders.txt";
+    {
+        std::ofstream file(path, std::ios::binary);
+        file << "OrdId1  SecId1 Sell  100 User10 Company2\n"
+                "OrdId2  SecId3 Sell  200 User8  Company2\r\n"
+                "OrdId3  SecId1 Buy   300 User13 Company2\n"
+                "\n"
+                "OrdId4  SecId2 Sell  400 User12 Company2\n"
+                "\tOrdId5  SecId3 Sell  500 User7  Company2\n"
+                "OrdId6  SecId3 Buy   600 User3  Company1\n"
+                "OrdId7  SecId1 Sell  700 User10 Company2\n"
+                "OrdId8  SecId1 Sell  800 User2  Company1\n"
+                "OrdId9  SecId2 Buy   900 User6  Company2\n"
+                "OrdId10 SecId2 Sell 1000 User5  Company1\n"
+                "OrdId11 SecId1 Sell 1100 User13 Company2\n"
+                "OrdId12 SecId2 Buy  1200 User9  Company2\n"
+                "OrdId13 SecId1 Sell 1300 User1  Company1";
+    }
+
+    OrderFile orders(path, 3, 64);
+    ASSERT_GT(orders.chunks().size(), 3);
+    ASSERT_EQ(orders.record_count(), 13);
+
+    BasicOrderCache<ShardedLockPolicy<4>> cache;
+    orders.addTo(cache);
+    std::remove(path.c_str());
+
+    ASSERT_EQ(cache.getAllOrders().size(), 13);
+    ASSERT_EQ(cache.getMatchingSizeForSecurity("SecId1"), 300);
+    ASSERT_EQ(cache.getMatchingSizeForSecurity("SecId2"), 1000);
+    ASSERT_EQ(cache.getMatchingSizeForSecurity("SecId3"), 600);
+
+    cache.cancelOrder("OrdId6");
+    ASSERT_EQ(cache.getMatchingSizeForSecurity("SecId3"), 0);
+}
+
+// Test F2: A malformed line is reported with its line number
+TEST(OrderFileTest, F2_OrderFileTest_MalformedLine)
+{
+    const std::string path = ::testing::TempDir() + "F2_orders.txt";
+    {
+        std::ofstream file(path, std::ios::binary);
+        file << "OrdId1 SecId1 Buy 1000 User1 CompanyA\n"
+                "OrdId2 SecId1 Sell 1x00 User2 CompanyB\n";
+    }
+
+    try
+    {
+        OrderFile orders(path);
+        FAIL() << "expected std::runtime_error";
+    }
+    catch (const std::runtime_error &e)
+    {
+        ASSERT_NE(std::string(e.what()).find("line 2: invalid qty"), std::string::npos);
+    }
+    std::remove(path.c_str());
+}
+
+// Test Q1: The MPSC ring is bounded and FIFO
+TEST(MpscRingTest, Q1_MpscRingTest_BoundedFifo)
+{
+    MpscRing<std::string> ring(3);
+    ASSERT_EQ(ring.capacity(), 4);
+    ASSERT_TRUE(ring.empty());
+
+    for (auto i = 0; i != 4; ++i)
+    {
+        auto value = std::to_string(i);
+        ASSERT_TRUE(ring.try_push(value));
+    }
+    std::string value = "4";
+    ASSERT_FALSE(ring.try_push(value));
+    ASSERT_EQ(value, "4");
+
+    ASSERT_EQ(ring.try_pop(), "0");
+    ASSERT_TRUE(ring.try_push(value));
+    for (const auto *expected : {"1", "2", "3", "4"})
+        ASSERT_EQ(ring.try_pop(), expected);
+    ASSERT_FALSE(ring.try_pop().has_value());
+}
+
+// Test Q2: Commands from several producers are applied by the writer thread
+TEST(AsyncOrderCacheTest, Q2_AsyncOrderCacheTest_Producers)
+{
+    AsyncOrderCache<> async_cache(16, 8);
+
+    std::vector<std::thread> producers;
+    for (auto t = 0; t != 4; ++t)
+        producers.emplace_back([&async_cache, t]()
+                               {
+                                   const auto security = "SecId" + std::to_string(t);
+                                   std::vector<std::future<void>> futures;
+                                   for (auto i = 0; i != 100; ++i)
+                                       futures.push_back(async_cache.addOrder(Order{std::to_string(t) + "_" + std::to_string(i), security, i % 2 == 0 ? "Buy" : "Sell", 100, "User" + std::to_string(i), "Company" + std::to_string(i % 4)}));
+                                   // applied after the adds of this producer
+                                   futures.push_back(async_cache.cancelOrder(std::to_string(t) + "_0"));
+                                   for (auto &future : futures)
+                                       future.get(); });
+    for (auto &producer : producers)
+        producer.join();
+
+    // orders of companies 0 and 2 are buys, of 1 and 3 sells: order 0 was
+    // cancelled, and re-matching leaves only 49 buys
+    async_cache.flush().get();
+    for (auto t = 0; t != 4; ++t)
+        ASSERT_EQ(async_cache.cache().getMatchingSizeForSecurity("SecId" + std::to_string(t)), 49 * 100);
+    ASSERT_EQ(async_cache.cache().getAllOrders().size(), 4 * 99);
+    ASSERT_EQ(async_cache.commandCount(), 4 * 101 + 1);
+    ASSERT_LE(async_cache.batchCount(), async_cache.commandCount());
+}
+
+// Test Q3: Completion callbacks run once each, in order for one producer
+TEST(AsyncOrderCacheTest, Q3_AsyncOrderCacheTest_Callbacks)
+{
+    std::vector<int> completed;
+    {
+        AsyncOrderCache<BasicOrderCache<NullLockPolicy>> async_cache;
+        auto callback = [&completed](int id)
+        {
+            return [&completed, id](std::exception_ptr error)
+            {
+                ASSERT_FALSE(error);
+                completed.push_back(id);
+            };
+        };
+
+        async_cache.addOrder(Order{"OrdId1", "SecId1", "Buy", 1000, "User1", "CompanyA"}, callback(1));
+        async_cache.addOrder(Order{"OrdId2", "SecId1", "Sell", 400, "User2", "CompanyB"}, callback(2));
+        async_cache.cancelOrdersForSecIdWithMinimumQty("SecId1", 1000, callback(3));
+        async_cache.addOrder(Order{"OrdId3", "SecId1", "Buy", 100, "User3", "CompanyC"}, nullptr);
+        async_cache.cancelOrdersForUser("User9", callback(4));
+        async_cache.flush().get();
+
+        ASSERT_EQ(async_cache.cache().getMatchingSizeForSecurity("SecId1"), 100);
+    }
+    ASSERT_EQ(completed, (std::vector<int>{1, 2, 3, 4}));
+}
+
+// Test W1: Polled changes are coalesced per security, for subscribed ones
+TEST(MatchingSizeNotifierTest, W1_MatchingSizeNotifierTest_PollCoalesced)
+{
+    MatchingSizeNotifier notifier(MatchingSizeNotifier::Delivery::Poll);
+    std::vector<std::string> sec1_changes;
+    notifier.subscribe("SecId1", [&sec1_changes](const MatchingSizeChange &change)
+                       { sec1_changes.push_back(change.security_id + ":" + std::to_string(change.old_size) + "->" + std::to_string(change.new_size)); });
+
+    OrderCache cache;
+    cache.setNotifier(&notifier);
+
+    cache.addOrder(Order{"OrdId1", "SecId1", "Buy", 1000, "User1", "CompanyA"});
+    cache.addOrder(Order{"OrdId2", "SecId1", "Sell", 400, "User2", "CompanyB"});
+    cache.addOrder(Order{"OrdId3", "SecId1", "Sell", 300, "User3", "CompanyC"});
+    cache.addOrder(Order{"OrdId4", "SecId2", "Buy", 500, "User4", "CompanyA"});
+    cache.addOrder(Order{"OrdId5", "SecId2", "Sell", 500, "User2", "CompanyB"});
+
+    // SecId2 isn't subscribed
+    auto changes = notifier.poll();
+    ASSERT_EQ(changes.size(), 1);
+    ASSERT_EQ(changes[0].security_id, "SecId1");
+    ASSERT_EQ(changes[0].old_size, 0);
+    ASSERT_EQ(changes[0].new_size, 700);
+    ASSERT_EQ(sec1_changes, (std::vector<std::string>{"SecId1:0->700"}));
+
+    // a wildcard subscription without a listener
+    const auto all = notifier.subscribeAll();
+    cache.cancelOrder("OrdId3");
+    cache.addOrder(Order{"OrdId6", "SecId1", "Sell", 300, "User6", "CompanyD"}); // back to 700
+    cache.cancelOrdersForUser("User4");
+    changes = notifier.poll();
+    ASSERT_EQ(changes.size(), 1);
+    ASSERT_EQ(changes[0].security_id, "SecId2");
+    ASSERT_EQ(changes[0].old_size, 500);
+    ASSERT_EQ(changes[0].new_size, 0);
+    ASSERT_EQ(sec1_changes.size(), 1);
+
+    notifier.unsubscribe(all);
+    cache.addOrder(Order{"OrdId7", "SecId2", "Buy", 200, "User7", "CompanyA"});
+    ASSERT_TRUE(notifier.poll().empty());
+    cache.cancelOrdersForSecIdWithMinimumQty("SecId1", 300);
+    ASSERT_EQ(notifier.poll().size(), 1);
+    ASSERT_EQ(sec1_changes, (std::vector<std::string>{"SecId1:0->700", "SecId1:700->0"}));
+}
+
+// Test W2: Changes are delivered on the notifier's thread
+TEST(MatchingSizeNotifierTest, W2_MatchingSizeNotifierTest_DeliveryThread)
+{
+    std::promise<MatchingSizeChange> delivered;
+    MatchingSizeNotifier notifier(MatchingSizeNotifier::Delivery::Thread, std::chrono::milliseconds(5));
+    const auto caller = std::this_thread::get_id();
+    auto first = true;
+    notifier.subscribeAll([&delivered, &first, caller](const MatchingSizeChange &change)
+                          {
+                              ASSERT_NE(std::this_thread::get_id(), caller);
+                              if (first == true)
+                                  delivered.set_value(change);
+                              first = false; });
+
+    BasicOrderCache<ShardedLockPolicy<4>> cache;
+    cache.setNotifier(&notifier);
+    cache.addOrder(Order{"OrdId1", "SecId1", "Buy", 1000, "User1", "CompanyA"});
+    cache.addOrder(Order{"OrdId2", "SecId1", "Sell", 400, "User2", "CompanyB"});
+    cache.addOrder(Order{"OrdId3", "SecId1", "Sell", 100, "User3", "CompanyC"});
+
+    auto future = delivered.get_future();
+    ASSERT_EQ(future.wait_for(std::chrono::seconds(10)), std::future_status::ready);
+    const auto change = future.get();
+    ASSERT_EQ(change.security_id, "SecId1");
+    ASSERT_EQ(change.old_size, 0);
+    ASSERT_GE(change.new_size, 400);
+    cache.setNotifier(nullptr);
+}
+
+// Test G1: Securities ranked by matching size follow adds, cancels and snapshot loads
+TEST(TopMatchingSecuritiesTest, G1_TopMatchingSecuritiesTest_Ranking)
+{
+    using Ranking = std::vector<std::pair<std::string, unsigned int>>;
+
+    BasicOrderCache<ShardedLockPolicy<4>> cache;
+    ASSERT_TRUE(cache.getTopMatchingSecurities(3).empty());
+
+    for (auto i = 1; i <= 5; ++i)
+    {
+        const auto security = "SecId" + std::to_string(i);
+        cache.addOrder(Order{"Buy" + std::to_string(i), security, "Buy", 100u * i, "User1", "CompanyA"});
+        cache.addOrder(Order{"Sell" + std::to_string(i), security, "Sell", 1000, "User2", "CompanyB"});
+    }
+    cache.addOrder(Order{"OrdId6", "SecId6", "Buy", 700, "User1", "CompanyA"}); // nothing to match
+
+    ASSERT_EQ(cache.getTopMatchingSecurities(3), (Ranking{{"SecId5", 500}, {"SecId4", 400}, {"SecId3", 300}}));
+    ASSERT_EQ(cache.getTopMatchingSecurities(10).size(), 5);
+    ASSERT_TRUE(cache.getTopMatchingSecurities(0).empty());
+
+    // ties are ranked by security id
+    cache.addOrder(Order{"OrdId7", "SecId2", "Buy", 200, "User3", "CompanyC"});
+    cache.cancelOrder("Buy5");
+    ASSERT_EQ(cache.getTopMatchingSecurities(3), (Ranking{{"SecId2", 400}, {"SecId4", 400}, {"SecId3", 300}}));
+
+    cache.cancelOrdersForUser("User1");
+    ASSERT_EQ(cache.getTopMatchingSecurities(3), (Ranking{{"SecId2", 200}}));
+
+    // the ranking of a loaded snapshot replaces the current one
+    BasicOrderCache<ShardedLockPolicy<4>> other;
+    other.addOrder(Order{"OrdId1", "SecId9", "Buy", 50, "User1", "CompanyA"});
+    other.addOrder(Order{"OrdId2", "SecId9", "Sell", 60, "User2", "CompanyB"});
+    const std::string path = "G1_TopMatchingSecuritiesTest.snapshot";
+    other.saveSnapshot(path);
+    cache.loadSnapshot(path);
+    std::remove(path.c_str());
+    ASSERT_EQ(cache.getTopMatchingSecurities(3), (Ranking{{"SecId9", 50}}));
+}
+
+// Test A1: Aggregates of securities, users and companies follow adds, matches and cancels
+TEST(AggregatesTest, A1_AggregatesTest_Example1)
+{
+    BasicOrderCache<ShardedLockPolicy<4>> cache;
+    cache.addOrder(Order{"OrdId1", "SecId1", "Buy", 1000, "User1", "CompanyA"});
+    cache.addOrder(Order{"OrdId2", "SecId2", "Sell", 3000, "User2", "CompanyB"});
+    cache.addOrder(Order{"OrdId3", "SecId1", "Sell", 500, "User3", "CompanyA"});
+    cache.addOrder(Order{"OrdId4", "SecId2", "Buy", 600, "User4", "CompanyC"});
+    cache.addOrder(Order{"OrdId5", "SecId2", "Buy", 100, "User5", "CompanyB"});
+    cache.addOrder(Order{"OrdId6", "SecId3", "Buy", 1000, "User6", "CompanyD"});
+    cache.addOrder(Order{"OrdId7", "SecId2", "Buy", 2000, "User7", "CompanyE"});
+    cache.addOrder(Order{"OrdId8", "SecId2", "Sell", 5000, "User8", "CompanyE"});
+
+    auto sec2 = cache.getSecurityAggregates("SecId2");
+    ASSERT_EQ(sec2.buy_orders, 3);
+    ASSERT_EQ(sec2.sell_orders, 2);
+    ASSERT_EQ(sec2.buy_qty, 2700);
+    ASSERT_EQ(sec2.sell_qty, 8000);
+    ASSERT_EQ(sec2.matching_size, 2700);
+    ASSERT_EQ(sec2.buy_unmatched_qty, 0);
+    ASSERT_EQ(sec2.sell_unmatched_qty, 5300);
+
+    auto sec1 = cache.getSecurityAggregates("SecId1");
+    ASSERT_EQ(sec1.buy_unmatched_qty, 1000); // same company, no match
+    ASSERT_EQ(sec1.sell_unmatched_qty, 500);
+    ASSERT_EQ(cache.getSecurityAggregates("SecId9").buy_orders, 0);
+
+    auto company_a = cache.getCompanyAggregates("CompanyA");
+    ASSERT_EQ(company_a.orders, 2);
+    ASSERT_EQ(company_a.buy_qty, 1000);
+    ASSERT_EQ(company_a.sell_qty, 500);
+    ASSERT_EQ(cache.getCompanyAggregates("CompanyE").open_qty(), 7000);
+    ASSERT_EQ(cache.getUserAggregates("User4").buy_qty, 600);
+
+    cache.cancelOrder("OrdId7");
+    cache.cancelOrdersForUser("User4");
+    sec2 = cache.getSecurityAggregates("SecId2");
+    ASSERT_EQ(sec2.buy_orders, 1);
+    ASSERT_EQ(sec2.buy_qty, 100);
+    ASSERT_EQ(sec2.matching_size, 100);
+    ASSERT_EQ(sec2.sell_unmatched_qty, 7900);
+    ASSERT_EQ(cache.getUserAggregates("User4").orders, 0);
+    ASSERT_EQ(cache.getCompanyAggregates("CompanyE").orders, 1);
+    ASSERT_EQ(cache.getCompanyAggregates("CompanyE").buy_qty, 0);
+
+    cache.cancelOrdersForSecIdWithMinimumQty("SecId2", 3000);
+    ASSERT_EQ(cache.getCompanyAggregates("CompanyB").sell_qty, 0);
+    ASSERT_EQ(cache.getCompanyAggregates("CompanyB").buy_qty, 100);
+
+    // loaded from a snapshot
+    const std::string path = "A1_AggregatesTest.snapshot";
+    cache.saveSnapshot(path);
+    OrderCache other;
+    other.addOrder(Order{"OrdId9", "SecId1", "Buy", 50, "User1", "CompanyA"});
+    other.loadSnapshot(path);
+    std::remove(path.c_str());
+    ASSERT_EQ(other.getCompanyAggregates("CompanyA").buy_qty, 1000);
+    ASSERT_EQ(other.getSecurityAggregates("SecId1").buy_qty, 1000);
+    ASSERT_EQ(other.getUserAggregates("User6").orders, 1);
+    ASSERT_EQ(other.getUserAggregates("User2").orders, 0);
+}
+
+// Test A2: An order id added twice keeps the first order, its matches and aggregates
+TEST(AggregatesTest, A2_AggregatesTest_DuplicateOrderId)
+{
+    using namespace std::chrono_literals;
+
+    BasicOrderCache<ShardedLockPolicy<4>> cache;
+    cache.addOrder(Order{"OrdId1", "SecId1", "Buy", 1000, "User1", "CompanyA"});
+    cache.addOrder(Order{"OrdId2", "SecId1", "Sell", 400, "User2", "CompanyB"});
+
+    // on either side, with an expiry
+    cache.addOrder(Order{"OrdId1", "SecId1", "Buy", 700, "User3", "CompanyC"});
+    cache.addOrder(Order{"OrdId1", "SecId1", "Sell", 900, "User3", "CompanyC"}, OrderCache::expiry_clock::now());
+    ASSERT_EQ(cache.stats()[StatsCounter::OrdersAdded], 2);
+    ASSERT_EQ(cache.getAllOrders().size(), 2);
+
+    const auto sec1 = cache.getSecurityAggregates("SecId1");
+    ASSERT_EQ(sec1.buy_orders, 1);
+    ASSERT_EQ(sec1.sell_orders, 1);
+    ASSERT_EQ(sec1.buy_qty, 1000);
+    ASSERT_EQ(sec1.sell_qty, 400);
+    ASSERT_EQ(sec1.buy_unmatched_qty, 600);
+    ASSERT_EQ(sec1.sell_unmatched_qty, 0);
+    ASSERT_EQ(cache.getMatchingSizeForSecurity("SecId1"), 400);
+    ASSERT_EQ(cache.getUserAggregates("User3").orders, 0);
+    ASSERT_EQ(cache.getCompanyAggregates("CompanyC").open_qty(), 0);
+
+    // the duplicate's expiry doesn't cancel the first order
+    ASSERT_EQ(cache.advanceTime(OrderCache::expiry_clock::now() + 1s), 0);
+    ASSERT_EQ(cache.getMatchingSizeForSecurity("SecId1"), 400);
+
+    cache.cancelOrder("OrdId1");
+    ASSERT_EQ(cache.getMatchingSizeForSecurity("SecId1"), 0);
+    ASSERT_EQ(cache.getSecurityAggregates("SecId1").sell_unmatched_qty, 400);
+    ASSERT_EQ(cache.getUserAggregates("User1").orders, 0);
+}
+
+// Test D1: Amends only trim or extend the matches of the order
+TEST(AmendOrderTest, D1_AmendOrderTest_IncreaseAndReduce)
+{
+    OrderCache cache;
+    cache.addOrder(Order{"OrdId1", "SecId1", "Buy", 1000, "User1", "CompanyA"});
+    cache.addOrder(Order{"OrdId2", "SecId1", "Sell", 400, "User2", "CompanyB"});
+    cache.addOrder(Order{"OrdId3", "SecId1", "Buy", 300, "User3", "CompanyC"}); // nothing left to match
+    ASSERT_EQ(cache.getMatchingSizeForSecurity("SecId1"), 400);
+
+    // reduced within the unmatched qty: matches are kept
+    ASSERT_TRUE(cache.amendOrderQty("OrdId1", 800));
+    ASSERT_EQ(cache.getMatchingSizeForSecurity("SecId1"), 400);
+
+    // reduced below the matched qty: OrdId2 gets 300 back, which OrdId3 matches
+    ASSERT_TRUE(cache.amendOrderQty("OrdId1", 100));
+    ASSERT_EQ(cache.getMatchingSizeForSecurity("SecId1"), 400);
+    ASSERT_EQ(cache.getSecurityAggregates("SecId1").buy_qty, 400);
+    ASSERT_EQ(cache.getSecurityAggregates("SecId1").buy_unmatched_qty, 0);
+
+    // increased: only the extra qty is matched
+    cache.addOrder(Order{"OrdId4", "SecId1", "Sell", 200, "User4", "CompanyD"});
+    ASSERT_TRUE(cache.amendOrderQty("OrdId1", 400));
+    ASSERT_EQ(cache.getMatchingSizeForSecurity("SecId1"), 600);
+    ASSERT_EQ(cache.getUserAggregates("User1").buy_qty, 400);
+
+    cache.cancelOrder("OrdId1");
+    ASSERT_EQ(cache.getMatchingSizeForSecurity("SecId1"), 300);
+
+    // increasing an order that already matches the only other side order
+    cache.addOrder(Order{"OrdId5", "SecId2", "Buy", 1000, "User1", "CompanyA"});
+    cache.addOrder(Order{"OrdId6", "SecId2", "Sell", 1500, "User2", "CompanyB"});
+    ASSERT_TRUE(cache.amendOrderQty("OrdId5", 1200));
+    ASSERT_EQ(cache.getMatchingSizeForSecurity("SecId2"), 1200);
+    ASSERT_TRUE(cache.amendOrderQty("OrdId5", 100));
+    ASSERT_EQ(cache.getMatchingSizeForSecurity("SecId2"), 100);
+    cache.cancelOrder("OrdId6");
+    ASSERT_EQ(cache.getMatchingSizeForSecurity("SecId2"), 0);
+
+    // zero cancels the order
+    ASSERT_TRUE(cache.amendOrderQty("OrdId5", 0));
+    ASSERT_FALSE(cache.amendOrderQty("OrdId5", 10));
+    ASSERT_EQ(cache.getAllOrders().size(), 3);
+    ASSERT_EQ(cache.stats()[StatsCounter::AmendOrderQtyCalls], 7);
+}
+
+// Test D2: Amends are journaled and replayed
+TEST(AmendOrderTest, D2_AmendOrderTest_JournalReplay)
+{
+    const std::string journal_path = ::testing::TempDir() + "D2_journal.bin";
+    std::remove(journal_path.c_str());
+
+    OrderCache cache;
+    {
+        Journal journal(journal_path, {JournalDurability::Write, std::chrono::microseconds(0)});
+        cache.setJournal(&journal);
+
+        cache.addOrder(Order{"OrdId1", "SecId1", "Buy", 1000, "User1", "CompanyA"});
+        cache.addOrder(Order{"OrdId2", "SecId1", "Sell", 400, "User2", "CompanyB"});
+        cache.addOrder(Order{"OrdId3", "SecId1", "Buy", 300, "User3", "CompanyC"});
+        cache.amendOrderQty("OrdId1", 100);
+        cache.amendOrderQty("OrdId2", 900);
+        cache.amendOrderQty("OrdId3", 0);
+
+        journal.flush();
+        ASSERT_EQ(journal.lastLsn(), 6);
+        cache.setJournal(nullptr);
+    }
+
+    OrderCache replayed;
+    ASSERT_EQ(replayed.replayJournal(journal_path).records, 6);
+    ASSERT_EQ(replayed.getMatchingSizeForSecurity("SecId1"), cache.getMatchingSizeForSecurity("SecId1"));
+    ASSERT_EQ(replayed.getMatchingSizeForSecurity("SecId1"), 100);
+    ASSERT_EQ(replayed.getSecurityAggregates("SecId1").sell_qty, 900);
+    ASSERT_EQ(replayed.getAllOrders().size(), 2);
+
+    std::remove(journal_path.c_str());
+}
+
+// Test E1: Timers expire at their tick, across levels, unless cancelled
+TEST(TimerWheelTest, E1_TimerWheelTest_AgainstSortedTimers)
+{
+    const uint64_t start = 1000000007;
+    TimerWheel<int> wheel(start);
+    std::map<TimerWheel<int>::Handle, std::pair<uint64_t, int>> pending;
+    std::mt19937_64 random(42);
+
+    std::vector<std::pair<TimerWheel<int>::Handle, int>> expired;
+    uint64_t now = start;
+    for (auto round = 0; round != 2000; ++round)
+    {
+        // delays from a tick up to past the range of the wheel
+        for (auto i = 0; i != 5; ++i)
+        {
+            const uint64_t delay = uint64_t{1} << (random() % 34);
+            const auto expiry = now + random() % delay;
+            const auto value = round * 5 + i;
+            pending[wheel.insert(expiry, value)] = {std::max(expiry, now + 1), value};
+        }
+
+        if (random() % 3 == 0 && pending.empty() == false)
+        {
+            auto it = pending.begin();
+            std::advance(it, random() % pending.size());
+            ASSERT_TRUE(wheel.cancel(it->first));
+            ASSERT_FALSE(wheel.cancel(it->first));
+            pending.erase(it);
+        }
+
+        now += uint64_t{1} << (random() % 30);
+        expired.clear();
+        wheel.advance(now, expired);
+
+        for (const auto &[handle, value] : expired)
+        {
+            auto it = pending.find(handle);
+            ASSERT_NE(it, pending.end());
+            ASSERT_LE(it->second.first, now);
+            ASSERT_EQ(it->second.second, value);
+            pending.erase(it);
+        }
+        for (const auto &x : pending)
+            ASSERT_GT(x.second.first, now);
+        ASSERT_EQ(wheel.size(), pending.size());
+    }
+}
+
+// Test E2: Expired orders are cancelled by advanceTime or the expiry thread
+TEST(ExpiryTest, E2_ExpiryTest_AdvanceTime)
+{
+    using namespace std::chrono_literals;
+    using clock = OrderCache::expiry_clock;
+
+    BasicOrderCache<ShardedLockPolicy<4>> cache;
+    const clock::time_point now = std::chrono::floor<std::chrono::milliseconds>(clock::now());
+    cache.addOrder(Order{"OrdId1", "SecId1", "Buy", 1000, "User1", "CompanyA"}, now + 100ms);
+    cache.addOrder(Order{"OrdId2", "SecId1", "Sell", 400, "User2", "CompanyB"});
+    cache.addOrder(Order{"OrdId3", "SecId1", "Buy", 300, "User3", "CompanyC"}, now + 200ms);
+    cache.addOrder(Order{"OrdId4", "SecId2", "Sell", 500, "User4", "CompanyD"}, now + 100ms);
+    cache.addOrder(Order{"OrdId5", "SecId2", "Buy", 500, "User5", "CompanyE"}, now + 100ms);
+    cache.addOrder(Order{"OrdId6", "SecId3", "Buy", 500, "User6", "CompanyF"}, now + 100ms);
+    cache.cancelOrder("OrdId6");
+    ASSERT_EQ(cache.getMatchingSizeForSecurity("SecId1"), 400);
+
+    ASSERT_EQ(cache.advanceTime(now + 99ms), 0);
+    ASSERT_EQ(cache.advanceTime(now + 100ms), 3);
+    ASSERT_EQ(cache.getMatchingSizeForSecurity("SecId1"), 300); // OrdId3 re-matched
+    ASSERT_EQ(cache.getMatchingSizeForSecurity("SecId2"), 0);
+    ASSERT_EQ(cache.getAllOrders().size(), 2);
+    ASSERT_EQ(cache.stats()[StatsCounter::OrdersExpired], 3);
+
+    // the background thread expires the last one
+    cache.addOrder(Order{"OrdId7", "SecId2", "Sell", 100, "User7", "CompanyG"}, clock::now() + 10ms);
+    cache.startExpiryThread(1ms);
+    for (auto i = 0; i != 1000 && cache.stats()[StatsCounter::OrdersExpired] != 5; ++i)
+        std::this_thread::sleep_for(5ms);
+    cache.stopExpiryThread();
+    ASSERT_EQ(cache.stats()[StatsCounter::OrdersExpired], 5);
+    ASSERT_EQ(cache.getMatchingSizeForSecurity("SecId1"), 0);
+    ASSERT_EQ(cache.getAllOrders().size(), 1);
+}
+
+// Test K1: The SPSC ring is a bounded FIFO between two threads
+TEST(SpscRingTest, K1_SpscRingTest_BoundedFifo)
+{
+    SpscRing<std::string> ring(3);
+    ASSERT_EQ(ring.capacity(), 4);
+    for (auto i = 0; i != 4; ++i)
+    {
+        auto value = std::to_string(i);
+        ASSERT_TRUE(ring.try_push(value));
+    }
+    std::string rejected = "4";
+    ASSERT_FALSE(ring.try_push(rejected));
+    ASSERT_EQ(rejected, "4");
+    ASSERT_EQ(ring.try_pop(), "0");
+
+    SpscRing<int> numbers(64);
+    std::thread producer([&numbers]()
+                         {
+                             for (auto i = 0; i != 100000; ++i)
+                                 while (numbers.try_push(i) == false)
+                                     std::this_thread::yield(); });
+    for (auto expected = 0; expected != 100000;)
+    {
+        if (auto value = numbers.try_pop())
+            ASSERT_EQ(*value, expected++);
+        else
+            std::this_thread::yield();
+    }
+    producer.join();
+    ASSERT_TRUE(numbers.empty());
+}
+
+// Test K2: Partitions apply routed and scattered commands like a single cache
+TEST(PartitionedOrderCacheTest, K2_PartitionedOrderCacheTest_Producers)
+{
+    PartitionedOrderCache cache({4, false, 16});
+    ASSERT_EQ(cache.partitionCount(), 4);
+
+    std::vector<std::thread> threads;
+    for (auto t = 0; t != 3; ++t)
+        threads.emplace_back([&cache, t]()
+                             {
+                                 auto producer = cache.producer();
+                                 for (auto i = 0; i != 200; ++i)
+                                     producer.addOrder(Order{std::to_string(t) + "_" + std::to_string(i), "SecId" + std::to_string(t) + "_" + std::to_string(i % 10),
+                                                             i % 2 == 0 ? "Buy" : "Sell", 100, "User" + std::to_string(i % 4), "Company" + std::to_string(i % 3)});
+                                 producer.cancelOrder(std::to_string(t) + "_0");
+                                 producer.flush(); });
+    for (auto &thread : threads)
+        thread.join();
+
+    // the same orders in one cache
+    OrderCache expected;
+    for (auto t = 0; t != 3; ++t)
+    {
+        for (auto i = 0; i != 200; ++i)
+            expected.addOrder(Order{std::to_string(t) + "_" + std::to_string(i), "SecId" + std::to_string(t) + "_" + std::to_string(i % 10),
+                                    i % 2 == 0 ? "Buy" : "Sell", 100, "User" + std::to_string(i % 4), "Company" + std::to_string(i % 3)});
+        expected.cancelOrder(std::to_string(t) + "_0");
+    }
+
+    auto compare = [&]()
+    {
+        ASSERT_EQ(cache.getAllOrders().size(), expected.getAllOrders().size());
+        for (auto t = 0; t != 3; ++t)
+            for (auto s = 0; s != 10; ++s)
+            {
+                const auto security = "SecId" + std::to_string(t) + "_" + std::to_string(s);
+                ASSERT_EQ(cache.getMatchingSizeForSecurity(security), expected.getMatchingSizeForSecurity(security));
+            }
+    };
+    compare();
+    ASSERT_EQ(cache.getAllOrders().size(), 3 * 199);
+
+    cache.cancelOrdersForUser("User1");
+    expected.cancelOrdersForUser("User1");
+    cache.cancelOrdersForSecIdWithMinimumQty("SecId1_2", 100);
+    expected.cancelOrdersForSecIdWithMinimumQty("SecId1_2", 100);
+    compare();
+}
+
+// Test L1: Another mapping of the shared segment reads what the cache publishes
+TEST(SharedSegmentTest, L1_SharedSegmentTest_CachePublishes)
+{
+    const auto name = "/ordercache_L1_" + std::to_string(getpid());
+    SharedSegmentWriter segment(name, 2, 8);
+
+    OrderCache cache;
+    cache.addOrder(Order{"OrdId1", "SecId1", "Buy", 1000, "User1", "CompanyA"});
+    cache.setSharedSegment(&segment);
+
+    const SharedSegmentReader reader(name);
+    ASSERT_EQ(reader.size(), 1);
+    ASSERT_EQ(reader.read(0).buy_qty, 1000);
+    ASSERT_FALSE(reader.read("SecId2").has_value());
+
+    cache.addOrder(Order{"OrdId2", "SecId1", "Sell", 300, "User2", "CompanyB"});
+    cache.addOrder(Order{"OrdId3", "SecId2", "Sell", 200, "User2", "CompanyB"});
+    auto values = reader.read("SecId1");
+    ASSERT_TRUE(values.has_value());
+    ASSERT_EQ(values->matching_size, 300);
+    ASSERT_EQ(values->buy_orders, 1);
+    ASSERT_EQ(values->sell_orders, 1);
+    ASSERT_EQ(values->sell_qty, 300);
+    ASSERT_EQ(reader.read("SecId2")->sell_qty, 200);
+    ASSERT_EQ(reader.securityId(*reader.find("SecId2")), "SecId2");
+
+    cache.cancelOrdersForUser("User2");
+    ASSERT_EQ(reader.read("SecId1")->matching_size, 0);
+    ASSERT_EQ(reader.read("SecId2")->sell_orders, 0);
+
+    // no room left for a third security
+    cache.addOrder(Order{"OrdId4", "SecId3", "Buy", 100, "User1", "CompanyA"});
+    cache.addOrder(Order{"OrdId5", "SecId3", "Buy", 100, "User1", "CompanyA"});
+    ASSERT_EQ(reader.size(), 2);
+    ASSERT_EQ(reader.overflow(), 1);
+    ASSERT_FALSE(reader.read("SecId3").has_value());
+
+    ASSERT_THROW(SharedSegmentReader("/ordercache_L1_missing"), std::runtime_error);
+}
+
+// Test L2: Readers never see a partially written slot
+TEST(SharedSegmentTest, L2_SharedSegmentTest_SeqlockReads)
+{
+    const auto name = "/ordercache_L2_" + std::to_string(getpid());
+    SharedSegmentWriter segment(name, 16);
+    const auto slot = segment.intern("SecId1");
+    ASSERT_EQ(segment.intern("SecId1"), slot);
+
+    std::atomic<bool> stop{false};
+    std::thread writer([&]()
+                       {
+                           for (uint64_t i = 1; stop == false; ++i)
+                               segment.publish(slot, {i, i, i, i, static_cast<unsigned int>(i)}); });
+
+    const SharedSegmentReader reader(name);
+    for (auto i = 0; i != 200000; ++i)
+    {
+        const auto values = reader.read(slot);
+        ASSERT_EQ(values.buy_orders, values.sell_orders);
+        ASSERT_EQ(values.buy_orders, values.buy_qty);
+        ASSERT_EQ(values.buy_orders, values.sell_qty);
+        ASSERT_EQ(static_cast<unsigned int>(values.buy_orders), values.matching_size);
+    }
+    stop = true;
+    writer.join();
+}
+
+// Test B1: Bulk loads end up in the same state as adding the orders one by one
+TEST(BulkLoadTest, B1_BulkLoadTest_EquivalentToAddOrder)
+{
+    // first example from README.txt, built in one go and loaded on top of
+    // orders already there
+    std::vector<Order> example{
+        Order{"OrdId1", "SecId1", "Buy", 1000, "User1", "CompanyA"},
+        Order{"OrdId2", "SecId2", "Sell", 3000, "User2", "CompanyB"},
+        Order{"OrdId3", "SecId1", "Sell", 500, "User3", "CompanyA"},
+        Order{"OrdId4", "SecId2", "Buy", 600, "User4", "CompanyC"},
+        Order{"OrdId5", "SecId2", "Buy", 100, "User5", "CompanyB"},
+        Order{"OrdId6", "SecId3", "Buy", 1000, "User6", "CompanyD"},
+        Order{"OrdId7", "SecId2", "Buy", 2000, "User7", "CompanyE"},
+        Order{"OrdId8", "SecId2", "Sell", 5000, "User8", "CompanyE"}};
+
+    OrderCache built(std::vector<Order>(example), {3, 8, 5, 4});
+    ASSERT_EQ(built.getMatchingSizeForSecurity("SecId1"), 0);
+    ASSERT_EQ(built.getMatchingSizeForSecurity("SecId2"), 2700);
+    ASSERT_EQ(built.getAllOrders().size(), 8);
+
+    OrderCache loaded;
+    loaded.addOrder(example[0]);
+    loaded.addOrder(example[1]);
+    loaded.load(std::vector<Order>(example.begin() + 2, example.end()));
+    ASSERT_EQ(loaded.getMatchingSizeForSecurity("SecId2"), 2700);
+    ASSERT_EQ(loaded.getTopMatchingSecurities(5).size(), 1);
+
+    // many securities matched on several threads
+    using Cache = BasicOrderCache<ShardedLockPolicy<>, NoRestrictionMatchPolicy>;
+    std::vector<Order> orders;
+    std::mt19937 random(42);
+    for (auto i = 0; i != 3000; ++i)
+        orders.push_back(Order{"OrdId" + std::to_string(i), "SecId" + std::to_string(random() % 40), random() % 2 == 0 ? "Buy" : "Sell",
+                               static_cast<unsigned int>(100 + random() % 10 * 100), "User" + std::to_string(random() % 9), "Company" + std::to_string(random() % 4)});
+
+    Cache expected;
+    for (const auto &order : orders)
+        expected.addOrder(order);
+
+    Cache cache(std::move(orders), {40, 9, 4, 4});
+    ASSERT_EQ(cache.getAllOrders().size(), 3000);
+    for (auto s = 0; s != 40; ++s)
+    {
+        const auto security_id = "SecId" + std::to_string(s);
+        const auto aggregates = cache.getSecurityAggregates(security_id);
+        const auto expected_aggregates = expected.getSecurityAggregates(security_id);
+        ASSERT_EQ(aggregates.buy_orders, expected_aggregates.buy_orders);
+        ASSERT_EQ(aggregates.sell_qty, expected_aggregates.sell_qty);
+        ASSERT_EQ(aggregates.matching_size, expected_aggregates.matching_size);
+        ASSERT_EQ(aggregates.matching_size, std::min(aggregates.buy_qty, aggregates.sell_qty));
+    }
+    for (auto u = 0; u != 9; ++u)
+        ASSERT_EQ(cache.getUserAggregates("User" + std::to_string(u)).open_qty(), expected.getUserAggregates("User" + std::to_string(u)).open_qty());
+    ASSERT_EQ(cache.getTopMatchingSecurities(40), expected.getTopMatchingSecurities(40));
+}
+
+// Test Y1: Lazy matching defers the work to the next read and agrees with eager matching
+TEST(LazyMatchingTest, Y1_LazyMatchingTest_DeferredUntilRead)
+{
+    OrderCache cache;
+    cache.setMatchingMode(MatchingMode::Lazy);
+
+    cache.addOrder(Order{"OrdId1", "SecId1", "Buy", 1000, "User1", "CompanyA"});
+    cache.addOrder(Order{"OrdId2", "SecId2", "Sell", 3000, "User2", "CompanyB"});
+    cache.addOrder(Order{"OrdId3", "SecId1", "Sell", 500, "User3", "CompanyA"});
+    cache.addOrder(Order{"OrdId4", "SecId2", "Buy", 600, "User4", "CompanyC"});
+    cache.addOrder(Order{"OrdId5", "SecId2", "Buy", 100, "User5", "CompanyB"});
+    cache.addOrder(Order{"OrdId6", "SecId3", "Buy", 1000, "User6", "CompanyD"});
+    cache.addOrder(Order{"OrdId7", "SecId2", "Buy", 2000, "User7", "CompanyE"});
+    cache.addOrder(Order{"OrdId8", "SecId2", "Sell", 5000, "User8", "CompanyE"});
+    ASSERT_EQ(cache.stats()[StatsCounter::MatchOrderCalls], 0);
+    ASSERT_EQ(cache.stats()[StatsCounter::MatchingDeferred], 8);
+
+    ASSERT_EQ(cache.getMatchingSizeForSecurity("SecId2"), 2700);
+    ASSERT_EQ(cache.getMatchingSizeForSecurity("SecId2"), 2700);
+    ASSERT_EQ(cache.stats()[StatsCounter::MatchRefreshes], 1);
+
+    cache.cancelOrder("OrdId8");
+    cache.amendOrderQty("OrdId7", 1000);
+    ASSERT_EQ(cache.getSecurityAggregates("SecId2").sell_unmatched_qty, 1400);
+    ASSERT_EQ(cache.getMatchingSizeForSecurity("SecId2"), 1600);
+    ASSERT_EQ(cache.refreshMatches(), 2); // SecId1 and SecId3, never read
+    ASSERT_EQ(cache.refreshMatches(), 0);
+    cache.addOrder(Order{"OrdId9", "SecId1", "Buy", 500, "User9", "CompanyF"});
+    ASSERT_EQ(cache.getTopMatchingSecurities(3), (std::vector<std::pair<std::string, unsigned int>>{{"SecId2", 1600}, {"SecId1", 500}}));
+
+    // the same random history, lazily and eagerly
+    using Cache = BasicOrderCache<ShardedLockPolicy<>, NoRestrictionMatchPolicy>;
+    Cache lazy, eager;
+    lazy.setMatchingMode(MatchingMode::Lazy);
+    std::mt19937 random(7);
+    std::vector<std::string> order_ids;
+    for (auto i = 0; i != 2000; ++i)
+    {
+        const auto security_id = "SecId" + std::to_string(random() % 10);
+        const auto action = random() % 4;
+        if (action < 2 && order_ids.empty() == false)
+        {
+            const auto index = random() % order_ids.size();
+            const auto qty = static_cast<unsigned int>(action == 0 ? 0 : 100 + random() % 5 * 100);
+            ASSERT_EQ(lazy.amendOrderQty(order_ids[index], qty), eager.amendOrderQty(order_ids[index], qty));
+            if (qty == 0)
+                order_ids.erase(order_ids.begin() + index);
+        }
+        else
+        {
+            order_ids.push_back("OrdId" + std::to_string(i));
+            Order order{order_ids.back(), security_id, random() % 2 == 0 ? "Buy" : "Sell", 100, "User1", "CompanyA"};
+            lazy.addOrder(order);
+            eager.addOrder(order);
+        }
+        if (i % 97 == 0)
+        {
+            ASSERT_EQ(lazy.getMatchingSizeForSecurity(security_id), eager.getMatchingSizeForSecurity(security_id));
+        }
+    }
+    ASSERT_GT(lazy.stats()[StatsCounter::OrdersCancelled], 100);
+    for (auto s = 0; s != 10; ++s)
+        ASSERT_EQ(lazy.getMatchingSizeForSecurity("SecId" + std::to_string(s)), eager.getMatchingSizeForSecurity("SecId" + std::to_string(s)));
+
+    // snapshots hold re-matched securities
+    lazy.addOrder(Order{"OrdIdX", "SecId0", "Sell", 100, "User1", "CompanyA"});
+    eager.addOrder(Order{"OrdIdX", "SecId0", "Sell", 100, "User1", "CompanyA"});
+    const auto path = ::testing::TempDir() + "Y1.snapshot";
+    lazy.saveSnapshot(path);
+    Cache loaded;
+    loaded.loadSnapshot(path);
+    std::remove(path.c_str());
+    ASSERT_EQ(loaded.getMatchingSizeForSecurity("SecId0"), eager.getMatchingSizeForSecurity("SecId0"));
+}
+
+// Test Y2: The refresh thread re-matches dirty securities in the background
+TEST(LazyMatchingTest, Y2_LazyMatchingTest_RefreshThread)
+{
+    OrderCache cache;
+    cache.setMatchingMode(MatchingMode::Lazy);
+    cache.startRefreshThread(std::chrono::milliseconds(1));
+
+    cache.addOrder(Order{"OrdId1", "SecId1", "Buy", 1000, "User1", "CompanyA"});
+    cache.addOrder(Order{"OrdId2", "SecId1", "Sell", 400, "User2", "CompanyB"});
+    for (auto i = 0; i != 5000 && cache.stats()[StatsCounter::MatchRefreshes] == 0; ++i)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    ASSERT_EQ(cache.stats()[StatsCounter::MatchRefreshes], 1);
+    ASSERT_EQ(cache.getMatchingSizeForSecurity("SecId1"), 400);
+    cache.stopRefreshThread();
+
+    // back to eager: dirty securities are re-matched first
+    cache.addOrder(Order{"OrdId3", "SecId1", "Sell", 400, "User3", "CompanyC"});
+    cache.setMatchingMode(MatchingMode::Eager);
+    ASSERT_EQ(cache.stats()[StatsCounter::MatchRefreshes], 2);
+    cache.addOrder(Order{"OrdId4", "SecId1", "Sell", 400, "User4", "CompanyD"});
+    ASSERT_EQ(cache.getMatchingSizeForSecurity("SecId1"), 1000);
+    ASSERT_EQ(cache.stats()[StatsCounter::MatchRefreshes], 2);
+}
+
+// Test Y3: Bulk loads matched on several threads in lazy mode agree with eager matching
+TEST(LazyMatchingTest, Y3_LazyMatchingTest_ParallelLoad)
+{
+    // securities share OrderCache's single shard, and its dirty list
+    std::vector<Order> orders;
+    std::mt19937 random(11);
+    for (auto i = 0; i != 3000; ++i)
+        orders.push_back(Order{"OrdId" + std::to_string(i), "SecId" + std::to_string(random() % 40), random() % 2 == 0 ? "Buy" : "Sell",
+                               static_cast<unsigned int>(100 + random() % 10 * 100), "User" + std::to_string(random() % 9), "Company" + std::to_string(random() % 4)});
+
+    OrderCache eager(std::vector<Order>(orders), {40, 9, 4, 1});
+    OrderCache lazy;
+    lazy.setMatchingMode(MatchingMode::Lazy);
+    lazy.load(std::move(orders), {0, 0, 0, 8});
+    ASSERT_EQ(lazy.stats()[StatsCounter::MatchOrderCalls], 0);
+
+    ASSERT_EQ(lazy.refreshMatches(), 40);
+    for (auto s = 0; s != 40; ++s)
+        ASSERT_EQ(lazy.getMatchingSizeForSecurity("SecId" + std::to_string(s)), eager.getMatchingSizeForSecurity("SecId" + std::to_string(s)));
+    ASSERT_EQ(lazy.getTopMatchingSecurities(40), eager.getTopMatchingSecurities(40));
+}
+
+// Test V1: Requests to a gateway, one at a time and pipelined
+TEST(GatewayTest, V1_GatewayTest_RoundTrips)
+{
+    const auto path = "/tmp/ordercache_test_" + std::to_string(getpid()) + ".sock";
+    BasicOrderCache<NullLockPolicy> cache; // only used by the gateway thread
+    OrderGateway gateway(cache, path);
+    std::thread server([&gateway]()
+                       { gateway.run(); });
+
+    {
+        GatewayClient client(path);
+        client.addOrder(Order{"OrdId1", "SecId1", "Buy", 1000, "User1", "CompanyA"});
+        client.addOrder(Order{"OrdId2", "SecId2", "Sell", 3000, "User2", "CompanyB"});
+        client.addOrder(Order{"OrdId3", "SecId1", "Sell", 500, "User3", "CompanyA"});
+        client.addOrder(Order{"OrdId4", "SecId2", "Buy", 600, "User4", "CompanyC"});
+        client.addOrder(Order{"OrdId5", "SecId2", "Buy", 100, "User5", "CompanyB"});
+        client.addOrder(Order{"OrdId6", "SecId3", "Buy", 1000, "User6", "CompanyD"});
+        client.addOrder(Order{"OrdId7", "SecId2", "Buy", 2000, "User7", "CompanyE"});
+        client.addOrder(Order{"OrdId8", "SecId2", "Sell", 5000, "User8", "CompanyE"});
+        ASSERT_EQ(client.getMatchingSizeForSecurity("SecId1"), 0);
+        ASSERT_EQ(client.getMatchingSizeForSecurity("SecId2"), 2700);
+
+        client.cancelOrder("OrdId8");
+        ASSERT_EQ(client.getMatchingSizeForSecurity("SecId2"), 2600);
+        client.cancelOrdersForUser("User2");
+        client.cancelOrdersForSecIdWithMinimumQty("SecId1", 1000);
+
+        const auto orders = client.getAllOrders();
+        const auto expected = cache.getAllOrders();
+        ASSERT_EQ(orders.size(), 5);
+        ASSERT_EQ(orders.size(), expected.size());
+        for (size_t i = 0; i != orders.size(); ++i)
+        {
+            ASSERT_EQ(orders[i].orderId(), expected[i].orderId());
+            ASSERT_EQ(orders[i].securityId(), expected[i].securityId());
+            ASSERT_EQ(orders[i].side(), expected[i].side());
+            ASSERT_EQ(orders[i].qty(), expected[i].qty());
+            ASSERT_EQ(orders[i].user(), expected[i].user());
+            ASSERT_EQ(orders[i].company(), expected[i].company());
+        }
+
+        // pipelined: answered in order, from a few reads
+        const auto before = gateway.stats();
+        std::vector<uint32_t> tags;
+        for (auto i = 0; i != 100; ++i)
+            tags.push_back(client.queueAddOrder("P" + std::to_string(i), "SecId4", i % 2 == 0 ? "Buy" : "Sell", 10, "User" + std::to_string(i), "Company" + std::to_string(i)));
+        tags.push_back(client.queueGetMatchingSizeForSecurity("SecId4"));
+        client.flush();
+
+        for (const auto tag : tags)
+        {
+            const auto response = client.readResponse();
+            ASSERT_EQ(response.tag, tag);
+            ASSERT_EQ(response.status, GatewayStatus::Ok);
+            if (tag == tags.back())
+            {
+                ASSERT_EQ(GatewayClient::matchingSize(response), 500);
+            }
+        }
+
+        const auto after = gateway.stats();
+        ASSERT_EQ(after.requests - before.requests, 101);
+        ASSERT_LT(after.reads - before.reads, 101);
+        ASSERT_EQ(after.connections, 1);
+    }
+
+    gateway.stop();
+    server.join();
+}
+
+// Test V2: Frames too short for their tag and code close the connection (server) or throw (client)
+TEST(GatewayTest, V2_GatewayTest_MalformedFrames)
+{
+    const auto path = "/tmp/ordercache_test_" + std::to_string(getpid()) + ".sock";
+    BasicOrderCache<NullLockPolicy> cache; // only used by the gateway thread
+    OrderGateway gateway(cache, path);
+    std::thread server([&gateway]()
+                       { gateway.run(); });
+
+    const auto connect_to = [](const std::string &socket_path)
+    {
+        const auto fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        std::strncpy(address.sun_path, socket_path.c_str(), sizeof(address.sun_path) - 1);
+        EXPECT_EQ(connect(fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)), 0);
+        return fd;
+    };
+
+    // a frame of 1 byte, then a valid request that it would swallow
+    std::string frames;
+    const auto put_u32 = [&frames](uint32_t value)
+    { frames.append(reinterpret_cast<const char *>(&value), sizeof(value)); };
+    put_u32(1);
+    frames.push_back(0);
+    put_u32(gateway_frame_header_size - sizeof(uint32_t));
+    put_u32(7);
+    frames.push_back(static_cast<char>(GatewayOp::GetAllOrders));
+
+    const auto fd = connect_to(path);
+    const timeval timeout{5, 0}; // fail rather than wait for an answer
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    ASSERT_EQ(write(fd, frames.data(), frames.size()), static_cast<ssize_t>(frames.size()));
+    char response[64];
+    ASSERT_EQ(read(fd, response, sizeof(response)), 0); // closed, without answering
+    close(fd);
+
+    // the server still serves other connections
+    {
+        GatewayClient client(path);
+        client.addOrder(Order{"OrdId1", "SecId1", "Buy", 1000, "User1", "CompanyA"});
+        ASSERT_EQ(client.getAllOrders().size(), 1);
+    }
+    gateway.stop();
+    server.join();
+
+    // a server answering with the same frames
+    const auto fake_path = path + ".fake";
+    const auto listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, fake_path.c_str(), sizeof(address.sun_path) - 1);
+    unlink(fake_path.c_str());
+    ASSERT_EQ(bind(listen_fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)), 0);
+    ASSERT_EQ(listen(listen_fd, 1), 0);
+    {
+        GatewayClient client(fake_path);
+        const auto server_fd = accept(listen_fd, nullptr, nullptr);
+        ASSERT_EQ(write(server_fd, frames.data(), frames.size()), static_cast<ssize_t>(frames.size()));
+        ASSERT_THROW(client.readResponse(), std::runtime_error);
+        close(server_fd);
+    }
+    close(listen_fd);
+    unlink(fake_path.c_str());
+}
+
+// Test V3: Requests pipelined before the client shuts down its side are all answered
+TEST(GatewayTest, V3_GatewayTest_HalfClose)
+{
+    const auto path = "/tmp/ordercache_test_" + std::to_string(getpid()) + ".sock";
+    BasicOrderCache<NullLockPolicy> cache; // only used by the gateway thread, once started
+    cache.addOrder(Order{"OrdId1", "SecId1", "Buy", 1000, "User1", "CompanyA"});
+    cache.addOrder(Order{"OrdId2", "SecId1", "Sell", 400, "User2", "CompanyB"});
+    OrderGateway gateway(cache, path);
+
+    std::string frames;
+    const auto put_u32 = [&frames](uint32_t value)
+    { frames.append(reinterpret_cast<const char *>(&value), sizeof(value)); };
+    const auto put_request = [&](uint32_t tag, GatewayOp op, const std::string &id)
+    {
+        put_u32(static_cast<uint32_t>(gateway_frame_header_size - sizeof(uint32_t) + sizeof(uint16_t) + id.size()));
+        put_u32(tag);
+        frames.push_back(static_cast<char>(op));
+        const auto id_size = static_cast<uint16_t>(id.size());
+        frames.append(reinterpret_cast<const char *>(&id_size), sizeof(id_size));
+        frames += id;
+    };
+
+    // 64 KiB of requests (the server's reads), all received with the end of
+    // the stream before the server starts
+    const auto request_size = gateway_frame_header_size + sizeof(uint16_t); // without its id
+    put_request(1, GatewayOp::CancelOrder, "OrdId1");
+    put_request(2, GatewayOp::CancelOrdersForUser, std::string(65536 - frames.size() - 2 * request_size - 3, 'U'));
+    put_request(3, GatewayOp::GetMatchingSizeForSecurity, "Sec");
+    ASSERT_EQ(frames.size(), 65536);
+
+    const auto fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+    ASSERT_EQ(connect(fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)), 0);
+    const timeval timeout{5, 0}; // fail rather than wait forever
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    ASSERT_EQ(write(fd, frames.data(), frames.size()), static_cast<ssize_t>(frames.size()));
+    ASSERT_EQ(shutdown(fd, SHUT_WR), 0);
+
+    std::thread server([&gateway]()
+                       { gateway.run(); });
+
+    // every response, then the server closes the connection
+    std::string responses;
+    char buffer[4096];
+    ssize_t bytes;
+    while ((bytes = read(fd, buffer, sizeof(buffer))) > 0)
+        responses.append(buffer, static_cast<size_t>(bytes));
+    ASSERT_EQ(bytes, 0);
+    close(fd);
+    gateway.stop();
+    server.join();
+
+    std::vector<uint32_t> tags;
+    for (size_t begin = 0; begin + gateway_frame_header_size <= responses.size();)
+    {
+        uint32_t size, tag;
+        std::memcpy(&size, responses.data() + begin, sizeof(size));
+        std::memcpy(&tag, responses.data() + begin + sizeof(size), sizeof(tag));
+        tags.push_back(tag);
+        begin += sizeof(size) + size;
+    }
+    ASSERT_EQ(tags, (std::vector<uint32_t>{1, 2, 3}));
+    ASSERT_EQ(cache.getAllOrders().size(), 1);
+}
+
+// Test I1: A consumer following the change feed keeps an exact copy of the orders
+TEST(ChangeFeedTest, I1_ChangeFeedTest_FollowCache)
+{
+    // orders of the copy by id, with their unmatched qty
+    using Copy = std::map<std::string, OrderChange>;
+    const auto apply = [](Copy &copy, const OrderChanges &changes)
+    {
+        for (const auto &change : changes.changes)
+            if (change.type == OrderChangeType::Cancelled)
+                copy.erase(change.order_id);
+            else
+                copy[change.order_id] = change;
+    };
+    const auto matching_size = [](const Copy &copy, const std::string &security_id)
+    {
+        unsigned int size = 0;
+        for (const auto &[order_id, change] : copy)
+            if (change.security_id == security_id && change.side == "Buy")
+                size += change.qty - change.unmatched;
+        return size;
+    };
+
+    for (const auto mode : {MatchingMode::Eager, MatchingMode::Lazy})
+    {
+        OrderCache cache;
+        cache.setMatchingMode(mode);
+        ChangeFeed feed(1 << 12);
+        cache.setChangeFeed(&feed);
+
+        Copy copy;
+        uint64_t version = feed.version();
+        std::mt19937 random(11);
+        std::vector<std::string> order_ids;
+        for (auto i = 0; i != 3000; ++i)
+        {
+            const auto security_id = "SecId" + std::to_string(random() % 5);
+            const auto action = random() % 6;
+            if (action < 2 && order_ids.empty() == false)
+            {
+                const auto index = random() % order_ids.size();
+                const auto qty = static_cast<unsigned int>(action == 0 ? 0 : 100 + random() % 5 * 100);
+                cache.amendOrderQty(order_ids[index], qty);
+                if (qty == 0)
+                    order_ids.erase(order_ids.begin() + index);
+            }
+            else if (action == 2 && order_ids.empty() == false)
+            {
+                const auto index = random() % order_ids.size();
+                cache.cancelOrder(order_ids[index]);
+                order_ids.erase(order_ids.begin() + index);
+            }
+            else
+            {
+                order_ids.push_back("OrdId" + std::to_string(i));
+                cache.addOrder(Order{order_ids.back(), security_id, random() % 2 == 0 ? "Buy" : "Sell", 100 + static_cast<unsigned int>(random() % 10) * 100,
+                                     "User" + std::to_string(random() % 3), "Company" + std::to_string(random() % 3)});
+            }
+
+            if (i % 50 == 0)
+            {
+                // the matching sizes are read first, for lazy mode to re-match
+                std::vector<unsigned int> sizes;
+                for (auto s = 0; s != 5; ++s)
+                    sizes.push_back(cache.getMatchingSizeForSecurity("SecId" + std::to_string(s)));
+
+                const auto changes = feed.getChangesSince(version);
+                ASSERT_FALSE(changes.resync);
+                ASSERT_EQ(changes.version, feed.version());
+                apply(copy, changes);
+                version = changes.version;
+
+                for (auto s = 0; s != 5; ++s)
+                    ASSERT_EQ(matching_size(copy, "SecId" + std::to_string(s)), sizes[s]);
+                const auto orders = cache.getAllOrders();
+                ASSERT_EQ(copy.size(), orders.size());
+                for (const auto &order : orders)
+                {
+                    const auto it = copy.find(order.orderId());
+                    ASSERT_NE(it, copy.end());
+                    ASSERT_EQ(it->second.qty, order.qty());
+                    ASSERT_EQ(it->second.user, order.user());
+                }
+            }
+        }
+        ASSERT_GT(feed.version(), feed.capacity());
+
+        // a consumer that has fallen too far behind resyncs
+        const auto behind = feed.getChangesSince(version - 1);
+        ASSERT_FALSE(behind.resync);
+        for (auto i = 0; i != 5000; ++i)
+            cache.addOrder(Order{"OrdIdX" + std::to_string(i), "SecId9", "Buy", 100, "User1", "CompanyA"});
+        const auto resync = feed.getChangesSince(version);
+        ASSERT_TRUE(resync.resync);
+        ASSERT_EQ(resync.version, feed.version());
+        ASSERT_EQ(feed.getChangesSince(resync.version - 3, 2).changes.size(), 2);
+        ASSERT_EQ(feed.getChangesSince(resync.version - 3, 2).version, resync.version - 1);
+        ASSERT_EQ(feed.getChangesSince(resync.version).changes.size(), 0);
+        ASSERT_TRUE(feed.getChangesSince(resync.version + 1).resync);
+
+        // and so does every consumer once the feed is attached again
+        cache.setChangeFeed(nullptr);
+        cache.cancelOrder("OrdIdX0");
+        ASSERT_EQ(feed.version(), resync.version);
+        cache.setChangeFeed(&feed);
+        ASSERT_TRUE(feed.getChangesSince(resync.version).resync);
+        ASSERT_FALSE(feed.getChangesSince(feed.version()).resync);
+    }
+
+    ASSERT_THROW(ChangeFeed(0), std::invalid_argument);
+}
+
+// Test X1: The read replica follows the cache through its change feed
+TEST(ReadReplicaTest, X1_ReadReplicaTest_FollowCache)
+{
+    OrderCache cache;
+    ChangeFeed feed(1 << 16);
+    cache.setChangeFeed(&feed);
+    cache.addOrder(Order{"OrdId0", "SecId0", "Buy", 1000, "User1", "CompanyA"});
+
+    ReadReplica replica(cache, feed, std::chrono::microseconds(200));
+    ASSERT_TRUE(replica.waitForVersion(feed.version(), std::chrono::seconds(10)));
+    ASSERT_EQ(replica.resyncs(), 1); // loaded from the cache when started
+
+    std::mt19937 random(5);
+    std::vector<std::string> order_ids{"OrdId0"};
+    for (auto i = 1; i != 2000; ++i)
+    {
+        const auto action = random() % 5;
+        if (action == 0 && order_ids.empty() == false)
+        {
+            const auto index = random() % order_ids.size();
+            cache.cancelOrder(order_ids[index]);
+            order_ids.erase(order_ids.begin() + index);
+        }
+        else if (action == 1 && order_ids.empty() == false)
+            cache.amendOrderQty(order_ids[random() % order_ids.size()], 100 + static_cast<unsigned int>(random() % 10) * 100);
+        else
+        {
+            order_ids.push_back("OrdId" + std::to_string(i));
+            cache.addOrder(Order{order_ids.back(), "SecId" + std::to_string(random() % 8), random() % 2 == 0 ? "Buy" : "Sell",
+                                 100 + static_cast<unsigned int>(random() % 10) * 100, "User" + std::to_string(random() % 3), "Company" + std::to_string(random() % 3)});
+        }
+    }
+
+    ASSERT_TRUE(replica.waitForVersion(feed.version(), std::chrono::seconds(10)));
+    ASSERT_EQ(replica.staleness(), 0);
+    for (auto s = 0; s != 9; ++s)
+    {
+        const auto security_id = "SecId" + std::to_string(s);
+        const auto expected = cache.getSecurityAggregates(security_id);
+        const auto aggregates = replica.getSecurityAggregates(security_id);
+        ASSERT_EQ(replica.getMatchingSizeForSecurity(security_id), cache.getMatchingSizeForSecurity(security_id));
+        ASSERT_EQ(aggregates.buy_orders, expected.buy_orders);
+        ASSERT_EQ(aggregates.sell_orders, expected.sell_orders);
+        ASSERT_EQ(aggregates.buy_qty, expected.buy_qty);
+        ASSERT_EQ(aggregates.sell_unmatched_qty, expected.sell_unmatched_qty);
+    }
+
+    // sorted by security id, then order id
+    const auto orders = replica.getAllOrders();
+    ASSERT_EQ(orders.size(), order_ids.size());
+    ASSERT_TRUE(std::is_sorted(orders.begin(), orders.end(), [](const auto &a, const auto &b)
+                               { return std::make_pair(a.securityId(), a.orderId()) < std::make_pair(b.securityId(), b.orderId()); }));
+    std::map<std::string, unsigned int> expected_qty;
+    for (const auto &order : cache.getAllOrders())
+        expected_qty[order.orderId()] = order.qty();
+    for (const auto &order : orders)
+        ASSERT_EQ(order.qty(), expected_qty.at(order.orderId()));
+
+    // views stay as they were published
+    const auto view = replica.view();
+    const auto version = view->version;
+    cache.cancelOrdersForUser("User1");
+    cache.setChangeFeed(&feed); // resets the feed, for the replica to resync
+    ASSERT_TRUE(replica.waitForVersion(feed.version(), std::chrono::seconds(10)));
+    ASSERT_EQ(replica.resyncs(), 2);
+    ASSERT_EQ(view->version, version);
+    ASSERT_NE(view->find("SecId1"), nullptr);
+    ASSERT_EQ(view->find("SecId8"), nullptr);
+    ASSERT_EQ(replica.getAllOrders().size(), cache.getAllOrders().size());
+    ASSERT_EQ(replica.getMatchingSizeForSecurity("SecId1"), cache.getMatchingSizeForSecurity("SecId1"));
+}
+
+// Test Z2: Memory usage per kind of container and per security
+TEST(AllocationTest, Z2_AllocationTest_MemoryUsage)
+{
+    OrderCache cache;
+    ASSERT_EQ(cache.memoryUsage().totals.total(), 0);
+
+    // ids longer than the small string buffer, and ids fitting in it
+    cache.addOrder(Order{"OrdId1-with-a-long-order-id", "SecId1", "Buy", 1000, "User1", "CompanyA"});
+    cache.addOrder(Order{"OrdId2", "SecId2", "Sell", 3000, "User2", "CompanyB"});
+    cache.addOrder(Order{"OrdId3", "SecId1", "Sell", 500, "User3", "CompanyB"});
+    cache.addOrder(Order{"OrdId4", "SecId2", "Buy", 600, "User4", "CompanyC"});
+    cache.addOrder(Order{"OrdId5", "SecId2", "Buy", 100, "User5", "CompanyD"});
+    cache.addOrder(Order{"OrdId6", "SecId3", "Buy", 1000, "User6", "CompanyD"});
+
+    const auto usage = cache.memoryUsage();
+    ASSERT_EQ(usage.totals.orders, 6);
+    ASSERT_EQ(usage.totals.match_edges, 3);
+    ASSERT_EQ(usage.totals.strings, std::string("OrdId1-with-a-long-order-id").capacity() + 1);
+    ASSERT_GT(usage.totals.order_maps, 6 * sizeof(Order));
+    ASSERT_GT(usage.totals.order_matches, 0);
+    ASSERT_GT(usage.totals.matches, 0);
+    ASSERT_GT(usage.security_maps, 3 * sizeof(Order));
+    ASSERT_GT(usage.ranking, 0);
+    ASSERT_GT(usage.owners, 0);
+    ASSERT_GE(usage.pool_reserved, usage.totals.order_maps + usage.totals.order_matches + usage.totals.matches + usage.ranking + usage.owners);
+    ASSERT_EQ(usage.bytesPerOrder(), static_cast<double>(usage.total()) / 6);
+    ASSERT_EQ(usage.bytesPerMatchEdge(), static_cast<double>(usage.totals.order_matches + usage.totals.matches) / 3);
+
+    // per security, largest first, adding up to the totals
+    ASSERT_EQ(usage.securities.size(), 3);
+    ASSERT_EQ(usage.securities[0].security_id, "SecId2");
+    ASSERT_EQ(usage.securities[0].orders, 3);
+    ASSERT_EQ(usage.securities[0].match_edges, 2);
+    ASSERT_EQ(usage.securities[2].security_id, "SecId3");
+    ASSERT_EQ(usage.securities[2].match_edges, 0);
+    uint64_t total = 0;
+    for (const auto &security : usage.securities)
+        total += security.total();
+    ASSERT_EQ(total, usage.totals.total());
+
+    // a deep book's maps are promoted to hash tables, and demoted back to
+    // arrays once it shrinks
+    const auto security_usage = [&cache](const std::string &security_id)
+    {
+        for (const auto &security : cache.memoryUsage().securities)
+            if (security.security_id == security_id)
+                return security;
+        return SecurityMemoryUsage{};
+    };
+    for (auto i = 0; i != 64; ++i)
+        cache.addOrder(Order{"Deep" + std::to_string(i), "SecId4", i % 2 == 0 ? "Buy" : "Sell", 100, "User1", i % 2 == 0 ? "CompanyA" : "CompanyB"});
+    const auto deep = security_usage("SecId4");
+    ASSERT_EQ(deep.match_edges, 32);
+    for (auto i = 0; i != 60; ++i)
+        cache.cancelOrder("Deep" + std::to_string(i));
+    const auto shallow = security_usage("SecId4");
+    ASSERT_EQ(shallow.orders, 4);
+    ASSERT_EQ(shallow.match_edges, 2);
+    ASSERT_LT(shallow.order_maps * 4, deep.order_maps);
+    ASSERT_LT(shallow.matches * 4, deep.matches);
+    ASSERT_EQ(cache.getMatchingSizeForSecurity("SecId4"), 200);
+}
+
+// Test Z3: Adaptive hash maps agree with std::unordered_map through promotions and demotions
+TEST(AllocationTest, Z3_AllocationTest_AdaptiveHashMap)
+{
+    TrackingResource<> memory;
+    {
+        AdaptiveHashMap<size_t, std::string> map(&memory);
+        AdaptiveHashMap<size_t, void> set(&memory);
+        std::unordered_map<size_t, std::string> expected;
+
+        std::mt19937 random(3);
+        auto promotions = 0, demotions = 0;
+        for (auto i = 0; i != 20000; ++i)
+        {
+            // the key range drifts between a few keys and many
+            const auto range = i / 2000 % 2 == 0 ? 6 : 40;
+            const size_t key = random() % range;
+            const auto indexed = map.indexed();
+            switch (random() % 4)
+            {
+            case 0:
+            case 1:
+            {
+                const auto [it, inserted] = map.try_emplace(key, "value " + std::to_string(key) + " with a long tail");
+                ASSERT_EQ(inserted, expected.try_emplace(key, it->second).second);
+                ASSERT_EQ(it->first, key);
+                set.insert(key);
+                break;
+            }
+            case 2:
+                ASSERT_EQ(map.erase(key), expected.erase(key));
+                set.erase(key);
+                break;
+            default:
+            {
+                // erase through iterators, as the cancel loops do
+                for (auto it = map.begin(); it != map.end();)
+                    if (it->first % 3 == key % 3)
+                    {
+                        expected.erase(it->first);
+                        it = map.erase(it);
+                    }
+                    else
+                        ++it;
+                map.compact();
+                ASSERT_EQ(map.indexed(), indexed == true && map.size() > 4);
+                break;
+            }
+            }
+            promotions += indexed == false && map.indexed() == true;
+            demotions += indexed == true && map.indexed() == false;
+
+            ASSERT_EQ(map.size(), expected.size());
+            // indexed past SmallSize elements, either way down to half of it
+            if (map.size() > 8)
+            {
+                ASSERT_TRUE(map.indexed());
+            }
+            if (i % 100 == 0)
+            {
+                size_t visited = 0;
+                for (const auto &[k, v] : map)
+                {
+                    ASSERT_EQ(expected.at(k), v);
+                    ++visited;
+                }
+                ASSERT_EQ(visited, expected.size());
+                for (const auto k : set)
+                    ASSERT_EQ(set.count(k), 1);
+            }
+        }
+        ASSERT_GT(promotions, 5);
+        ASSERT_GT(demotions, 5);
+        ASSERT_GT(memory.bytes(), 0);
+
+        // moves keep the elements (and the memory resource)
+        auto moved = std::move(map);
+        ASSERT_EQ(moved.size(), expected.size());
+        ASSERT_EQ(map.size(), 0);
+
+        // emptied maps hold no storage once compacted
+        moved.clear();
+        moved.compact();
+        ASSERT_EQ(moved.capacity(), 0);
+        ASSERT_FALSE(moved.indexed());
+        for (size_t k = 0; k != 40; ++k)
+            set.erase(k);
+        ASSERT_EQ(memory.bytes(), 0);
+    }
+    ASSERT_EQ(memory.bytes(), 0);
+}
+
 int main(int argc, char **argv)
 {
     ::testing::InitGoogleTest(&argc, argv);
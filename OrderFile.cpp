@@ -0,0 +1,150 @@
+#include "OrderFile.h"
+#include "Snapshot.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+namespace
+{
+  inline bool is_blank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+  struct ChunkError
+  {
+    size_t offset = std::string::npos; // of the malformed line in the file
+    const char *what = nullptr;
+  };
+
+  // tokenize the lines in [begin, end) (starting at a line), appending
+  // their records; stops at the first malformed line
+  void tokenize(const char *data, const char *begin, const char *end, std::vector<OrderRecord> &records, ChunkError &error)
+  {
+    auto position = begin;
+    while (position != end)
+    {
+      const auto line = position;
+      auto line_end = static_cast<const char *>(std::memchr(position, '\n', static_cast<size_t>(end - position)));
+      if (line_end == nullptr)
+        line_end = end;
+      position = line_end == end ? end : line_end + 1;
+
+      std::string_view fields[6];
+      size_t count = 0;
+      for (auto p = line; p != line_end;)
+      {
+        while (p != line_end && is_blank(*p) == true)
+          ++p;
+        if (p == line_end)
+          break;
+
+        const auto field = p;
+        while (p != line_end && is_blank(*p) == false)
+          ++p;
+
+        if (count == 6)
+        {
+          count = 7;
+          break;
+        }
+        fields[count++] = {field, static_cast<size_t>(p - field)};
+      }
+
+      if (count == 0)
+        continue;
+
+      auto fail = [&](const char *what)
+      {
+        error.offset = static_cast<size_t>(line - data);
+        error.what = what;
+      };
+
+      if (count != 6)
+        return fail("expected 6 fields: OrdId SecId Side Qty User Company");
+
+      if (fields[2] != "Buy" && fields[2] != "Sell")
+        return fail("side must be Buy or Sell");
+
+      uint64_t qty = 0;
+      for (const auto c : fields[3])
+      {
+        if (c < '0' || c > '9' || (qty = qty * 10 + static_cast<unsigned int>(c - '0')) > UINT32_MAX)
+          return fail("invalid qty");
+      }
+
+      records.push_back(OrderRecord{fields[0], fields[1], fields[2], static_cast<unsigned int>(qty), fields[4], fields[5]});
+    }
+  }
+}
+
+OrderFile::OrderFile(const std::string &path, unsigned int threads, size_t chunk_size)
+    : _file(std::make_unique<MappedFile>(path))
+{
+  const auto data = _file->data();
+  const auto size = _file->size();
+
+  // chunks end after a newline, so that lines aren't split
+  std::vector<const char *> boundaries{data};
+  const auto end = data + size;
+  while (boundaries.back() != end)
+  {
+    auto boundary = boundaries.back() + std::min(std::max<size_t>(chunk_size, 1), static_cast<size_t>(end - boundaries.back()));
+    if (boundary != end)
+    {
+      const auto newline = static_cast<const char *>(std::memchr(boundary, '\n', static_cast<size_t>(end - boundary)));
+      boundary = newline == nullptr ? end : newline + 1;
+    }
+    boundaries.push_back(boundary);
+  }
+
+  const auto chunk_count = boundaries.size() - 1;
+  _chunks.resize(chunk_count);
+  std::vector<ChunkError> errors(chunk_count);
+
+  if (threads == 0)
+    threads = std::max(std::thread::hardware_concurrency(), 1u);
+  threads = static_cast<unsigned int>(std::min<size_t>(threads, chunk_count));
+
+  // threads take the next chunk until there are none left
+  std::atomic<size_t> next_chunk{0};
+  auto worker = [&]()
+  {
+    for (auto chunk = next_chunk++; chunk < chunk_count; chunk = next_chunk++)
+    {
+      // records are roughly 40 bytes long
+      _chunks[chunk].reserve(static_cast<size_t>(boundaries[chunk + 1] - boundaries[chunk]) / 32);
+      tokenize(data, boundaries[chunk], boundaries[chunk + 1], _chunks[chunk], errors[chunk]);
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for (auto t = 1u; t < threads; ++t)
+    workers.emplace_back(worker);
+  worker();
+  for (auto &w : workers)
+    w.join();
+
+  for (const auto &error : errors)
+  {
+    if (error.what != nullptr)
+    {
+      const auto line = 1 + std::count(data, data + error.offset, '\n');
+      throw std::runtime_error("order file " + path + ": line " + std::to_string(line) + ": " + error.what);
+    }
+  }
+}
+
+OrderFile::~OrderFile() = default;
+
+size_t OrderFile::record_count() const
+{
+  size_t count = 0;
+  for (const auto &chunk : _chunks)
+    count += chunk.size();
+  return count;
+}
+
+size_t OrderFile::byte_count() const
+{
+  return _file->size();
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "OrderCache.h"
+
+class MappedFile;
+
+// Text file of orders, one per line in the layout of the examples in
+// assignment/README.txt:
+//
+//   OrdId1 SecId1 Buy  1000 User1 CompanyA
+//
+// (fields separated by spaces/tabs, blank lines ignored, CRLF accepted).
+//
+// The file is memory mapped and split into chunks at line boundaries,
+// which are tokenized (and their strings hashed) on several threads into
+// OrderRecord views of the mapping, to be added with
+// BasicOrderCache::addOrders. The records are only valid while the
+// OrderFile is alive.
+class OrderFile
+{
+public:
+  // threads: number of tokenizing threads (0: one per hardware thread)
+  // chunk_size: approximate size of the chunks tokenized by each thread
+  // Throws std::runtime_error if the file can't be read or has a
+  // malformed line (reporting its line number).
+  explicit OrderFile(const std::string &path, unsigned int threads = 0, size_t chunk_size = 4 << 20);
+  ~OrderFile();
+
+  OrderFile(const OrderFile &) = delete;
+  OrderFile &operator=(const OrderFile &) = delete;
+
+  // records of each chunk, in file order
+  const std::vector<std::vector<OrderRecord>> &chunks() const { return _chunks; }
+
+  size_t record_count() const;
+  size_t byte_count() const;
+
+  // add all the records, chunk by chunk, to a cache
+  template <typename Cache>
+  void addTo(Cache &cache) const
+  {
+    for (const auto &chunk : _chunks)
+      cache.addOrders(chunk);
+  }
+
+private:
+  std::unique_ptr<MappedFile> _file;
+  std::vector<std::vector<OrderRecord>> _chunks;
+};
@@ -0,0 +1,412 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "OrderCacheImpl.h"
+#include "SpscRing.h"
+
+// Shared-nothing order cache: securities are hashed to N partitions, each
+// owning a single threaded cache (BasicOrderCache<NullLockPolicy>) that
+// only its worker thread touches, optionally pinned to its own core.
+//
+// Requests are messages: every client thread gets a Producer, which owns
+// one SPSC ring per partition, so no queue has more than one writer or
+// reader. Operations on one security go to its partition; operations that
+// can involve any security (cancelOrder, cancelOrdersForUser, getAllOrders)
+// are scattered to every partition and, for queries, gathered.
+//
+// Mutations are asynchronous and applied in the order a producer sent them;
+// queries wait for the answer, which reflects everything the producer sent
+// before. There is no journal, snapshot or expiry support in this mode.
+template <typename MatchPolicy = DifferentCompanyMatchPolicy>
+class BasicPartitionedOrderCache : public OrderCacheInterface
+{
+  enum class CommandType : uint8_t
+  {
+    AddOrder,
+    CancelOrder,
+    CancelOrdersForUser,
+    CancelOrdersForSecIdWithMinimumQty,
+    GetMatchingSizeForSecurity,
+    GetAllOrders,
+    Flush,
+  };
+
+  struct Completion;
+  struct Command;
+  using Queue = SpscRing<Command>;
+
+public:
+  using Cache = BasicOrderCache<NullLockPolicy, MatchPolicy>;
+
+  struct Options
+  {
+    size_t partitions = std::max(std::thread::hardware_concurrency(), 1u);
+    bool pin_threads = true;      // pin worker i to core i % cores (Linux only)
+    size_t queue_capacity = 4096; // commands per producer and partition
+  };
+
+  // handle of one client thread: not thread safe, and must be destroyed
+  // before the cache
+  class Producer
+  {
+  public:
+    explicit Producer(BasicPartitionedOrderCache &owner) : _owner(&owner)
+    {
+      for (auto &partition : _owner->_partitions)
+      {
+        _queues.push_back(std::make_shared<Queue>(_owner->_options.queue_capacity));
+        partition->attach(_queues.back());
+      }
+    }
+
+    ~Producer()
+    {
+      if (_owner == nullptr)
+        return;
+
+      flush();
+      for (size_t i = 0; i != _queues.size(); ++i)
+        _owner->_partitions[i]->detach(_queues[i]);
+    }
+
+    Producer(Producer &&other) noexcept : _owner(std::exchange(other._owner, nullptr)), _queues(std::move(other._queues)) {}
+    Producer &operator=(Producer &&) = delete;
+
+    void addOrder(Order order)
+    {
+      const auto partition = _owner->partition_of(order.securityIdHash());
+      push(partition, Command{CommandType::AddOrder, std::move(order)});
+    }
+
+    void cancelOrder(const std::string &orderId) { scatter(CommandType::CancelOrder, orderId); }
+
+    void cancelOrdersForUser(const std::string &user) { scatter(CommandType::CancelOrdersForUser, user); }
+
+    void cancelOrdersForSecIdWithMinimumQty(const std::string &securityId, unsigned int minQty)
+    {
+      push(_owner->partition_of(str_hash{}(securityId)), Command{CommandType::CancelOrdersForSecIdWithMinimumQty, std::nullopt, securityId, minQty});
+    }
+
+    unsigned int getMatchingSizeForSecurity(const std::string &securityId)
+    {
+      auto completion = std::make_shared<Completion>(1);
+      push(_owner->partition_of(str_hash{}(securityId)), Command{CommandType::GetMatchingSizeForSecurity, std::nullopt, securityId, 0, completion});
+      completion->done.get_future().get();
+      return completion->matching_size;
+    }
+
+    std::vector<Order> getAllOrders()
+    {
+      auto completion = scatter(CommandType::GetAllOrders, {}, true);
+      completion->done.get_future().get();
+      return std::move(completion->orders);
+    }
+
+    // wait until every partition has applied what was sent so far
+    void flush() { scatter(CommandType::Flush, {}, true)->done.get_future().get(); }
+
+  private:
+    void push(size_t partition, Command &&command)
+    {
+      while (_queues[partition]->try_push(command) == false)
+        std::this_thread::yield();
+      _owner->_partitions[partition]->wake_if_sleeping();
+    }
+
+    std::shared_ptr<Completion> scatter(CommandType type, const std::string &id, bool wait = false)
+    {
+      std::shared_ptr<Completion> completion;
+      if (wait == true)
+        completion = std::make_shared<Completion>(_queues.size());
+      for (size_t i = 0; i != _queues.size(); ++i)
+        push(i, Command{type, std::nullopt, id, 0, completion});
+      return completion;
+    }
+
+    BasicPartitionedOrderCache *_owner;
+    std::vector<std::shared_ptr<Queue>> _queues; // by partition
+  };
+
+  explicit BasicPartitionedOrderCache(Options options = {}) : _options(options)
+  {
+    _options.partitions = std::max<size_t>(_options.partitions, 1);
+    for (size_t i = 0; i != _options.partitions; ++i)
+      _partitions.push_back(std::make_unique<Partition>());
+
+    const auto cores = std::max(std::thread::hardware_concurrency(), 1u);
+    for (size_t i = 0; i != _partitions.size(); ++i)
+    {
+      auto &partition = *_partitions[i];
+      partition.thread = std::thread([&partition]()
+                                     { partition.run(); });
+      if (_options.pin_threads == true)
+        pin(partition.thread, i % cores);
+    }
+
+    _producer.emplace(*this);
+  }
+
+  // applies the commands sent so far before returning
+  ~BasicPartitionedOrderCache()
+  {
+    _producer.reset();
+    for (auto &partition : _partitions)
+    {
+      partition->stop.store(true);
+      partition->wake();
+    }
+    for (auto &partition : _partitions)
+      partition->thread.join();
+  }
+
+  BasicPartitionedOrderCache(const BasicPartitionedOrderCache &) = delete;
+  BasicPartitionedOrderCache &operator=(const BasicPartitionedOrderCache &) = delete;
+
+  Producer producer() { return Producer(*this); }
+
+  size_t partitionCount() const { return _partitions.size(); }
+
+  // OrderCacheInterface, through a producer shared by the calling threads
+  // (serialized by a mutex): use a Producer per thread for throughput
+  void addOrder(Order order) override
+  {
+    shared([&](Producer &p)
+           { p.addOrder(std::move(order)); });
+  }
+  void cancelOrder(const std::string &orderId) override
+  {
+    shared([&](Producer &p)
+           { p.cancelOrder(orderId); });
+  }
+  void cancelOrdersForUser(const std::string &user) override
+  {
+    shared([&](Producer &p)
+           { p.cancelOrdersForUser(user); });
+  }
+  void cancelOrdersForSecIdWithMinimumQty(const std::string &securityId, unsigned int minQty) override
+  {
+    shared([&](Producer &p)
+           { p.cancelOrdersForSecIdWithMinimumQty(securityId, minQty); });
+  }
+  unsigned int getMatchingSizeForSecurity(const std::string &securityId) override
+  {
+    return shared([&](Producer &p)
+                  { return p.getMatchingSizeForSecurity(securityId); });
+  }
+  std::vector<Order> getAllOrders() const override
+  {
+    return shared([](Producer &p)
+                  { return p.getAllOrders(); });
+  }
+
+private:
+  // answer of a command sent to one or several partitions
+  struct Completion
+  {
+    explicit Completion(size_t partitions) : pending(partitions) {}
+
+    std::atomic<size_t> pending;
+    std::promise<void> done;
+    std::mutex mutex; // orders gathered from several partitions
+    std::vector<Order> orders;
+    unsigned int matching_size = 0;
+
+    void complete()
+    {
+      if (pending.fetch_sub(1) == 1)
+        done.set_value();
+    }
+  };
+
+  struct Command
+  {
+    CommandType type = CommandType::Flush;
+    std::optional<Order> order{}; // AddOrder
+    std::string id{};             // order id, user or security id
+    unsigned int min_qty = 0;
+    std::shared_ptr<Completion> completion{}; // queries and flushes
+  };
+
+  struct Partition
+  {
+    Cache cache;
+    std::thread thread;
+    std::atomic<bool> stop{false};
+
+    // producer queues, copied by the worker when the version changes
+    std::mutex queues_mutex;
+    std::vector<std::shared_ptr<Queue>> queues;
+    std::atomic<uint64_t> queues_version{0};
+
+    std::atomic<bool> sleeping{false};
+    std::mutex wake_mutex;
+    std::condition_variable wake_cv;
+
+    void attach(const std::shared_ptr<Queue> &queue)
+    {
+      std::lock_guard lock(queues_mutex);
+      queues.push_back(queue);
+      queues_version.fetch_add(1);
+    }
+
+    // the queue must be empty (the producer flushed it)
+    void detach(const std::shared_ptr<Queue> &queue)
+    {
+      std::lock_guard lock(queues_mutex);
+      queues.erase(std::find(queues.begin(), queues.end(), queue));
+      queues_version.fetch_add(1);
+    }
+
+    void wake_if_sleeping()
+    {
+      // pairs with the fence in run: either the worker sees the command
+      // before sleeping, or this sees it sleeping and wakes it
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (sleeping.load(std::memory_order_relaxed) == true)
+        wake();
+    }
+
+    void wake()
+    {
+      std::lock_guard lock(wake_mutex);
+      wake_cv.notify_one();
+    }
+
+    void run()
+    {
+      std::vector<std::shared_ptr<Queue>> local_queues;
+      uint64_t version = ~uint64_t{0};
+      unsigned int idle = 0;
+
+      while (true)
+      {
+        if (queues_version.load() != version)
+        {
+          std::lock_guard lock(queues_mutex);
+          local_queues = queues;
+          version = queues_version.load();
+        }
+
+        auto applied = false;
+        for (auto &queue : local_queues)
+        {
+          for (auto n = 0; n != 256; ++n)
+          {
+            auto command = queue->try_pop();
+            if (command.has_value() == false)
+              break;
+            apply(*command);
+            applied = true;
+          }
+        }
+
+        if (applied == true)
+        {
+          idle = 0;
+          continue;
+        }
+
+        if (stop.load() == true)
+          break;
+
+        // spin for a while before sleeping, as commands tend to come in bursts
+        if (++idle < 64)
+        {
+          std::this_thread::yield();
+          continue;
+        }
+
+        std::unique_lock lock(wake_mutex);
+        sleeping.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (std::all_of(local_queues.begin(), local_queues.end(), [](const auto &queue)
+                        { return queue->empty(); }) &&
+            queues_version.load() == version && stop.load() == false)
+          wake_cv.wait_for(lock, std::chrono::milliseconds(10));
+        sleeping.store(false, std::memory_order_relaxed);
+      }
+    }
+
+    void apply(Command &command)
+    {
+      switch (command.type)
+      {
+      case CommandType::AddOrder:
+        cache.addOrder(std::move(*command.order));
+        break;
+      case CommandType::CancelOrder:
+        cache.cancelOrder(command.id);
+        break;
+      case CommandType::CancelOrdersForUser:
+        cache.cancelOrdersForUser(command.id);
+        break;
+      case CommandType::CancelOrdersForSecIdWithMinimumQty:
+        cache.cancelOrdersForSecIdWithMinimumQty(command.id, command.min_qty);
+        break;
+      case CommandType::GetMatchingSizeForSecurity:
+        command.completion->matching_size = cache.getMatchingSizeForSecurity(command.id);
+        break;
+      case CommandType::GetAllOrders:
+      {
+        auto orders = cache.getAllOrders();
+        std::lock_guard lock(command.completion->mutex);
+        auto &gathered = command.completion->orders;
+        gathered.reserve(gathered.size() + orders.size());
+        for (auto &order : orders)
+          gathered.push_back(std::move(order));
+        break;
+      }
+      case CommandType::Flush:
+        break;
+      }
+
+      if (command.completion != nullptr)
+        command.completion->complete();
+    }
+  };
+
+  static void pin(std::thread &thread, size_t core)
+  {
+#if defined(__linux__)
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(core, &cpus);
+    pthread_setaffinity_np(thread.native_handle(), sizeof(cpus), &cpus); // best effort
+#else
+    (void)thread;
+    (void)core;
+#endif
+  }
+
+  size_t partition_of(size_t security_id_hash) const { return security_id_hash % _partitions.size(); }
+
+  template <typename Func>
+  auto shared(Func func) const
+  {
+    std::lock_guard lock(_producer_mutex);
+    return func(*_producer);
+  }
+
+  Options _options;
+  std::vector<std::unique_ptr<Partition>> _partitions;
+
+  mutable std::mutex _producer_mutex;
+  mutable std::optional<Producer> _producer; // for the OrderCacheInterface methods
+};
+
+using PartitionedOrderCache = BasicPartitionedOrderCache<>;
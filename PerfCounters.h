@@ -0,0 +1,159 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Hardware performance counters read as a single perf_event_open group, so
+// all of them cover exactly the same instructions.
+//
+// Opening the counters fails in many containers/VMs (perf_event_paranoid,
+// seccomp, no PMU virtualization): the group then reports itself as
+// unavailable and start()/stop() are no-ops, so callers can always wrap
+// their measurements with it. Counters that can't be opened individually
+// (eg no LLC event on some CPUs) are reported as unavailable on their own.
+class PerfCounters
+{
+public:
+  enum Event
+  {
+    Cycles,
+    Instructions,
+    L1DMisses,
+    LLCMisses,
+    BranchMisses,
+    EventCount
+  };
+
+  struct Sample
+  {
+    std::array<uint64_t, EventCount> values{};
+    std::array<bool, EventCount> available{};
+
+    bool has(Event event) const { return available[event]; }
+    uint64_t operator[](Event event) const { return values[event]; }
+
+    double ipc() const
+    {
+      return has(Cycles) && has(Instructions) && values[Cycles] != 0 ? static_cast<double>(values[Instructions]) / values[Cycles] : 0.0;
+    }
+  };
+
+  PerfCounters()
+  {
+#if defined(__linux__)
+    struct Config
+    {
+      uint32_t type;
+      uint64_t config;
+    };
+
+    constexpr auto l1d_read_miss = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+
+    const Config configs[EventCount] = {
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        {PERF_TYPE_HW_CACHE, l1d_read_miss},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    };
+
+    for (int i = 0; i != EventCount; ++i)
+    {
+      perf_event_attr attr;
+      std::memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      attr.type = configs[i].type;
+      attr.config = configs[i].config;
+      attr.disabled = _leader == -1 ? 1 : 0; // the group is enabled through its leader
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+      const auto fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, _leader, 0));
+      if (fd == -1)
+        continue;
+
+      if (_leader == -1)
+        _leader = fd;
+      _fds[i] = fd;
+      ioctl(fd, PERF_EVENT_IOC_ID, &_ids[i]);
+    }
+#endif
+  }
+
+  ~PerfCounters()
+  {
+#if defined(__linux__)
+    for (const auto fd : _fds)
+      if (fd != -1)
+        close(fd);
+#endif
+  }
+
+  PerfCounters(const PerfCounters &) = delete;
+  PerfCounters &operator=(const PerfCounters &) = delete;
+
+  bool available() const { return _leader != -1; }
+
+  void start()
+  {
+#if defined(__linux__)
+    if (_leader == -1)
+      return;
+    ioctl(_leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(_leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+  }
+
+  Sample stop()
+  {
+    Sample sample;
+#if defined(__linux__)
+    if (_leader == -1)
+      return sample;
+
+    ioctl(_leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+    // layout for PERF_FORMAT_GROUP | PERF_FORMAT_ID | TOTAL_TIME_*
+    struct
+    {
+      uint64_t nr;
+      uint64_t time_enabled;
+      uint64_t time_running;
+      struct
+      {
+        uint64_t value;
+        uint64_t id;
+      } values[EventCount];
+    } data;
+
+    if (read(_leader, &data, sizeof(data)) <= 0 || data.time_running == 0)
+      return sample;
+
+    // scale up if the group was multiplexed with other events
+    const auto scale = static_cast<double>(data.time_enabled) / data.time_running;
+
+    for (uint64_t n = 0; n != data.nr && n != EventCount; ++n)
+      for (int i = 0; i != EventCount; ++i)
+        if (_fds[i] != -1 && _ids[i] == data.values[n].id)
+        {
+          sample.values[i] = static_cast<uint64_t>(data.values[n].value * scale);
+          sample.available[i] = true;
+        }
+#endif
+    return sample;
+  }
+
+private:
+  int _leader = -1;
+  std::array<int, EventCount> _fds{-1, -1, -1, -1, -1};
+  std::array<uint64_t, EventCount> _ids{};
+};
@@ -0,0 +1,201 @@
+#include "ReadReplica.h"
+#include <algorithm>
+
+const ReplicaSecurity *ReplicaView::find(std::string_view security_id) const
+{
+  const auto it = std::lower_bound(securities.begin(), securities.end(), security_id, [](const auto &security, std::string_view id)
+                                   { return security->security_id < id; });
+  return it != securities.end() && (*it)->security_id == security_id ? it->get() : nullptr;
+}
+
+ReadReplica::ReadReplica(ChangeFeed &feed, LoadOrders load_orders, std::chrono::microseconds interval)
+    : _feed(feed), _load_orders(std::move(load_orders)), _view(std::make_shared<ReplicaView>())
+{
+  _update_thread = std::thread([this, interval]()
+                               { update_loop(interval); });
+}
+
+ReadReplica::~ReadReplica()
+{
+  {
+    std::lock_guard lock(_stop_mutex);
+    _stop = true;
+  }
+  _stop_cv.notify_one();
+  _update_thread.join();
+}
+
+std::shared_ptr<const ReplicaView> ReadReplica::view() const
+{
+  std::lock_guard lock(_view_mutex);
+  return _view;
+}
+
+uint64_t ReadReplica::staleness() const
+{
+  // the feed first, so that the difference can't be negative
+  const auto primary_version = _feed.version();
+  const auto replica_version = version();
+  return primary_version > replica_version ? primary_version - replica_version : 0;
+}
+
+uint64_t ReadReplica::resyncs() const
+{
+  std::lock_guard lock(_view_mutex);
+  return _resyncs;
+}
+
+bool ReadReplica::waitForVersion(uint64_t version, std::chrono::milliseconds timeout) const
+{
+  std::unique_lock lock(_view_mutex);
+  return _view_cv.wait_for(lock, timeout, [this, version]()
+                           { return _view->version >= version; });
+}
+
+std::vector<Order> ReadReplica::getAllOrders() const
+{
+  const auto current = view();
+
+  size_t size = 0;
+  for (const auto &security : current->securities)
+    size += security->size();
+
+  std::vector<Order> orders;
+  orders.reserve(size);
+  for (const auto &security : current->securities)
+    for (size_t i = 0; i != security->size(); ++i)
+      orders.emplace_back(security->order_ids[i], security->security_id, security->is_buy[i] ? "Buy" : "Sell", security->qty[i],
+                          security->users[i], security->companies[i]);
+  return orders;
+}
+
+unsigned int ReadReplica::getMatchingSizeForSecurity(std::string_view securityId) const
+{
+  return getSecurityAggregates(securityId).matching_size;
+}
+
+SecurityAggregates ReadReplica::getSecurityAggregates(std::string_view securityId) const
+{
+  const auto current = view();
+  const auto *security = current->find(securityId);
+  return security != nullptr ? security->aggregates : SecurityAggregates{};
+}
+
+void ReadReplica::update_loop(std::chrono::microseconds interval)
+{
+  while (true)
+  {
+    update();
+
+    std::unique_lock lock(_stop_mutex);
+    if (_stop_cv.wait_for(lock, interval, [this]()
+                          { return _stop; }) == true)
+      break;
+  }
+}
+
+bool ReadReplica::update()
+{
+  auto changes = _feed.getChangesSince(_version);
+  if (changes.resync == true)
+  {
+    // the feed has moved on (or was reset): reload every order
+    changes = _load_orders();
+    _books.clear();
+    for (const auto &security : _securities)
+      _changed.insert(security.first);
+    {
+      std::lock_guard lock(_view_mutex);
+      ++_resyncs;
+    }
+  }
+
+  for (const auto &change : changes.changes)
+    apply(change);
+
+  if (changes.version == _version && _changed.empty() == true)
+    return false;
+
+  publish(changes.version);
+  return true;
+}
+
+void ReadReplica::apply(const OrderChange &change)
+{
+  _changed.insert(change.security_id);
+  if (change.type == OrderChangeType::Cancelled)
+  {
+    const auto it = _books.find(change.security_id);
+    if (it != _books.end())
+    {
+      it->second.erase(change.order_id);
+      if (it->second.empty() == true)
+        _books.erase(it);
+    }
+    return;
+  }
+
+  // changes carry the whole state of their order
+  auto &row = _books[change.security_id][change.order_id];
+  row.is_buy = change.side == "Buy";
+  row.qty = change.qty;
+  row.unmatched = change.unmatched;
+  row.user = change.user;
+  row.company = change.company;
+}
+
+void ReadReplica::publish(uint64_t version)
+{
+  // rebuild the columns of the securities that changed only
+  for (const auto &security_id : _changed)
+  {
+    const auto book_it = _books.find(security_id);
+    if (book_it == _books.end())
+    {
+      _securities.erase(security_id);
+      continue;
+    }
+
+    auto security = std::make_shared<ReplicaSecurity>();
+    security->security_id = security_id;
+    const auto &book = book_it->second;
+    security->order_ids.reserve(book.size());
+    security->is_buy.reserve(book.size());
+    security->qty.reserve(book.size());
+    security->unmatched.reserve(book.size());
+    security->users.reserve(book.size());
+    security->companies.reserve(book.size());
+
+    auto &aggregates = security->aggregates;
+    for (const auto &[order_id, row] : book)
+    {
+      security->order_ids.push_back(order_id);
+      security->is_buy.push_back(row.is_buy);
+      security->qty.push_back(row.qty);
+      security->unmatched.push_back(row.unmatched);
+      security->users.push_back(row.user);
+      security->companies.push_back(row.company);
+
+      (row.is_buy ? aggregates.buy_orders : aggregates.sell_orders) += 1;
+      (row.is_buy ? aggregates.buy_qty : aggregates.sell_qty) += row.qty;
+      (row.is_buy ? aggregates.buy_unmatched_qty : aggregates.sell_unmatched_qty) += row.unmatched;
+    }
+    // each match takes the same qty from a buy and a sell order
+    aggregates.matching_size = static_cast<unsigned int>(aggregates.buy_qty - aggregates.buy_unmatched_qty);
+    _securities[security_id] = std::move(security);
+  }
+  _changed.clear();
+  _version = version;
+
+  auto view = std::make_shared<ReplicaView>();
+  view->version = version;
+  view->securities.reserve(_securities.size());
+  for (const auto &security : _securities)
+    view->securities.push_back(security.second);
+
+  {
+    std::lock_guard lock(_view_mutex);
+    _view = std::move(view);
+  }
+  _view_cv.notify_all();
+}
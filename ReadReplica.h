@@ -0,0 +1,131 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "ChangeFeed.h"
+
+// orders of a security in the replica, as columns sorted by order id, with
+// their aggregates computed once per change of the security
+struct ReplicaSecurity
+{
+  std::string security_id;
+  std::vector<std::string> order_ids;
+  std::vector<uint8_t> is_buy;
+  std::vector<unsigned int> qty;
+  std::vector<unsigned int> unmatched;
+  std::vector<std::string> users;
+  std::vector<std::string> companies;
+  SecurityAggregates aggregates;
+
+  size_t size() const { return order_ids.size(); }
+};
+
+// immutable state of the replica at a version of the change feed
+struct ReplicaView
+{
+  uint64_t version = 0;
+  std::vector<std::shared_ptr<const ReplicaSecurity>> securities; // sorted by security id
+
+  // nullptr without open orders
+  const ReplicaSecurity *find(std::string_view security_id) const;
+};
+
+// Read-optimized copy of a cache for analytical reads, kept up to date
+// from a ChangeFeed attached to the cache by a background thread, so that
+// reads never take the cache's locks.
+//
+// Every interval the thread applies the changes since its version to its
+// books (orders by id, per security), rebuilds the columns of the
+// securities that changed and publishes a new ReplicaView, sharing the
+// unchanged securities with the previous one. Readers take the latest
+// view (a shared_ptr copy) and query it without blocking the thread. When
+// the feed asks to resync, the books are reloaded from the cache's
+// getOrderStates().
+//
+// The replica is as recent as the last published view: staleness() is the
+// number of changes of the feed it hasn't published yet. In lazy mode, the
+// matched qty of dirty securities is the one from before they got dirty,
+// until the cache re-matches them.
+class ReadReplica
+{
+public:
+  using LoadOrders = std::function<OrderChanges()>;
+
+  template <typename Cache>
+  ReadReplica(const Cache &primary, ChangeFeed &feed, std::chrono::microseconds interval = std::chrono::milliseconds(1))
+      : ReadReplica(feed, [&primary]()
+                    { return primary.getOrderStates(); },
+                    interval)
+  {
+  }
+
+  // load_orders returns the state of every order at a version of the feed
+  ReadReplica(ChangeFeed &feed, LoadOrders load_orders, std::chrono::microseconds interval = std::chrono::milliseconds(1));
+  ~ReadReplica();
+
+  ReadReplica(const ReadReplica &) = delete;
+  ReadReplica &operator=(const ReadReplica &) = delete;
+
+  // the latest published view, for several consistent reads
+  std::shared_ptr<const ReplicaView> view() const;
+
+  uint64_t version() const { return view()->version; }
+  uint64_t primaryVersion() const { return _feed.version(); }
+  uint64_t staleness() const;
+  uint64_t resyncs() const;
+
+  // wait until a view at (or after) `version` is published; false on timeout
+  bool waitForVersion(uint64_t version, std::chrono::milliseconds timeout) const;
+
+  // orders sorted by security id, then order id
+  std::vector<Order> getAllOrders() const;
+  unsigned int getMatchingSizeForSecurity(std::string_view securityId) const;
+  SecurityAggregates getSecurityAggregates(std::string_view securityId) const;
+
+private:
+  struct Row
+  {
+    bool is_buy;
+    unsigned int qty;
+    unsigned int unmatched;
+    std::string user;
+    std::string company;
+  };
+  using Book = std::map<std::string, Row, std::less<>>; // by order id
+
+  void update_loop(std::chrono::microseconds interval);
+  bool update(); // apply the new changes and publish them, if any
+  void apply(const OrderChange &change);
+  void publish(uint64_t version);
+
+  ChangeFeed &_feed;
+  LoadOrders _load_orders;
+
+  // owned by the update thread
+  std::unordered_map<std::string, Book> _books; // by security id
+  std::unordered_set<std::string> _changed;      // securities since the last view
+  std::map<std::string, std::shared_ptr<const ReplicaSecurity>, std::less<>> _securities;
+  uint64_t _version = 0;
+
+  mutable std::mutex _view_mutex; // only held to copy or swap the view
+  mutable std::condition_variable _view_cv;
+  std::shared_ptr<const ReplicaView> _view;
+  uint64_t _resyncs = 0;
+
+  std::mutex _stop_mutex;
+  std::condition_variable _stop_cv;
+  bool _stop = false;
+  std::thread _update_thread;
+};
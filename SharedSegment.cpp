@@ -0,0 +1,209 @@
+#include "SharedSegment.h"
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define ORDERCACHE_HAVE_SHM 1
+#endif
+
+namespace
+{
+  // offsets of the parts of a segment
+  struct Layout
+  {
+    Layout(uint32_t capacity, uint32_t directory_size, uint32_t arena_size)
+    {
+      slots = align(sizeof(SharedSegmentHeader));
+      directory = slots + size_t{capacity} * sizeof(SharedSecuritySlot);
+      arena = directory + size_t{directory_size} * sizeof(std::atomic<uint32_t>);
+      size = arena + arena_size;
+    }
+
+    static size_t align(size_t offset) { return (offset + alignof(SharedSecuritySlot) - 1) / alignof(SharedSecuritySlot) * alignof(SharedSecuritySlot); }
+
+    size_t slots;
+    size_t directory;
+    size_t arena;
+    size_t size;
+  };
+
+  [[noreturn]] void fail(const std::string &name, const std::string &what)
+  {
+    throw std::runtime_error("shared segment " + name + ": " + what);
+  }
+}
+
+SharedMapping::~SharedMapping()
+{
+#if defined(ORDERCACHE_HAVE_SHM)
+  if (_data != nullptr)
+    munmap(_data, _size);
+#endif
+}
+
+SharedSegmentWriter::SharedSegmentWriter(const std::string &name, uint32_t capacity, uint32_t average_id_size) : _name(name)
+{
+  if (capacity == 0 || capacity > (1u << 30))
+    fail(name, "invalid capacity");
+
+  uint32_t directory_size = 1;
+  while (directory_size < 2 * capacity)
+    directory_size *= 2;
+
+  const auto arena_size = uint64_t{capacity} * average_id_size;
+  if (arena_size > UINT32_MAX)
+    fail(name, "security ids don't fit in the arena");
+
+  const Layout layout(capacity, directory_size, static_cast<uint32_t>(arena_size));
+
+#if defined(ORDERCACHE_HAVE_SHM)
+  shm_unlink(name.c_str()); // a segment left behind by a previous owner
+  const auto fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+  if (fd == -1)
+    fail(name, "cannot create");
+
+  if (ftruncate(fd, static_cast<off_t>(layout.size)) != 0)
+  {
+    close(fd);
+    shm_unlink(name.c_str());
+    fail(name, "cannot resize");
+  }
+
+  auto data = mmap(nullptr, layout.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED)
+  {
+    shm_unlink(name.c_str());
+    fail(name, "cannot map");
+  }
+  _mapping = SharedMapping(data, layout.size);
+#else
+  fail(name, "shared memory isn't supported on this platform");
+#endif
+
+  // the object is zero filled: only the atomics need constructing
+  auto *base = _mapping.data();
+  _header = new (base) SharedSegmentHeader{};
+  _slots = new (base + layout.slots) SharedSecuritySlot[capacity]{};
+  _directory = new (base + layout.directory) std::atomic<uint32_t>[directory_size]{};
+  _arena = base + layout.arena;
+
+  _header->version = SharedSegmentHeader::version_value;
+  _header->capacity = capacity;
+  _header->directory_size = directory_size;
+  _header->arena_size = static_cast<uint32_t>(arena_size);
+
+  std::atomic_thread_fence(std::memory_order_release);
+  std::memcpy(_header->magic, SharedSegmentHeader::magic_value, sizeof(_header->magic));
+}
+
+SharedSegmentWriter::~SharedSegmentWriter()
+{
+#if defined(ORDERCACHE_HAVE_SHM)
+  shm_unlink(_name.c_str());
+#endif
+}
+
+uint32_t SharedSegmentWriter::intern(std::string_view security_id)
+{
+  std::lock_guard lock(_mutex);
+
+  auto [it, inserted] = _interned.try_emplace(std::string(security_id), no_slot);
+  if (inserted == false)
+    return it->second;
+
+  const auto slot = _header->securities.load(std::memory_order_relaxed);
+  if (slot == _header->capacity || security_id.size() > _header->arena_size - _arena_used)
+  {
+    // remembered as not published, so that it's only counted once
+    _header->overflow.fetch_add(1, std::memory_order_relaxed);
+    return no_slot;
+  }
+
+  auto &s = _slots[slot];
+  s.hash = shared_segment_hash(security_id);
+  s.id_offset = _arena_used;
+  s.id_size = static_cast<uint32_t>(security_id.size());
+  std::memcpy(_arena + _arena_used, security_id.data(), security_id.size());
+  _arena_used += s.id_size;
+
+  // the directory entry publishes the slot (and its id) to the readers
+  const auto mask = _header->directory_size - 1;
+  auto index = static_cast<uint32_t>(s.hash) & mask;
+  while (_directory[index].load(std::memory_order_relaxed) != 0)
+    index = (index + 1) & mask;
+  _directory[index].store(slot + 1, std::memory_order_release);
+  _header->securities.store(slot + 1, std::memory_order_release);
+
+  it->second = slot;
+  return slot;
+}
+
+SharedSegmentReader::SharedSegmentReader(const std::string &name)
+{
+#if defined(ORDERCACHE_HAVE_SHM)
+  const auto fd = shm_open(name.c_str(), O_RDONLY, 0);
+  if (fd == -1)
+    fail(name, "cannot open");
+
+  struct stat st;
+  if (fstat(fd, &st) != 0)
+  {
+    close(fd);
+    fail(name, "cannot stat");
+  }
+
+  const auto size = static_cast<size_t>(st.st_size);
+  if (size < sizeof(SharedSegmentHeader))
+  {
+    close(fd);
+    fail(name, "not initialized");
+  }
+
+  auto data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED)
+    fail(name, "cannot map");
+  _mapping = SharedMapping(data, size);
+#else
+  fail(name, "shared memory isn't supported on this platform");
+#endif
+
+  const auto *base = _mapping.data();
+  _header = reinterpret_cast<const SharedSegmentHeader *>(base);
+
+  if (std::memcmp(_header->magic, SharedSegmentHeader::magic_value, sizeof(_header->magic)) != 0)
+    fail(name, "not initialized");
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (_header->version != SharedSegmentHeader::version_value)
+    fail(name, "unsupported version " + std::to_string(_header->version));
+
+  const Layout layout(_header->capacity, _header->directory_size, _header->arena_size);
+  if (layout.size > size)
+    fail(name, "truncated");
+
+  _slots = reinterpret_cast<const SharedSecuritySlot *>(base + layout.slots);
+  _directory = reinterpret_cast<const std::atomic<uint32_t> *>(base + layout.directory);
+  _arena = base + layout.arena;
+}
+
+std::optional<uint32_t> SharedSegmentReader::find(std::string_view security_id) const
+{
+  const auto hash = shared_segment_hash(security_id);
+  const auto mask = _header->directory_size - 1;
+  for (auto index = static_cast<uint32_t>(hash) & mask;; index = (index + 1) & mask)
+  {
+    const auto entry = _directory[index].load(std::memory_order_acquire);
+    if (entry == 0)
+      return std::nullopt;
+
+    const auto slot = entry - 1;
+    if (_slots[slot].hash == hash && securityId(slot) == security_id)
+      return slot;
+  }
+}
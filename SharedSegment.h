@@ -0,0 +1,230 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+
+// Shared memory segment publishing the matching size and order totals of
+// every security, so that other processes on the host can read them
+// without asking the cache (BasicOrderCache::setSharedSegment).
+//
+// The segment is a POSIX shared memory object (shm_open) with a fixed
+// layout:
+//
+//   SharedSegmentHeader
+//   SharedSecuritySlot[capacity]          (64 byte aligned)
+//   std::atomic<uint32_t>[directory_size] (slot + 1 by hash, 0 if empty)
+//   char[arena_size]                      (security ids)
+//
+// Securities are interned once: the writer takes the next slot, copies
+// the security id to the arena, then inserts the slot in the directory,
+// an open addressing table probed linearly from the id's hash. Slots and
+// directory entries are never removed, so a reader that found a slot can
+// keep reading it.
+//
+// The values of a slot are protected by a seqlock: the writer makes its
+// sequence odd, stores the values and makes it even again, and a reader
+// retries while the sequence is odd or changed over its read. Readers
+// never write to the segment, so they map it read-only and any number of
+// them can read while the cache is running.
+//
+// Only supported on POSIX systems; elsewhere the constructors throw.
+
+// values of a security
+struct SharedSecurityValues
+{
+  uint64_t buy_orders = 0;
+  uint64_t sell_orders = 0;
+  uint64_t buy_qty = 0;
+  uint64_t sell_qty = 0;
+  unsigned int matching_size = 0;
+};
+
+struct SharedSegmentHeader
+{
+  static constexpr char magic_value[8] = {'O', 'C', 'S', 'H', 'M', '0', '0', '1'};
+  static constexpr uint32_t version_value = 1;
+
+  char magic[8]; // written last, once the segment is initialized
+  uint32_t version;
+  uint32_t capacity;       // slots
+  uint32_t directory_size; // power of two, at least twice the capacity
+  uint32_t arena_size;
+  std::atomic<uint32_t> securities; // slots in use
+  std::atomic<uint32_t> overflow;   // securities not published, for lack of room
+};
+
+struct alignas(64) SharedSecuritySlot
+{
+  std::atomic<uint32_t> sequence; // odd while the values are written
+  std::atomic<uint32_t> matching_size;
+  std::atomic<uint64_t> buy_orders;
+  std::atomic<uint64_t> sell_orders;
+  std::atomic<uint64_t> buy_qty;
+  std::atomic<uint64_t> sell_qty;
+
+  // set before the slot is in the directory, then constant
+  uint64_t hash;
+  uint32_t id_offset; // in the arena
+  uint32_t id_size;
+};
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free && std::atomic<uint64_t>::is_always_lock_free,
+              "the segment needs address-free atomics");
+
+// hash of the security ids in the directory (FNV-1a), so that readers
+// don't depend on the writer's std::hash
+inline uint64_t shared_segment_hash(std::string_view value)
+{
+  uint64_t hash = 0xcbf29ce484222325ull;
+  for (const auto c : value)
+  {
+    hash ^= static_cast<unsigned char>(c);
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+
+// mapping of a shared memory object
+class SharedMapping
+{
+public:
+  SharedMapping() = default;
+  SharedMapping(void *data, size_t size) : _data(data), _size(size) {}
+  SharedMapping(SharedMapping &&other) noexcept : _data(other._data), _size(other._size) { other._data = nullptr; }
+  ~SharedMapping();
+
+  SharedMapping &operator=(SharedMapping &&other) noexcept
+  {
+    std::swap(_data, other._data);
+    std::swap(_size, other._size);
+    return *this;
+  }
+
+  char *data() const { return static_cast<char *>(_data); }
+  size_t size() const { return _size; }
+
+private:
+  void *_data = nullptr;
+  size_t _size = 0;
+};
+
+// the segment's owner: the cache publishes to it
+class SharedSegmentWriter
+{
+public:
+  static constexpr uint32_t no_slot = UINT32_MAX;
+
+  // create the segment `name` (eg "/ordercache", see shm_open), replacing
+  // any segment of that name, with room for `capacity` securities whose
+  // ids average at most `average_id_size` bytes. The segment is unlinked
+  // by the destructor (processes that mapped it keep their mapping).
+  // Throws std::runtime_error if it can't be created.
+  explicit SharedSegmentWriter(const std::string &name, uint32_t capacity = 1 << 16, uint32_t average_id_size = 16);
+  ~SharedSegmentWriter();
+
+  SharedSegmentWriter(const SharedSegmentWriter &) = delete;
+  SharedSegmentWriter &operator=(const SharedSegmentWriter &) = delete;
+
+  const std::string &name() const { return _name; }
+
+  // slot of a security, interning it if it's new; no_slot if the segment
+  // is full (counted once per security in the header's overflow).
+  // Thread safe.
+  uint32_t intern(std::string_view security_id);
+
+  // store the values of a slot; a slot must not be published by two
+  // threads at the same time
+  void publish(uint32_t slot, const SharedSecurityValues &values)
+  {
+    auto &s = _slots[slot];
+    const auto sequence = s.sequence.load(std::memory_order_relaxed);
+    s.sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    s.matching_size.store(values.matching_size, std::memory_order_relaxed);
+    s.buy_orders.store(values.buy_orders, std::memory_order_relaxed);
+    s.sell_orders.store(values.sell_orders, std::memory_order_relaxed);
+    s.buy_qty.store(values.buy_qty, std::memory_order_relaxed);
+    s.sell_qty.store(values.sell_qty, std::memory_order_relaxed);
+
+    s.sequence.store(sequence + 2, std::memory_order_release);
+  }
+
+private:
+  std::string _name;
+  SharedMapping _mapping;
+  SharedSegmentHeader *_header;
+  SharedSecuritySlot *_slots;
+  std::atomic<uint32_t> *_directory;
+  char *_arena;
+
+  std::mutex _mutex; // interning
+  std::unordered_map<std::string, uint32_t> _interned;
+  uint32_t _arena_used = 0;
+};
+
+// read-only view of a segment, from any process
+class SharedSegmentReader
+{
+public:
+  // map the segment `name` (a segment created again by a new owner needs
+  // a new reader). Throws std::runtime_error if it doesn't exist
+  // (or isn't initialized yet) or isn't a segment of this version.
+  explicit SharedSegmentReader(const std::string &name);
+
+  // securities published so far, in slots [0, size())
+  uint32_t size() const { return _header->securities.load(std::memory_order_acquire); }
+  uint32_t overflow() const { return _header->overflow.load(std::memory_order_relaxed); }
+
+  // slot of a security, if published (a slot stays valid, so it can be
+  // looked up once and read many times)
+  std::optional<uint32_t> find(std::string_view security_id) const;
+
+  std::string_view securityId(uint32_t slot) const { return {_arena + _slots[slot].id_offset, _slots[slot].id_size}; }
+
+  // consistent values of a slot
+  SharedSecurityValues read(uint32_t slot) const
+  {
+    const auto &s = _slots[slot];
+    SharedSecurityValues values;
+    while (true)
+    {
+      const auto sequence = s.sequence.load(std::memory_order_acquire);
+      if ((sequence & 1) == 0)
+      {
+        values.matching_size = s.matching_size.load(std::memory_order_relaxed);
+        values.buy_orders = s.buy_orders.load(std::memory_order_relaxed);
+        values.sell_orders = s.sell_orders.load(std::memory_order_relaxed);
+        values.buy_qty = s.buy_qty.load(std::memory_order_relaxed);
+        values.sell_qty = s.sell_qty.load(std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (s.sequence.load(std::memory_order_relaxed) == sequence)
+          return values;
+      }
+    }
+  }
+
+  // values of a security, if published
+  std::optional<SharedSecurityValues> read(std::string_view security_id) const
+  {
+    const auto slot = find(security_id);
+    if (slot.has_value() == false)
+      return std::nullopt;
+    return read(*slot);
+  }
+
+private:
+  SharedMapping _mapping;
+  const SharedSegmentHeader *_header;
+  const SharedSecuritySlot *_slots;
+  const std::atomic<uint32_t> *_directory;
+  const char *_arena;
+};
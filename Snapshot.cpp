@@ -0,0 +1,198 @@
+#include "Snapshot.h"
+#include <cstdio>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define ORDERCACHE_HAVE_MMAP 1
+#endif
+
+namespace
+{
+  constexpr uint64_t checksum_prime = 0x100000001b3ull * 0x9e3779b1ull;
+
+  inline uint64_t mix(uint64_t hash, uint64_t word)
+  {
+    hash ^= word;
+    hash *= checksum_prime;
+    return (hash << 31) | (hash >> 33);
+  }
+
+  constexpr size_t writer_buffer_size = 1 << 20;
+}
+
+void SnapshotChecksum::update(const char *data, size_t size)
+{
+  _length += size;
+
+  // complete a partial word from a previous update
+  while (_pending_size != 0 && size != 0)
+  {
+    _pending |= static_cast<uint64_t>(static_cast<unsigned char>(*data++)) << (8 * _pending_size);
+    --size;
+    if (++_pending_size == 8)
+    {
+      _hash = mix(_hash, _pending);
+      _pending = 0;
+      _pending_size = 0;
+    }
+  }
+
+  for (; size >= 8; data += 8, size -= 8)
+  {
+    uint64_t word;
+    std::memcpy(&word, data, 8);
+    _hash = mix(_hash, word);
+  }
+
+  for (; size != 0; --size)
+    _pending |= static_cast<uint64_t>(static_cast<unsigned char>(*data++)) << (8 * _pending_size++);
+}
+
+uint64_t SnapshotChecksum::value() const
+{
+  auto hash = mix(_hash, _pending ^ (static_cast<uint64_t>(_pending_size) << 56));
+  return mix(hash, _length);
+}
+
+SnapshotWriter::SnapshotWriter(const std::string &path)
+    : _path(path), _tmp_path(path + ".tmp"), _file(_tmp_path, std::ios::binary | std::ios::trunc)
+{
+  if (!_file)
+    throw std::runtime_error("snapshot: cannot open " + _tmp_path);
+
+  _buffer.reserve(writer_buffer_size);
+
+  // room for the header, written on commit
+  const SnapshotHeader header{};
+  _file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+}
+
+SnapshotWriter::~SnapshotWriter()
+{
+  if (_committed == false)
+  {
+    _file.close();
+    std::remove(_tmp_path.c_str());
+  }
+}
+
+void SnapshotWriter::write(const char *data, size_t size)
+{
+  _checksum.update(data, size);
+  _payload_size += size;
+
+  if (_buffer.size() + size > writer_buffer_size)
+    flush_buffer();
+
+  if (size > writer_buffer_size)
+    _file.write(data, static_cast<std::streamsize>(size));
+  else
+    _buffer.insert(_buffer.end(), data, data + size);
+}
+
+void SnapshotWriter::flush_buffer()
+{
+  _file.write(_buffer.data(), static_cast<std::streamsize>(_buffer.size()));
+  _buffer.clear();
+}
+
+void SnapshotWriter::commit(SnapshotHeader header)
+{
+  flush_buffer();
+
+  std::memcpy(header.magic, SnapshotHeader::magic_value, sizeof(header.magic));
+  header.version = SnapshotHeader::current_version;
+  header.byte_order = SnapshotHeader::byte_order_mark;
+  header.payload_size = _payload_size;
+  header.payload_checksum = _checksum.value();
+
+  _file.seekp(0);
+  _file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  _file.close();
+  if (!_file)
+    throw std::runtime_error("snapshot: cannot write " + _tmp_path);
+
+  if (std::rename(_tmp_path.c_str(), _path.c_str()) != 0)
+    throw std::runtime_error("snapshot: cannot rename " + _tmp_path + " to " + _path);
+
+  _committed = true;
+}
+
+MappedFile::MappedFile(const std::string &path)
+{
+#if defined(ORDERCACHE_HAVE_MMAP)
+  const auto fd = open(path.c_str(), O_RDONLY);
+  if (fd == -1)
+    throw std::runtime_error("cannot open " + path);
+
+  struct stat st;
+  if (fstat(fd, &st) != 0)
+  {
+    close(fd);
+    throw std::runtime_error("cannot stat " + path);
+  }
+
+  _size = static_cast<size_t>(st.st_size);
+  if (_size != 0)
+  {
+    auto data = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED)
+    {
+      close(fd);
+      throw std::runtime_error("cannot map " + path);
+    }
+    // the file is read front to back once
+    madvise(data, _size, MADV_SEQUENTIAL);
+    madvise(data, _size, MADV_WILLNEED);
+    _data = static_cast<const char *>(data);
+    _mapped = true;
+  }
+  close(fd);
+#else
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  if (!file)
+    throw std::runtime_error("cannot open " + path);
+
+  _fallback.resize(static_cast<size_t>(file.tellg()));
+  file.seekg(0);
+  file.read(_fallback.data(), static_cast<std::streamsize>(_fallback.size()));
+  _data = _fallback.data();
+  _size = _fallback.size();
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+#if defined(ORDERCACHE_HAVE_MMAP)
+  if (_mapped == true)
+    munmap(const_cast<char *>(_data), _size);
+#endif
+}
+
+SnapshotReader::SnapshotReader(const std::string &path) : _file(path)
+{
+  if (_file.size() < sizeof(SnapshotHeader))
+    fail("file too small");
+
+  std::memcpy(&_header, _file.data(), sizeof(_header));
+
+  if (std::memcmp(_header.magic, SnapshotHeader::magic_value, sizeof(_header.magic)) != 0)
+    fail("not a snapshot file");
+  if (_header.byte_order != SnapshotHeader::byte_order_mark)
+    fail("written with a different byte order");
+  if (_header.version != SnapshotHeader::current_version)
+    fail("unsupported version " + std::to_string(_header.version));
+  if (_header.payload_size != _file.size() - sizeof(SnapshotHeader))
+    fail("payload size mismatch");
+
+  _position = _file.data() + sizeof(SnapshotHeader);
+  _end = _position + _header.payload_size;
+
+  SnapshotChecksum checksum;
+  checksum.update(_position, _header.payload_size);
+  if (checksum.value() != _header.payload_checksum)
+    fail("checksum mismatch");
+}
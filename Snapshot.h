@@ -0,0 +1,159 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Building blocks of the OrderCache binary snapshot format.
+//
+// A snapshot file is a fixed-size SnapshotHeader followed by the payload,
+// written in native byte order (the header records it, so a file from a
+// machine with different endianness is rejected rather than misread).
+// Payload layout, all integers being uint32_t:
+//
+//   strings:    string_count x (length, bytes)  -- interned strings
+//   securities: security_count x
+//                 (security id string, buy count, sell count, edge count, matching size)
+//                 (buy count + sell count) x
+//                   (order id string, side string, user string, company string, qty, unmatched)
+//                 edge count x
+//                   (buy order index, sell order index, matched qty)
+//
+// Order indexes in edges are relative to the security's buy/sell orders.
+
+struct SnapshotHeader
+{
+  static constexpr char magic_value[8] = {'O', 'C', 'S', 'N', 'A', 'P', '\0', '\0'};
+  static constexpr uint32_t current_version = 2;
+  static constexpr uint32_t byte_order_mark = 0x01020304;
+
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint64_t payload_size;
+  uint64_t payload_checksum;
+  uint64_t string_count;
+  uint64_t security_count;
+  uint64_t order_count;
+  uint64_t edge_count;
+  uint64_t journal_lsn; // last journal record included (0: none)
+};
+
+// 64-bit checksum processing 8 bytes at a time, so verification doesn't
+// slow down loading from a fast disk (not cryptographic)
+class SnapshotChecksum
+{
+public:
+  void update(const char *data, size_t size);
+  uint64_t value() const;
+
+private:
+  uint64_t _hash = 0x9e3779b97f4a7c15ull;
+  uint64_t _length = 0;
+  uint64_t _pending = 0; // bytes not yet mixed (fewer than 8)
+  unsigned int _pending_size = 0;
+};
+
+// Buffered payload writer: writes to `path`.tmp and renames it over `path`
+// on commit(), so an existing snapshot is never left half-written.
+// Throws std::runtime_error on I/O errors.
+class SnapshotWriter
+{
+public:
+  explicit SnapshotWriter(const std::string &path);
+  ~SnapshotWriter();
+
+  SnapshotWriter(const SnapshotWriter &) = delete;
+  SnapshotWriter &operator=(const SnapshotWriter &) = delete;
+
+  void write_u32(uint32_t value) { write(reinterpret_cast<const char *>(&value), sizeof(value)); }
+
+  void write_string(std::string_view str)
+  {
+    write_u32(static_cast<uint32_t>(str.size()));
+    write(str.data(), str.size());
+  }
+
+  // fill in the header (magic, version, size, checksum + the given counts)
+  // and atomically replace the destination file
+  void commit(SnapshotHeader header);
+
+private:
+  void write(const char *data, size_t size);
+  void flush_buffer();
+
+  std::string _path;
+  std::string _tmp_path;
+  std::ofstream _file;
+  std::vector<char> _buffer;
+  uint64_t _payload_size = 0;
+  SnapshotChecksum _checksum;
+  bool _committed = false;
+};
+
+// Read-only memory mapping of a whole file (read into memory where mmap
+// isn't available). Throws std::runtime_error if it can't be opened.
+class MappedFile
+{
+public:
+  explicit MappedFile(const std::string &path);
+  ~MappedFile();
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  const char *data() const { return _data; }
+  size_t size() const { return _size; }
+
+private:
+  const char *_data = nullptr;
+  size_t _size = 0;
+  bool _mapped = false;
+  std::vector<char> _fallback;
+};
+
+// Bounds-checked reader over a mapped snapshot: the constructor validates
+// the header and checksum; string views returned point into the mapping.
+class SnapshotReader
+{
+public:
+  explicit SnapshotReader(const std::string &path);
+
+  const SnapshotHeader &header() const { return _header; }
+
+  uint32_t read_u32()
+  {
+    uint32_t value;
+    std::memcpy(&value, take(sizeof(value)), sizeof(value));
+    return value;
+  }
+
+  std::string_view read_string()
+  {
+    const auto size = read_u32();
+    return {take(size), size};
+  }
+
+  bool at_end() const { return _position == _end; }
+
+  [[noreturn]] static void fail(const std::string &what) { throw std::runtime_error("snapshot: " + what); }
+
+private:
+  const char *take(size_t size)
+  {
+    if (static_cast<size_t>(_end - _position) < size)
+      fail("truncated payload");
+    const auto data = _position;
+    _position += size;
+    return data;
+  }
+
+  MappedFile _file;
+  SnapshotHeader _header;
+  const char *_position;
+  const char *_end;
+};
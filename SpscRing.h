@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <utility>
+
+// Bounded lock-free single-producer/single-consumer ring buffer.
+//
+// The producer only writes the tail and the consumer only writes the head,
+// each keeping a cached copy of the other index that it refreshes only when
+// the ring looks full (producer) or empty (consumer), so in steady state
+// neither side touches the other's cache line. The capacity is rounded up
+// to a power of two. Values only need to be move constructible.
+template <typename T>
+class SpscRing
+{
+public:
+  explicit SpscRing(size_t capacity)
+  {
+    size_t size = 2;
+    while (size < capacity)
+      size *= 2;
+
+    _mask = size - 1;
+    _slots = std::make_unique<std::optional<T>[]>(size);
+  }
+
+  SpscRing(const SpscRing &) = delete;
+  SpscRing &operator=(const SpscRing &) = delete;
+
+  size_t capacity() const { return _mask + 1; }
+
+  // producer thread only: false (leaving value untouched) if the ring is full
+  bool try_push(T &value)
+  {
+    const auto tail = _tail.load(std::memory_order_relaxed);
+    if (tail - _cached_head == capacity())
+    {
+      _cached_head = _head.load(std::memory_order_acquire);
+      if (tail - _cached_head == capacity())
+        return false;
+    }
+
+    _slots[tail & _mask].emplace(std::move(value));
+    _tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // consumer thread only: nothing if the ring is empty
+  std::optional<T> try_pop()
+  {
+    const auto head = _head.load(std::memory_order_relaxed);
+    if (head == _cached_tail)
+    {
+      _cached_tail = _tail.load(std::memory_order_acquire);
+      if (head == _cached_tail)
+        return std::nullopt;
+    }
+
+    auto &slot = _slots[head & _mask];
+    std::optional<T> value(std::move(*slot));
+    slot.reset();
+    _head.store(head + 1, std::memory_order_release);
+    return value;
+  }
+
+  // consumer thread only
+  bool empty() const
+  {
+    return _head.load(std::memory_order_relaxed) == _tail.load(std::memory_order_acquire);
+  }
+
+private:
+  std::unique_ptr<std::optional<T>[]> _slots;
+  size_t _mask;
+
+  alignas(64) std::atomic<size_t> _tail{0}; // next position written by the producer
+  size_t _cached_head = 0;                  // producer's copy of _head
+
+  alignas(64) std::atomic<size_t> _head{0}; // next position read by the consumer
+  size_t _cached_tail = 0;                  // consumer's copy of _tail
+};
@@ -0,0 +1,61 @@
+#include "StatsExporter.h"
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+
+void writePrometheusText(std::ostream &os, const OrderCacheStats &stats, const std::string &prefix)
+{
+  for (size_t i = 0; i != static_cast<size_t>(StatsCounter::Count); ++i)
+  {
+    const auto &info = stats_counter_info(static_cast<StatsCounter>(i));
+    const auto type = info.type == StatsCounterType::Counter ? "counter" : "gauge";
+
+    os << "# HELP " << prefix << info.name << ' ' << info.help << '\n';
+    os << "# TYPE " << prefix << info.name << ' ' << type << '\n';
+    os << prefix << info.name << ' ' << stats.counters[i] << '\n';
+  }
+
+  if (stats.latency.enabled == false)
+    return;
+
+  static constexpr struct
+  {
+    double value;
+    const char *label;
+  } quantiles[] = {{0.5, "0.5"}, {0.9, "0.9"}, {0.99, "0.99"}, {0.999, "0.999"}};
+
+  const auto name = prefix + "latency_ns";
+  os << "# HELP " << name << " Latency of OrderCache operations and internal phases\n";
+  os << "# TYPE " << name << " summary\n";
+
+  for (size_t i = 0; i != static_cast<size_t>(LatencyMetric::Count); ++i)
+  {
+    const auto &histogram = stats.latency.metrics[i];
+    const auto op = latency_metric_name(static_cast<LatencyMetric>(i));
+
+    for (const auto &quantile : quantiles)
+      os << name << "{op=\"" << op << "\",quantile=\"" << quantile.label << "\"} " << histogram.percentile(quantile.value) << '\n';
+
+    os << name << "_sum{op=\"" << op << "\"} " << histogram.sum << '\n';
+    os << name << "_count{op=\"" << op << "\"} " << histogram.count << '\n';
+  }
+}
+
+void writePrometheusTextFile(const std::string &path, const OrderCacheStats &stats, const std::string &prefix)
+{
+  const auto tmp_path = path + ".tmp";
+  {
+    std::ofstream file(tmp_path, std::ios::trunc);
+    if (!file)
+      throw std::runtime_error("cannot open " + tmp_path);
+
+    writePrometheusText(file, stats, prefix);
+
+    file.flush();
+    if (!file)
+      throw std::runtime_error("cannot write " + tmp_path);
+  }
+
+  if (std::rename(tmp_path.c_str(), path.c_str()) != 0)
+    throw std::runtime_error("cannot rename " + tmp_path + " to " + path);
+}
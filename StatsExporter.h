@@ -0,0 +1,16 @@
+#pragma once
+
+#include <ostream>
+#include <string>
+
+#include "OrderCacheStats.h"
+
+// Write the stats in Prometheus text exposition format (version 0.0.4).
+// Counters are prefixed with `prefix`; latency histograms, when enabled,
+// are exported as summaries (quantiles in nanoseconds).
+void writePrometheusText(std::ostream &os, const OrderCacheStats &stats, const std::string &prefix = "ordercache_");
+
+// Same as above, but to a file. The text is written to a temporary file that
+// is then renamed over `path`, so a scraper never sees a partial file.
+// Throws std::runtime_error if the file cannot be written.
+void writePrometheusTextFile(const std::string &path, const OrderCacheStats &stats, const std::string &prefix = "ordercache_");
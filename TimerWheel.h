@@ -0,0 +1,212 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Hierarchical timer wheel over integer ticks (Varghese & Lauck).
+//
+// Four levels of 256 slots: level l holds the timers due within 256^(l+1)
+// ticks, in the slot of bits [8l, 8l+8) of their expiry. Whenever the time
+// crosses a multiple of 256^l, the matching slot of level l is cascaded,
+// re-inserting its timers in the lower levels, so each timer moves down at
+// most three times before it expires from level 0. Timers further away than
+// 2^32 ticks wait in the top level and are re-inserted when cascaded.
+//
+// Insert and cancel are O(1): timers are nodes of doubly linked slot lists
+// in a pool. A handle carries the generation of its node, so cancelling a
+// timer that already expired (or was cancelled) is a no-op. advance only
+// visits the ticks it has to: it jumps over the stretches in which the
+// lower levels are empty.
+//
+// Not thread safe.
+template <typename T>
+class TimerWheel
+{
+public:
+  using Handle = uint64_t; // 0 is never a valid handle
+
+  static constexpr unsigned int level_bits = 8;
+  static constexpr unsigned int level_count = 4;
+  static constexpr uint64_t slot_count = uint64_t{1} << level_bits;
+
+  explicit TimerWheel(uint64_t now = 0) : _now(now)
+  {
+    _heads.fill(nil);
+  }
+
+  uint64_t now() const { return _now; }
+  size_t size() const { return _size; }
+
+  // expiries not after now() are due on the next tick
+  Handle insert(uint64_t expiry, T value)
+  {
+    uint32_t index;
+    if (_free != nil)
+    {
+      index = _free;
+      _free = _nodes[index].next;
+    }
+    else
+    {
+      index = static_cast<uint32_t>(_nodes.size());
+      _nodes.emplace_back();
+    }
+
+    auto &node = _nodes[index];
+    node.expiry = std::max(expiry, _now + 1);
+    node.value = std::move(value);
+    link(index);
+    ++_size;
+    return handle_of(index);
+  }
+
+  // false if the timer isn't pending anymore
+  bool cancel(Handle handle)
+  {
+    const auto index = static_cast<uint32_t>(handle);
+    if (handle == 0 || index >= _nodes.size() || _nodes[index].generation != static_cast<uint32_t>(handle >> 32))
+      return false;
+
+    unlink(index);
+    release(index);
+    return true;
+  }
+
+  // move the time forward to `now`, appending the timers that expire (in
+  // expiry order) to `expired`
+  void advance(uint64_t now, std::vector<std::pair<Handle, T>> &expired)
+  {
+    while (_now < now)
+    {
+      if (_size == 0)
+      {
+        _now = now;
+        break;
+      }
+
+      // nothing can happen before the next multiple of 256^l if levels
+      // [0, l) are empty
+      unsigned int empty_levels = 0;
+      while (empty_levels != level_count - 1 && _level_sizes[empty_levels] == 0)
+        ++empty_levels;
+
+      const auto span = uint64_t{1} << (level_bits * empty_levels);
+      const auto next = (_now | (span - 1)) + 1;
+      if (next > now)
+      {
+        _now = now;
+        break;
+      }
+
+      _now = next;
+      tick(expired);
+    }
+  }
+
+private:
+  static constexpr uint32_t nil = UINT32_MAX;
+
+  struct Node
+  {
+    uint64_t expiry = 0;
+    uint32_t prev = nil;
+    uint32_t next = nil;
+    uint32_t generation = 1;
+    uint32_t slot = 0; // level * slot_count + slot in the level
+    T value{};
+  };
+
+  Handle handle_of(uint32_t index) const { return (static_cast<uint64_t>(_nodes[index].generation) << 32) | index; }
+
+  void link(uint32_t index)
+  {
+    auto &node = _nodes[index];
+
+    // timers too far away wait in the top level, as if due at its end
+    const auto delta = std::min(node.expiry - _now, (uint64_t{1} << (level_bits * level_count)) - 1);
+    const auto expiry = _now + delta;
+
+    unsigned int level = 0;
+    while (delta >> (level_bits * (level + 1)) != 0)
+      ++level;
+
+    node.slot = static_cast<uint32_t>(level * slot_count + ((expiry >> (level_bits * level)) & (slot_count - 1)));
+    node.prev = nil;
+    node.next = _heads[node.slot];
+    if (node.next != nil)
+      _nodes[node.next].prev = index;
+    _heads[node.slot] = index;
+    ++_level_sizes[level];
+  }
+
+  void unlink(uint32_t index)
+  {
+    auto &node = _nodes[index];
+    if (node.prev != nil)
+      _nodes[node.prev].next = node.next;
+    else
+      _heads[node.slot] = node.next;
+    if (node.next != nil)
+      _nodes[node.next].prev = node.prev;
+    --_level_sizes[node.slot / slot_count];
+  }
+
+  void release(uint32_t index)
+  {
+    auto &node = _nodes[index];
+    node.value = T{};
+    ++node.generation;
+    if (node.generation == 0)
+      node.generation = 1;
+    node.next = _free;
+    _free = index;
+    --_size;
+  }
+
+  // take the whole list of a slot
+  uint32_t take_slot(uint32_t slot)
+  {
+    const auto head = _heads[slot];
+    _heads[slot] = nil;
+    for (auto index = head; index != nil; index = _nodes[index].next)
+      --_level_sizes[slot / slot_count];
+    return head;
+  }
+
+  void tick(std::vector<std::pair<Handle, T>> &expired)
+  {
+    // cascade the levels whose period starts at this tick, highest first
+    for (auto level = level_count - 1; level != 0; --level)
+    {
+      if ((_now & ((uint64_t{1} << (level_bits * level)) - 1)) != 0)
+        continue;
+
+      const auto slot = static_cast<uint32_t>(level * slot_count + ((_now >> (level_bits * level)) & (slot_count - 1)));
+      for (auto index = take_slot(slot); index != nil;)
+      {
+        const auto next = _nodes[index].next;
+        link(index);
+        index = next;
+      }
+    }
+
+    for (auto index = take_slot(static_cast<uint32_t>(_now & (slot_count - 1))); index != nil;)
+    {
+      const auto next = _nodes[index].next;
+      expired.emplace_back(handle_of(index), std::move(_nodes[index].value));
+      release(index);
+      index = next;
+    }
+  }
+
+  std::vector<Node> _nodes;
+  uint32_t _free = nil; // free list of nodes, through next
+  std::array<uint32_t, level_count * slot_count> _heads;
+  std::array<size_t, level_count> _level_sizes{};
+  size_t _size = 0;
+  uint64_t _now;
+};
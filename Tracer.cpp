@@ -0,0 +1,162 @@
+#include "Tracer.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iterator>
+#include <stdexcept>
+
+namespace
+{
+  std::atomic<uint64_t> next_tracer_id{1};
+
+  void write_json_string(std::ostream &os, std::string_view str)
+  {
+    os << '"';
+    for (const auto c : str)
+    {
+      if (c == '"' || c == '\\')
+        os << '\\' << c;
+      else if (static_cast<unsigned char>(c) < 0x20)
+        os << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c) << std::dec << std::setfill(' ');
+      else
+        os << c;
+    }
+    os << '"';
+  }
+}
+
+const char *trace_span_name(TraceSpan span)
+{
+  static constexpr const char *names[] = {
+      "addOrder",
+      "cancelOrder",
+      "amendOrderQty",
+      "cancelOrdersForUser",
+      "cancelOrdersForSecIdWithMinimumQty",
+      "match_order",
+      "unmatch_order",
+      "update_matches",
+  };
+  static_assert(sizeof(names) / sizeof(names[0]) == static_cast<size_t>(TraceSpan::Count));
+  return names[static_cast<size_t>(span)];
+}
+
+Tracer::Tracer(size_t events_per_thread)
+    : _id(next_tracer_id.fetch_add(1, std::memory_order_relaxed)),
+      _events_per_thread(std::max<size_t>(events_per_thread, 1)),
+      _origin(clock::now()) {}
+
+Tracer::~Tracer() = default;
+
+Tracer::ThreadBuffer &Tracer::thread_buffer()
+{
+  // one cached buffer per thread: a thread alternating between tracers
+  // falls back to the registration path below
+  thread_local struct
+  {
+    uint64_t tracer_id = 0;
+    ThreadBuffer *buffer = nullptr;
+  } cache;
+
+  if (cache.tracer_id == _id)
+    return *cache.buffer;
+
+  const std::lock_guard lock(_buffers_mutex);
+
+  const auto owner = std::this_thread::get_id();
+  auto it = std::find_if(_buffers.begin(), _buffers.end(), [owner](const auto &buffer)
+                         { return buffer->owner == owner; });
+  if (it == _buffers.end())
+  {
+    _buffers.push_back(std::make_unique<ThreadBuffer>(_events_per_thread, owner, static_cast<uint32_t>(_buffers.size() + 1)));
+    it = std::prev(_buffers.end());
+  }
+
+  cache.tracer_id = _id;
+  cache.buffer = it->get();
+  return *cache.buffer;
+}
+
+void Tracer::record(TraceSpan span, uint64_t start_ns, uint64_t end_ns, std::string_view security, uint32_t orders_visited)
+{
+  auto &buffer = thread_buffer();
+
+  const auto position = buffer.head.load(std::memory_order_relaxed);
+  auto &event = buffer.events[position % buffer.events.size()];
+
+  event.seq.store(2 * position + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  event.start_ns = start_ns;
+  event.duration_ns = end_ns - start_ns;
+  event.orders_visited = orders_visited;
+  event.span = span;
+  event.security_length = static_cast<uint8_t>(std::min(security.size(), sizeof(event.security)));
+  std::memcpy(event.security, security.data(), event.security_length);
+
+  event.seq.store(2 * (position + 1), std::memory_order_release);
+  buffer.head.store(position + 1, std::memory_order_release);
+}
+
+void Tracer::writeChromeTrace(std::ostream &os) const
+{
+  const std::lock_guard lock(_buffers_mutex);
+
+  os << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+  auto first = true;
+
+  for (const auto &buffer : _buffers)
+  {
+    const auto head = buffer->head.load(std::memory_order_acquire);
+    const auto capacity = buffer->events.size();
+
+    for (auto position = head > capacity ? head - capacity : 0; position != head; ++position)
+    {
+      const auto &slot = buffer->events[position % capacity];
+
+      // copy the slot and check it wasn't (being) overwritten meanwhile
+      const auto seq = slot.seq.load(std::memory_order_acquire);
+      if (seq != 2 * (position + 1))
+        continue;
+
+      const auto start_ns = slot.start_ns;
+      const auto duration_ns = slot.duration_ns;
+      const auto orders_visited = slot.orders_visited;
+      const auto span = slot.span;
+      char security[sizeof(slot.security)];
+      const auto security_length = std::min<size_t>(slot.security_length, sizeof(security));
+      std::memcpy(security, slot.security, security_length);
+
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (slot.seq.load(std::memory_order_relaxed) != seq)
+        continue;
+
+      os << (first ? "\n" : ",\n");
+      first = false;
+
+      os << "{\"name\":\"" << trace_span_name(span) << "\",\"cat\":\"ordercache\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->thread_id
+         << std::fixed << std::setprecision(3)
+         << ",\"ts\":" << start_ns / 1000.0
+         << ",\"dur\":" << duration_ns / 1000.0
+         << ",\"args\":{\"security\":";
+      write_json_string(os, std::string_view(security, security_length));
+      os << ",\"orders_visited\":" << orders_visited << "}}";
+    }
+  }
+
+  os << "\n]}\n";
+}
+
+void Tracer::writeChromeTraceFile(const std::string &path) const
+{
+  std::ofstream file(path, std::ios::trunc);
+  if (!file)
+    throw std::runtime_error("cannot open " + path);
+
+  writeChromeTrace(file);
+
+  file.flush();
+  if (!file)
+    throw std::runtime_error("cannot write " + path);
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Spans recorded by OrderCache when a Tracer is attached
+enum class TraceSpan : uint8_t
+{
+  AddOrder,
+  CancelOrder,
+  AmendOrderQty,
+  CancelOrdersForUser,
+  CancelOrdersForSecIdWithMinimumQty,
+  MatchOrder,
+  UnmatchOrder,
+  UpdateMatches,
+  Count
+};
+
+const char *trace_span_name(TraceSpan span);
+
+// Flight recorder of spans that can be dumped as Chrome trace-event JSON
+// (loadable in Perfetto or chrome://tracing).
+//
+// Every thread that records spans gets its own ring buffer (registered on
+// first use), so recording is wait-free: the owning thread is the only
+// writer, and each slot carries a sequence number that lets the dump skip
+// slots overwritten while being read. When a ring is full the oldest spans
+// are overwritten.
+class Tracer
+{
+public:
+  using clock = std::chrono::steady_clock;
+
+  explicit Tracer(size_t events_per_thread = 1 << 16);
+  ~Tracer();
+
+  Tracer(const Tracer &) = delete;
+  Tracer &operator=(const Tracer &) = delete;
+
+  // nanoseconds since the tracer was created
+  uint64_t now() const { return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - _origin).count()); }
+
+  void record(TraceSpan span, uint64_t start_ns, uint64_t end_ns, std::string_view security, uint32_t orders_visited);
+
+  void writeChromeTrace(std::ostream &os) const;
+
+  // throws std::runtime_error if the file cannot be written
+  void writeChromeTraceFile(const std::string &path) const;
+
+private:
+  struct Event
+  {
+    std::atomic<uint64_t> seq{0}; // 2 * position + 1 while being written, 2 * (position + 1) when done
+    uint64_t start_ns;
+    uint64_t duration_ns;
+    uint32_t orders_visited;
+    TraceSpan span;
+    uint8_t security_length;
+    char security[34];
+  };
+  static_assert(sizeof(Event) == 64);
+
+  struct ThreadBuffer
+  {
+    ThreadBuffer(size_t capacity, std::thread::id owner, uint32_t thread_id) : events(capacity), owner(owner), thread_id(thread_id) {}
+
+    std::vector<Event> events;
+    std::atomic<uint64_t> head{0}; // total events recorded by this thread
+    const std::thread::id owner;
+    const uint32_t thread_id;
+  };
+
+  ThreadBuffer &thread_buffer();
+
+  const uint64_t _id; // process-wide unique id, to validate thread-local caches
+  const size_t _events_per_thread;
+  const clock::time_point _origin;
+
+  mutable std::mutex _buffers_mutex; // only taken to register a thread or dump
+  std::vector<std::unique_ptr<ThreadBuffer>> _buffers;
+};
+
+// RAII span: when the tracer is null (tracing disabled) the only cost is a
+// predictable null check on entry and exit.
+class TraceScope
+{
+public:
+  TraceScope(Tracer *tracer, TraceSpan span, std::string_view security = {}) noexcept
+      : _tracer(tracer), _span(span), _security(security)
+  {
+    if (_tracer != nullptr)
+      _start_ns = _tracer->now();
+  }
+
+  ~TraceScope()
+  {
+    if (_tracer != nullptr)
+      _tracer->record(_span, _start_ns, _tracer->now(), _security, _orders_visited);
+  }
+
+  TraceScope(const TraceScope &) = delete;
+  TraceScope &operator=(const TraceScope &) = delete;
+
+  void set_security(std::string_view security) noexcept { _security = security; }
+  void set_orders_visited(uint32_t orders_visited) noexcept { _orders_visited = orders_visited; }
+
+private:
+  Tracer *const _tracer;
+  const TraceSpan _span;
+  std::string_view _security;
+  uint64_t _start_ns = 0;
+  uint32_t _orders_visited = 0;
+};
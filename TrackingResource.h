@@ -0,0 +1,44 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+
+// Memory resource counting the bytes currently allocated through it, on
+// top of an upstream resource, to account for the memory of the containers
+// allocating from it (BasicOrderCache::memoryUsage).
+//
+// Counter is uint64_t for resources only used under their owner's lock,
+// and std::atomic<uint64_t> for ones shared by several threads. Counts the
+// bytes requested, not what the upstream resource rounds them up to.
+template <typename Counter = uint64_t>
+class TrackingResource : public std::pmr::memory_resource
+{
+public:
+  explicit TrackingResource(std::pmr::memory_resource *upstream = std::pmr::get_default_resource()) : _upstream(upstream) {}
+
+  TrackingResource(const TrackingResource &) = delete;
+  TrackingResource &operator=(const TrackingResource &) = delete;
+
+  uint64_t bytes() const { return _bytes; }
+
+private:
+  void *do_allocate(std::size_t bytes, std::size_t alignment) override
+  {
+    auto *p = _upstream->allocate(bytes, alignment);
+    _bytes += bytes;
+    return p;
+  }
+
+  void do_deallocate(void *p, std::size_t bytes, std::size_t alignment) override
+  {
+    _upstream->deallocate(p, bytes, alignment);
+    _bytes -= bytes;
+  }
+
+  bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override { return this == &other; }
+
+  std::pmr::memory_resource *_upstream;
+  Counter _bytes{0};
+};
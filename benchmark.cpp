@@ -1,44 +1,695 @@
+#if defined(BENCHMARK_SIMPLE_ORDER_CACHE)
+#include "simple/OrderCache.h"
+static constexpr auto implementation = "simple";
+#else
+#include "AsyncOrderCache.h"
 #include "OrderCache.h"
+#include "OrderFile.h"
+#include "PartitionedOrderCache.h"
+#include "SharedSegment.h"
+#include <unistd.h>
+static constexpr auto implementation = "final";
+#endif
+#include "PerfCounters.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
 #include <iomanip>
+#include <sstream>
+#include <algorithm>
+#include <optional>
+#include <thread>
 
-void test()
+std::vector<Order> make_orders(unsigned int iterations)
 {
-    OrderCache cache;
+    std::vector<Order> orders;
+    orders.reserve(iterations * 8);
 
     unsigned int orderNumber = 0;
     auto get_next_order_id = [&orderNumber]()
     { ++orderNumber; return "OrdId" + std::to_string(orderNumber); };
 
-    for (auto i = 0; i != 10000; ++i)
+    for (auto i = 0u; i != iterations; ++i)
     {
-        cache.addOrder(Order{get_next_order_id(), "SecId1", "Buy", 1000, "User1", "CompanyA"});
-        cache.addOrder(Order{get_next_order_id(), "SecId2", "Sell", 3000, "User2", "CompanyB"});
-        cache.addOrder(Order{get_next_order_id(), "SecId1", "Sell", 500, "User3", "CompanyA"});
-        cache.addOrder(Order{get_next_order_id(), "SecId2", "Buy", 600, "User4", "CompanyC"});
-        cache.addOrder(Order{get_next_order_id(), "SecId2", "Buy", 100, "User5", "CompanyB"});
-        cache.addOrder(Order{get_next_order_id(), "SecId3", "Buy", 1000, "User6", "CompanyD"});
-        cache.addOrder(Order{get_next_order_id(), "SecId2", "Buy", 2000, "User7", "CompanyE"});
-        cache.addOrder(Order{get_next_order_id(), "SecId2", "Sell", 5000, "User8", "CompanyE"});
+        orders.push_back(Order{get_next_order_id(), "SecId1", "Buy", 1000, "User1", "CompanyA"});
+        orders.push_back(Order{get_next_order_id(), "SecId2", "Sell", 3000, "User2", "CompanyB"});
+        orders.push_back(Order{get_next_order_id(), "SecId1", "Sell", 500, "User3", "CompanyA"});
+        orders.push_back(Order{get_next_order_id(), "SecId2", "Buy", 600, "User4", "CompanyC"});
+        orders.push_back(Order{get_next_order_id(), "SecId2", "Buy", 100, "User5", "CompanyB"});
+        orders.push_back(Order{get_next_order_id(), "SecId3", "Buy", 1000, "User6", "CompanyD"});
+        orders.push_back(Order{get_next_order_id(), "SecId2", "Buy", 2000, "User7", "CompanyE"});
+        orders.push_back(Order{get_next_order_id(), "SecId2", "Sell", 5000, "User8", "CompanyE"});
     }
+    return orders;
 }
 
-int main()
+void print_header(PerfCounters &perf)
 {
-    auto benchmark = [](auto func)
+    if (perf.available() == false)
+        std::cout << "hardware counters: unavailable (perf_event_open failed), reporting timings only\n";
+
+    std::cout << std::left << std::setw(56) << "phase" << std::right
+              << std::setw(10) << "ops" << std::setw(12) << "time (ms)" << std::setw(12) << "ns/op"
+              << std::setw(8) << "IPC" << std::setw(12) << "L1D miss/op" << std::setw(12) << "LLC miss/op" << std::setw(12) << "br miss/op" << '\n';
+}
+
+// measure func (performing `ops` operations) and print its timings and
+// hardware counters per operation
+template <typename Func>
+void benchmark(PerfCounters &perf, const std::string &name, size_t ops, Func func)
+{
+    perf.start();
+    const auto t1 = std::chrono::high_resolution_clock::now();
+
+    func();
+
+    const auto t2 = std::chrono::high_resolution_clock::now();
+    const auto sample = perf.stop();
+    const std::chrono::duration<double, std::milli> ms = t2 - t1;
+
+    auto format = [](bool available, double value)
+    {
+        std::ostringstream os;
+        if (available)
+            os << std::fixed << std::setprecision(2) << value;
+        else
+            os << "n/a";
+        return os.str();
+    };
+
+    auto per_op = [&](PerfCounters::Event event)
+    { return format(sample.has(event), static_cast<double>(sample[event]) / ops); };
+
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << std::left << std::setw(56) << name << std::right
+              << std::setw(10) << ops << std::setw(12) << ms.count() << std::setw(12) << ms.count() * 1e6 / ops
+              << std::setw(8) << format(sample.has(PerfCounters::Cycles) && sample.has(PerfCounters::Instructions), sample.ipc())
+              << std::setw(12) << per_op(PerfCounters::L1DMisses)
+              << std::setw(12) << per_op(PerfCounters::LLCMisses)
+              << std::setw(12) << per_op(PerfCounters::BranchMisses) << '\n';
+}
+
+template <typename Cache>
+void run_phases(PerfCounters &perf, const std::string &label, unsigned int iterations, unsigned int cancels)
+{
+    auto orders = make_orders(iterations);
+    const auto order_count = orders.size();
+
+    Cache cache;
+
+    benchmark(perf, label + " addOrder", order_count, [&]()
+              {
+                  for (auto &order : orders)
+                      cache.addOrder(std::move(order));
+              });
+
+    const size_t queries = 100000;
+    unsigned int total = 0;
+    benchmark(perf, label + " getMatchingSizeForSecurity", queries, [&]()
+              {
+                  const std::string securities[] = {"SecId1", "SecId2", "SecId3"};
+                  for (size_t i = 0; i != queries; ++i)
+                      total += cache.getMatchingSizeForSecurity(securities[i % 3]);
+              });
+
+    benchmark(perf, label + " getAllOrders", 1, [&]()
+              { total += static_cast<unsigned int>(cache.getAllOrders().size()); });
+
+    // cancel orders spread over the whole cache
+    const auto stride = std::max<size_t>(order_count / std::max(cancels, 1u), 1);
+    benchmark(perf, label + " cancelOrder", cancels, [&]()
+              {
+                  for (size_t i = 0; i != cancels; ++i)
+                      cache.cancelOrder("OrdId" + std::to_string(1 + (i * stride) % order_count));
+              });
+
+    benchmark(perf, label + " cancelOrdersForSecIdWithMinimumQty", 1, [&]()
+              { cache.cancelOrdersForSecIdWithMinimumQty("SecId1", 1000); });
+
+    benchmark(perf, label + " cancelOrdersForUser", 8, [&]()
+              {
+                  for (auto user = 1; user <= 8; ++user)
+                      cache.cancelOrdersForUser("User" + std::to_string(user));
+              });
+
+    // keep the queries from being optimized away
+    if (total == 1)
+        std::cout << '\n';
+}
+
+// orders of each thread, for its own set of securities
+std::vector<std::vector<Order>> make_thread_orders(unsigned int threads, unsigned int orders_per_thread)
+{
+    std::vector<std::vector<Order>> orders(threads);
+    for (auto t = 0u; t != threads; ++t)
+    {
+        orders[t].reserve(orders_per_thread);
+        for (auto i = 0u; i != orders_per_thread; ++i)
+        {
+            const auto security = "SecId" + std::to_string(t) + "_" + std::to_string(i % 64);
+            orders[t].push_back(Order{"OrdId" + std::to_string(t) + "_" + std::to_string(i), security, i % 2 == 0 ? "Buy" : "Sell",
+                                      100 + i % 7 * 100, "User" + std::to_string(i % 5), "Company" + std::to_string(i % 3)});
+        }
+    }
+    return orders;
+}
+
+// run func(thread index) on each of `threads` threads
+template <typename Func>
+void run_threads(unsigned int threads, Func func)
+{
+    std::vector<std::thread> workers;
+    for (auto t = 0u; t != threads; ++t)
+        workers.emplace_back(func, t);
+    for (auto &worker : workers)
+        worker.join();
+}
+
+// every thread adds orders (and reads the matching size back) for its own
+// set of securities, to compare lock contention between policies
+template <typename Cache>
+void run_concurrent_adds(PerfCounters &perf, const std::string &label, unsigned int threads, unsigned int orders_per_thread)
+{
+    auto orders = make_thread_orders(threads, orders_per_thread);
+
+    Cache cache;
+
+    benchmark(perf, label + " addOrder (" + std::to_string(threads) + " threads)", threads * orders_per_thread, [&]()
+              {
+                  run_threads(threads, [&cache, &orders](unsigned int t)
+                              {
+                                  for (auto &order : orders[t])
+                                  {
+                                      const auto security = order.securityId();
+                                      cache.addOrder(std::move(order));
+                                      cache.getMatchingSizeForSecurity(security);
+                                  } });
+              });
+}
+
+#if !defined(BENCHMARK_SIMPLE_ORDER_CACHE)
+// producers adding orders for their own securities, either through the
+// locks of the cache or through the single-writer command queue
+void run_async_adds(PerfCounters &perf, unsigned int threads, unsigned int orders_per_thread)
+{
+    const auto ops = threads * orders_per_thread;
+    const auto suffix = " addOrder only (" + std::to_string(threads) + " producers)";
+
+    {
+        auto orders = make_thread_orders(threads, orders_per_thread);
+        OrderCache cache;
+        benchmark(perf, "SharedMutexLockPolicy" + suffix, ops, [&]()
+                  { run_threads(threads, [&cache, &orders](unsigned int t)
+                                {
+                                    for (auto &order : orders[t])
+                                        cache.addOrder(std::move(order));
+                                }); });
+    }
+
     {
-        const auto t1 = std::chrono::high_resolution_clock::now();
+        auto orders = make_thread_orders(threads, orders_per_thread);
+        AsyncOrderCache<> async_cache;
+        benchmark(perf, "AsyncOrderCache" + suffix, ops, [&]()
+                  {
+                      run_threads(threads, [&async_cache, &orders](unsigned int t)
+                                  {
+                                      for (auto &order : orders[t])
+                                          async_cache.addOrder(std::move(order), nullptr);
+                                  });
+                      async_cache.flush().get();
+                  });
+        std::cout << "  " << static_cast<double>(async_cache.commandCount()) / async_cache.batchCount() << " commands per batch\n";
+    }
+}
+#endif
+
+#if !defined(BENCHMARK_SIMPLE_ORDER_CACHE)
+// warm start from a snapshot compared to replaying the orders through addOrder
+template <typename Cache>
+void run_snapshot(PerfCounters &perf, const std::string &label, unsigned int iterations)
+{
+    auto orders = make_orders(iterations);
+    const auto order_count = orders.size();
+
+    Cache cache;
+    for (auto &order : orders)
+        cache.addOrder(std::move(order));
 
-        func();
+    const std::string path = "benchmark_snapshot.bin";
+    benchmark(perf, label + " saveSnapshot", order_count, [&]()
+              { cache.saveSnapshot(path); });
 
-        const auto t2 = std::chrono::high_resolution_clock::now();
-        const std::chrono::duration<double, std::milli> ms = t2 - t1;
+    Cache loaded;
+    benchmark(perf, label + " loadSnapshot", order_count, [&]()
+              { loaded.loadSnapshot(path); });
 
-        std::cout << std::fixed << std::setprecision(1);
-        std::cout << "benchmark time: " << ms.count() << " ms\n";
+    std::remove(path.c_str());
+}
+
+// addOrder overhead of the write-ahead journal in each durability mode
+// (FsyncWait waits for an fsync per order from a single thread, so it only
+// adds a share of the orders)
+template <typename Cache>
+void run_journal(PerfCounters &perf, const std::string &label, unsigned int iterations)
+{
+    const std::pair<JournalDurability, const char *> modes[] = {{JournalDurability::Write, "Write"},
+                                                                {JournalDurability::Fsync, "Fsync"},
+                                                                {JournalDurability::FsyncWait, "FsyncWait"}};
+    for (const auto &[durability, name] : modes)
+    {
+        auto orders = make_orders(durability == JournalDurability::FsyncWait ? std::max(iterations / 16, 1u) : iterations);
+        const auto order_count = orders.size();
+
+        const std::string path = "benchmark_journal.bin";
+        std::remove(path.c_str());
+
+        Cache cache;
+        Journal journal(path, {durability});
+        cache.setJournal(&journal);
+
+        benchmark(perf, label + " addOrder (journal, " + name + ")", order_count, [&]()
+                  {
+                      for (auto &order : orders)
+                          cache.addOrder(std::move(order));
+                      journal.flush();
+                  });
+
+        cache.setJournal(nullptr);
+        std::remove(path.c_str());
+    }
+}
+
+// eager compared to lazy matching, for a write-heavy workload: each
+// security gets `writes` order replacements (a cancel and an add) between
+// two reads of its matching size. Eager matching pays for every write, lazy
+// matching for one re-match per read, so lazy wins once writes per read
+// exceed the crossover point.
+template <typename Cache>
+void run_lazy_matching(PerfCounters &perf, const std::string &label, unsigned int iterations)
+{
+    const auto securities = 10u, orders_per_security = 200u;
+    const auto writes_total = std::max(iterations * 4, 4096u);
+
+    for (const auto mode : {MatchingMode::Eager, MatchingMode::Lazy})
+        for (const auto writes : {1u, 4u, 16u, 64u, 256u})
+        {
+            Cache cache;
+            cache.setMatchingMode(mode);
+
+            // orders of each security, oldest first
+            std::vector<std::vector<std::string>> order_ids(securities);
+            unsigned int next_order = 0;
+            auto add = [&](unsigned int s)
+            {
+                order_ids[s].push_back("OrdId" + std::to_string(next_order));
+                cache.addOrder(Order{order_ids[s].back(), "SecId" + std::to_string(s), next_order % 2 == 0 ? "Buy" : "Sell", 100 + next_order % 7 * 100,
+                                     "User" + std::to_string(next_order % 5), "Company" + std::to_string(next_order % 3)});
+                ++next_order;
+            };
+            for (auto s = 0u; s != securities; ++s)
+                for (auto i = 0u; i != orders_per_security; ++i)
+                    add(s);
+            cache.getTopMatchingSecurities(1); // everything matched
+
+            uint64_t total = 0;
+            benchmark(perf, label + (mode == MatchingMode::Eager ? " eager" : " lazy") + ", " + std::to_string(writes) + " writes/read (per write)", writes_total, [&]()
+                      {
+                          for (auto done = 0u, s = 0u; done < writes_total; s = (s + 1) % securities)
+                          {
+                              for (auto w = 0u; w != writes; ++w, ++done)
+                              {
+                                  cache.cancelOrder(order_ids[s].front());
+                                  order_ids[s].erase(order_ids[s].begin());
+                                  add(s);
+                              }
+                              total += cache.getMatchingSizeForSecurity("SecId" + std::to_string(s));
+                          }
+                      });
+
+            // keep the reads from being optimized away
+            if (total == 1)
+                std::cout << '\n';
+        }
+}
+
+// building a cache from a known set of orders over many securities: one
+// addOrder per order, addOrders, and load (pre-sized, matched in parallel)
+template <typename Cache>
+void run_bulk_load(PerfCounters &perf, const std::string &label, unsigned int iterations, unsigned int threads)
+{
+    const auto order_count = iterations * 8;
+    auto make = [order_count]()
+    {
+        std::vector<Order> orders;
+        orders.reserve(order_count);
+        for (auto i = 0u; i != order_count; ++i)
+            orders.push_back(Order{"OrdId" + std::to_string(i), "SecId" + std::to_string(i % 1000), i % 2 == 0 ? "Buy" : "Sell", 100 + i % 7 * 100,
+                                   "User" + std::to_string(i % 50), "Company" + std::to_string(i % 7)});
+        return orders;
     };
 
-    benchmark(test);
+    auto orders = make();
+    {
+        Cache cache;
+        benchmark(perf, label + " build: addOrder", order_count, [&]()
+                  {
+                      for (auto &order : orders)
+                          cache.addOrder(std::move(order));
+                  });
+    }
+
+    orders = make();
+    {
+        Cache cache;
+        benchmark(perf, label + " build: addOrders", order_count, [&]()
+                  { cache.addOrders(std::move(orders)); });
+    }
+
+    for (const auto load_threads : {1u, threads})
+    {
+        orders = make();
+        std::optional<Cache> cache;
+        benchmark(perf, label + " build: load (" + std::to_string(load_threads) + " threads)", order_count, [&]()
+                  { cache.emplace(std::move(orders), BulkLoadOptions{1000, 50, 7, load_threads}); });
+    }
+}
+
+// order file ingestion: tokenizing throughput on a large file, and adding
+// the orders through the bulk path compared to addOrder
+template <typename Cache>
+void run_order_file(PerfCounters &perf, const std::string &label, unsigned int iterations, unsigned int threads)
+{
+    std::ostringstream lines;
+    for (const auto &order : make_orders(iterations))
+        lines << order.orderId() << ' ' << order.securityId() << ' ' << order.side() << ' ' << order.qty() << ' ' << order.user() << ' ' << order.company() << '\n';
+    const auto text = lines.str();
+
+    const std::string path = "benchmark_orders.txt";
+    {
+        // repeated up to 64 MB to measure tokenizing throughput
+        std::ofstream file(path, std::ios::binary);
+        for (size_t size = 0; size < (64u << 20); size += text.size())
+            file << text;
+    }
+
+    size_t bytes = 0, records = 0;
+    benchmark(perf, label + " OrderFile tokenize (" + std::to_string(threads) + " threads)", 1, [&]()
+              {
+                  OrderFile orders(path, threads);
+                  bytes = orders.byte_count();
+                  records = orders.record_count();
+              });
+    std::cout << "  " << records << " records, " << bytes / (1 << 20) << " MB\n";
+
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file << text;
+    }
+
+    Cache cache;
+    benchmark(perf, label + " OrderFile load + addOrders", iterations * 8, [&]()
+              {
+                  OrderFile orders(path, threads);
+                  orders.addTo(cache);
+              });
+
+    std::remove(path.c_str());
+}
+
+// qty amends spread over the whole cache: cancelling and re-adding each
+// order, compared to amending it in place
+template <typename Cache>
+void run_amends(PerfCounters &perf, const std::string &label, unsigned int iterations, unsigned int amends)
+{
+    const auto order_count = iterations * 8;
+    const auto stride = std::max<size_t>(order_count / std::max(amends, 1u), 1);
+
+    Cache replaced;
+    for (auto &order : make_orders(iterations))
+        replaced.addOrder(std::move(order));
+
+    auto orders = make_orders(iterations);
+    benchmark(perf, label + " amend (cancelOrder + addOrder)", amends, [&]()
+              {
+                  for (size_t i = 0; i != amends; ++i)
+                  {
+                      const auto &order = orders[(i * stride) % order_count];
+                      replaced.cancelOrder(order.orderId());
+                      replaced.addOrder(Order{order.orderId(), order.securityId(), order.side(), order.qty() / 2 + 1, order.user(), order.company()});
+                  }
+              });
+
+    Cache amended;
+    for (auto &order : make_orders(iterations))
+        amended.addOrder(std::move(order));
+
+    benchmark(perf, label + " amend (amendOrderQty)", amends, [&]()
+              {
+                  for (size_t i = 0; i != amends; ++i)
+                  {
+                      const auto &order = orders[(i * stride) % order_count];
+                      amended.amendOrderQty(order.orderId(), order.qty() / 2 + 1);
+                  }
+              });
+}
+
+// producers adding orders for their own securities to a partitioned
+// cache with as many partitions, against the sharded locks: per-partition
+// throughput should stay flat as partitions are added (given the cores)
+void run_partitioned_adds(PerfCounters &perf, unsigned int partitions, unsigned int orders_per_thread)
+{
+    const auto ops = partitions * orders_per_thread;
+    const auto suffix = " addOrder only (" + std::to_string(partitions) + " producers)";
+
+    {
+        auto orders = make_thread_orders(partitions, orders_per_thread);
+        BasicOrderCache<ShardedLockPolicy<>> cache;
+        benchmark(perf, "ShardedLockPolicy" + suffix, ops, [&]()
+                  { run_threads(partitions, [&cache, &orders](unsigned int t)
+                                {
+                                    for (auto &order : orders[t])
+                                        cache.addOrder(std::move(order));
+                                }); });
+    }
+
+    {
+        auto orders = make_thread_orders(partitions, orders_per_thread);
+        PartitionedOrderCache cache({partitions});
+        benchmark(perf, "PartitionedOrderCache" + suffix, ops, [&]()
+                  { run_threads(partitions, [&cache, &orders](unsigned int t)
+                                {
+                                    auto producer = cache.producer();
+                                    for (auto &order : orders[t])
+                                        producer.addOrder(std::move(order));
+                                    producer.flush();
+                                }); });
+    }
+}
+
+// good-till-time orders over 1000 securities, expiring over a second and
+// advanced one millisecond at a time: each step only visits the orders that
+// are due, and re-matches each of their securities once
+template <typename Cache>
+void run_expiry(PerfCounters &perf, const std::string &label, unsigned int iterations)
+{
+    using namespace std::chrono_literals;
+
+    Cache cache;
+    const auto order_count = iterations * 8;
+    const auto start = Cache::expiry_clock::now();
+
+    benchmark(perf, label + " addOrder (with expiry)", order_count, [&]()
+              {
+                  for (auto i = 0u; i != order_count; ++i)
+                      cache.addOrder(Order{"OrdId" + std::to_string(i), "SecId" + std::to_string(i % 1000), i % 2 == 0 ? "Buy" : "Sell", 100 + i % 7 * 100,
+                                           "User" + std::to_string(i % 5), "Company" + std::to_string(i % 3)},
+                                     start + 1ms + std::chrono::milliseconds(i * 1000ull / order_count));
+              });
+
+    size_t expired = 0;
+    benchmark(perf, label + " advanceTime (1000 steps, per expired order)", order_count, [&]()
+              {
+                  for (auto step = 1; step <= 1001; ++step)
+                      expired += cache.advanceTime(start + std::chrono::milliseconds(step));
+              });
+    std::cout << "  " << expired << " orders expired\n";
+}
+
+// top securities by matching size over many securities: scanning them all
+// and sorting, compared to the maintained ranking
+template <typename Cache>
+void run_top_securities(PerfCounters &perf, const std::string &label, unsigned int securities)
+{
+    Cache cache;
+    std::vector<std::string> security_ids;
+    for (auto i = 0u; i != securities; ++i)
+    {
+        security_ids.push_back("SecId" + std::to_string(i));
+        cache.addOrder(Order{"Buy" + std::to_string(i), security_ids.back(), "Buy", 100 + i % 997, "User1", "CompanyA"});
+        cache.addOrder(Order{"Sell" + std::to_string(i), security_ids.back(), "Sell", 100 + i % 991, "User2", "CompanyB"});
+    }
+
+    const size_t queries = 100, n = 10;
+    size_t total = 0;
+    benchmark(perf, label + " top " + std::to_string(n) + " of " + std::to_string(securities) + " (scan + sort)", queries, [&]()
+              {
+                  for (size_t q = 0; q != queries; ++q)
+                  {
+                      std::vector<std::pair<unsigned int, std::string>> sizes;
+                      for (const auto &security_id : security_ids)
+                          sizes.emplace_back(cache.getMatchingSizeForSecurity(security_id), security_id);
+                      std::partial_sort(sizes.begin(), sizes.begin() + n, sizes.end(), [](const auto &a, const auto &b)
+                                        { return a.first != b.first ? a.first > b.first : a.second < b.second; });
+                      total += sizes[0].first;
+                  }
+              });
+
+    benchmark(perf, label + " top " + std::to_string(n) + " of " + std::to_string(securities) + " (getTopMatchingSecurities)", queries, [&]()
+              {
+                  for (size_t q = 0; q != queries; ++q)
+                      total += cache.getTopMatchingSecurities(n)[0].second;
+              });
+
+    // keep the queries from being optimized away
+    if (total == 1)
+        std::cout << '\n';
+}
+
+// reads of the matching size through the cache, and from a mapping of the
+// shared segment as another process would (by id, or by a slot looked up
+// once), plus the cost of publishing to the segment on addOrder
+template <typename Cache>
+void run_shared_segment(PerfCounters &perf, const std::string &label, unsigned int iterations)
+{
+    const auto name = "/ordercache_benchmark_" + std::to_string(getpid());
+    SharedSegmentWriter segment(name);
+    const auto orders = make_orders(iterations);
+
+    Cache cache;
+    cache.setSharedSegment(&segment);
+    benchmark(perf, label + " addOrder (shared segment)", orders.size(), [&]()
+              {
+                  for (const auto &order : orders)
+                      cache.addOrder(order);
+              });
+
+    const SharedSegmentReader reader(name);
+    const size_t reads = 1000000;
+    const std::string security_id = "SecId2";
+    uint64_t total = 0;
+    benchmark(perf, label + " getMatchingSizeForSecurity", reads, [&]()
+              {
+                  for (size_t i = 0; i != reads; ++i)
+                      total += cache.getMatchingSizeForSecurity(security_id);
+              });
+    benchmark(perf, label + " shared segment read by id", reads, [&]()
+              {
+                  for (size_t i = 0; i != reads; ++i)
+                      total += reader.read(security_id)->matching_size;
+              });
+    const auto slot = *reader.find(security_id);
+    benchmark(perf, label + " shared segment read by slot", reads, [&]()
+              {
+                  for (size_t i = 0; i != reads; ++i)
+                      total += reader.read(slot).matching_size;
+              });
+
+    // keep the reads from being optimized away
+    if (total == 1)
+        std::cout << '\n';
+}
+
+// memory used by books of increasing size, spread over a fixed number of
+// securities, per kind of container (the containers allocating from the
+// cache's pool are counted exactly, see BasicOrderCache::memoryUsage)
+template <typename Cache>
+void run_memory_usage(const std::string &label, const std::vector<unsigned int> &book_sizes)
+{
+    const auto securities = 100u;
+
+    std::cout << label << " memory usage\n"
+              << std::right << std::setw(10) << "orders" << std::setw(10) << "edges" << std::setw(12) << "total KiB"
+              << std::setw(10) << "B/order" << std::setw(10) << "B/edge" << std::setw(12) << "order maps" << std::setw(10) << "strings"
+              << std::setw(14) << "order matches" << std::setw(10) << "matches" << std::setw(14) << "security maps" << std::setw(10) << "owners"
+              << std::setw(14) << "pool reserved" << '\n';
+
+    for (const auto orders : book_sizes)
+    {
+        Cache cache;
+        for (auto i = 0u; i != orders; ++i)
+            cache.addOrder(Order{"OrdId" + std::to_string(i), "SecId" + std::to_string(i % securities), i / securities % 2 == 0 ? "Buy" : "Sell",
+                                 100 + i % 7 * 100, "User" + std::to_string(i % 50), "Company" + std::to_string(i % 13)});
+
+        const auto usage = cache.memoryUsage();
+        std::cout << std::setw(10) << usage.totals.orders << std::setw(10) << usage.totals.match_edges << std::setw(12) << usage.total() / 1024
+                  << std::fixed << std::setprecision(1) << std::setw(10) << usage.bytesPerOrder() << std::setw(10) << usage.bytesPerMatchEdge()
+                  << std::setw(12) << usage.totals.order_maps << std::setw(10) << usage.totals.strings << std::setw(14) << usage.totals.order_matches
+                  << std::setw(10) << usage.totals.matches << std::setw(14) << usage.security_maps << std::setw(10) << usage.owners
+                  << std::setw(14) << usage.pool_reserved << '\n';
+    }
+}
+#endif
+
+int main(int argc, char **argv)
+{
+#if !defined(BENCHMARK_SIMPLE_ORDER_CACHE)
+    // memory mode: "benchmark memory [book sizes...]" only reports the
+    // memory usage of books of each size
+    if (argc > 1 && std::string(argv[1]) == "memory")
+    {
+        std::vector<unsigned int> book_sizes;
+        for (auto i = 2; i < argc; ++i)
+            book_sizes.push_back(static_cast<unsigned int>(std::atoi(argv[i])));
+        if (book_sizes.empty() == true)
+            book_sizes = {1000, 10000, 100000};
+
+        run_memory_usage<BasicOrderCache<NullLockPolicy>>("NullLockPolicy", book_sizes);
+        return 0;
+    }
+#endif
+
+    // number of iterations of the 8 orders pattern to add
+    const unsigned int iterations = argc > 1 ? static_cast<unsigned int>(std::atoi(argv[1])) : 2000;
+    // number of orders cancelled one by one (each one re-matches its
+    // security, so keep it low for the final implementation)
+    const unsigned int cancels = argc > 2 ? static_cast<unsigned int>(std::atoi(argv[2])) : 100;
+
+    PerfCounters perf;
+
+    std::cout << "implementation: " << implementation << '\n';
+    print_header(perf);
+
+    run_phases<OrderCache>(perf, implementation, iterations, cancels);
+
+#if !defined(BENCHMARK_SIMPLE_ORDER_CACHE)
+    // number of threads for the lock contention benchmark
+    const unsigned int threads = argc > 3 ? static_cast<unsigned int>(std::atoi(argv[3])) : std::max(std::thread::hardware_concurrency(), 2u);
+
+    // lock policies of the final implementation
+    run_phases<BasicOrderCache<NullLockPolicy>>(perf, "NullLockPolicy", iterations, cancels);
+    run_phases<BasicOrderCache<ShardedLockPolicy<>>>(perf, "ShardedLockPolicy", iterations, cancels);
+
+    run_snapshot<OrderCache>(perf, implementation, iterations);
+    run_journal<OrderCache>(perf, implementation, iterations);
+    run_order_file<OrderCache>(perf, implementation, iterations, threads);
+    run_bulk_load<BasicOrderCache<ShardedLockPolicy<>>>(perf, "ShardedLockPolicy", iterations, threads);
+    run_amends<OrderCache>(perf, implementation, iterations, cancels);
+    run_top_securities<OrderCache>(perf, implementation, 10000);
+    run_expiry<OrderCache>(perf, implementation, iterations);
+    run_shared_segment<OrderCache>(perf, implementation, iterations);
+    run_lazy_matching<OrderCache>(perf, implementation, iterations);
+
+    run_concurrent_adds<BasicOrderCache<SharedMutexLockPolicy>>(perf, "SharedMutexLockPolicy", threads, iterations * 8 / threads);
+    run_concurrent_adds<BasicOrderCache<ShardedLockPolicy<>>>(perf, "ShardedLockPolicy", threads, iterations * 8 / threads);
+
+    for (const auto producers : {2u, threads, threads * 4})
+        run_async_adds(perf, producers, iterations * 8 / producers);
+
+    for (const auto partitions : {1u, 2u, threads})
+        run_partitioned_adds(perf, partitions, iterations * 8 / partitions);
+#endif
 
     return 0;
-}
\ No newline at end of file
+}
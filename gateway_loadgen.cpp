@@ -0,0 +1,127 @@
+// Load generator for the order gateway: each connection (on its own
+// thread) keeps up to `depth` requests in flight, a mix of adds, cancels
+// of its earlier orders and matching size queries, and the round trip of
+// every request is recorded from the time it is sent to the time its
+// response is read.
+//
+// usage: gateway_loadgen [socket path] [connections] [requests per connection] [pipeline depth]
+
+#include "Gateway.h"
+#include "LatencyHistogram.h"
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+
+using load_clock = std::chrono::steady_clock;
+
+static uint64_t elapsed_ns(load_clock::time_point begin, load_clock::time_point end)
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count());
+}
+
+static void run_connection(const std::string &path, unsigned int connection, unsigned int requests, unsigned int depth, LatencyHistogram &round_trips)
+{
+    GatewayClient client(path);
+
+    const auto order_id = [connection](unsigned int n)
+    { return "L" + std::to_string(connection) + "-" + std::to_string(n); };
+    const auto security_id = [](unsigned int n)
+    { return "SecId" + std::to_string(n % 100); };
+
+    // send times by tag, for the requests in flight
+    std::vector<load_clock::time_point> sent_at(depth);
+    unsigned int sent = 0, received = 0, added = 0, cancelled = 0;
+
+    while (received != requests)
+    {
+        // top the window up once half of it has been answered, so that
+        // requests go out (and are read by the server) in batches
+        if (sent - received <= depth / 2 && sent != requests)
+        {
+            const auto now = load_clock::now();
+            while (sent - received != depth && sent != requests)
+            {
+                uint32_t tag;
+                switch (sent % 4)
+                {
+                case 0:
+                case 2:
+                    tag = client.queueAddOrder(order_id(added), security_id(added), added % 2 == 0 ? "Buy" : "Sell", 100 * (1 + added % 10),
+                                               "User" + std::to_string(added % 50), "Company" + std::to_string(added % 20));
+                    ++added;
+                    break;
+                case 1:
+                    tag = cancelled != added ? client.queueCancelOrder(order_id(cancelled++)) : client.queueGetMatchingSizeForSecurity(security_id(sent));
+                    break;
+                default:
+                    tag = client.queueGetMatchingSizeForSecurity(security_id(sent));
+                    break;
+                }
+                sent_at[tag % depth] = now;
+                ++sent;
+            }
+            client.flush();
+        }
+
+        const auto response = client.readResponse();
+        round_trips.record(elapsed_ns(sent_at[response.tag % depth], load_clock::now()));
+        if (response.status != GatewayStatus::Ok)
+            throw std::runtime_error("request " + std::to_string(response.tag) + " failed");
+        ++received;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const std::string path = argc > 1 ? argv[1] : "/tmp/ordercache.sock";
+    const unsigned int connections = argc > 2 ? static_cast<unsigned int>(std::atoi(argv[2])) : 4;
+    const unsigned int requests = argc > 3 ? static_cast<unsigned int>(std::atoi(argv[3])) : 100000;
+    const unsigned int depth = argc > 4 ? std::max(static_cast<unsigned int>(std::atoi(argv[4])), 1u) : 64;
+
+    LatencyHistogram round_trips;
+    std::vector<std::thread> threads;
+    std::vector<std::exception_ptr> errors(connections);
+
+    const auto begin = load_clock::now();
+    for (unsigned int c = 0; c != connections; ++c)
+        threads.emplace_back([&, c]()
+                             {
+                                 try
+                                 {
+                                     run_connection(path, c, requests, depth, round_trips);
+                                 }
+                                 catch (...)
+                                 {
+                                     errors[c] = std::current_exception();
+                                 } });
+    for (auto &thread : threads)
+        thread.join();
+    const auto seconds = elapsed_ns(begin, load_clock::now()) / 1e9;
+
+    for (const auto &error : errors)
+        if (error)
+        {
+            try
+            {
+                std::rethrow_exception(error);
+            }
+            catch (const std::exception &e)
+            {
+                std::cerr << e.what() << '\n';
+                return 1;
+            }
+        }
+
+    const auto snapshot = round_trips.snapshot();
+    std::cout << connections << " connections x " << requests << " requests, pipeline depth " << depth << '\n'
+              << std::fixed << std::setprecision(0)
+              << "throughput: " << snapshot.count / seconds << " requests/s\n"
+              << "round trip (us): mean " << std::setprecision(1) << snapshot.mean() / 1000
+              << ", p50 " << snapshot.percentile(0.5) / 1000.0
+              << ", p99 " << snapshot.percentile(0.99) / 1000.0
+              << ", p99.9 " << snapshot.percentile(0.999) / 1000.0
+              << ", max " << snapshot.max() / 1000.0 << '\n';
+    return 0;
+}
@@ -0,0 +1,49 @@
+// Order gateway server: serves an order cache on a Unix domain socket (see
+// Gateway.h) until interrupted.
+//
+// usage: order_gateway [socket path]
+
+#include "Gateway.h"
+#include <csignal>
+#include <iostream>
+
+// the gateway serves every connection from one thread, so the cache needs
+// no locks
+using GatewayCache = BasicOrderCache<NullLockPolicy>;
+
+static OrderGateway *gateway = nullptr;
+
+static void on_signal(int)
+{
+    if (gateway != nullptr)
+        gateway->stop();
+}
+
+int main(int argc, char **argv)
+{
+    const std::string path = argc > 1 ? argv[1] : "/tmp/ordercache.sock";
+
+    try
+    {
+        GatewayCache cache;
+        OrderGateway server(cache, path);
+        gateway = &server;
+        std::signal(SIGINT, on_signal);
+        std::signal(SIGTERM, on_signal);
+
+        std::cout << "serving on " << path << std::endl;
+        server.run();
+        gateway = nullptr;
+
+        const auto stats = server.stats();
+        std::cout << stats.connections << " connections, " << stats.requests << " requests in " << stats.reads << " reads ("
+                  << (stats.reads != 0 ? static_cast<double>(stats.requests) / stats.reads : 0.0) << " per read), "
+                  << stats.writes << " writes\n";
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+    return 0;
+}